@@ -0,0 +1,196 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "allocreport.h"
+#include "alloctrack.h"
+#include "catalog.h"
+#include "collectioneditorwidget.h"
+#include "ingredientwidget.h"
+#include "ioexecutor.h"
+#include "mainwindow.h"
+#include "masscalculatorwidget.h"
+#include "masslineedit.h"
+#include "recipe.h"
+#include <QApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QKeyEvent>
+#include <QMap>
+#include <QTemporaryDir>
+#include <QTextCodec>
+#include <QTextStream>
+#include <functional>
+
+namespace {
+    const int SampleIngredients = 20;
+
+    struct Budget {
+        quint64 allocations;
+        quint64 bytes;
+    };
+
+    QMap<QString, Budget> readBudgets(const QString &fileName) {
+        QMap<QString, Budget> budgets;
+        QFile file(fileName);
+        if (fileName.isEmpty() || !file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return budgets;
+        QTextStream in(&file);
+        in.setCodec(QTextCodec::codecForName("UTF-8"));
+        while (!in.atEnd()) {
+            QString line = in.readLine().trimmed();
+            int equals = line.lastIndexOf('=');
+            if (line.startsWith('#') || equals < 0)
+                continue;
+            QStringList limits = line.mid(equals + 1).split(',');
+            Budget budget;
+            budget.allocations = limits.value(0).trimmed().toULongLong();
+            budget.bytes = limits.value(1).trimmed().toULongLong();
+            budgets.insert(line.left(equals).trimmed(), budget);
+        }
+        return budgets;
+    }
+
+    // the first catalog entries with a mass each, for runs without a recipe
+    Recipe sampleRecipe() {
+        Recipe recipe;
+        for (auto &&line : Catalog::entryLines().mid(0, SampleIngredients)) {
+            Recipe::Item item;
+            if (!Catalog::parseLine(line, &item.ingredient))
+                continue;
+            item.mass = QString::number(50 + 10 * recipe.items.count());
+            recipe.items.append(item);
+        }
+        recipe.instructions = "Ανακατεύουμε όλα τα υλικά.";
+        return recipe;
+    }
+
+    void typeText(QWidget *widget, const QString &text) {
+        widget->setFocus();
+        for (auto &&c : text) {
+            QKeyEvent press(QEvent::KeyPress, c.unicode(), Qt::NoModifier, QString(c));
+            QKeyEvent release(QEvent::KeyRelease, c.unicode(), Qt::NoModifier, QString(c));
+            QApplication::sendEvent(widget, &press);
+            QApplication::sendEvent(widget, &release);
+        }
+    }
+}
+
+int AllocReport::run(MainWindow *window, const QString &recipeFile, const QString &budgetFile) {
+    QTextStream out(stdout);
+    out.setCodec(QTextCodec::codecForName("UTF-8"));
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out << "cannot create a temporary directory\n";
+        return 2;
+    }
+    const QString base = dir.path() + '/';
+    QString source = recipeFile;
+    if (source.isEmpty()) {
+        source = base + "sample.rcp";
+        if (!sampleRecipe().write(source)) {
+            out << "cannot write " << source << '\n';
+            return 2;
+        }
+    }
+
+    // Each step runs with the events it posts, so deferred relayouts and
+    // repaints are charged to the operation that caused them.
+    QList<QPair<QString, std::function<bool()>>> script;
+    script << qMakePair(QString("open recipe"), std::function<bool()>([=]() {
+        bool opened = false;
+        QEventLoop loop;
+        window->openRecipe(source, [&](bool ok) {
+            opened = ok;
+            loop.quit();
+        });
+        loop.exec();
+        return opened;
+    }));
+    script << qMakePair(QString("add ingredient"), std::function<bool()>([=]() {
+        window->stackedWidget->setCurrentWidget(window->editor);
+        window->editor->addNew(Ingredient("Αλάτι", 0));
+        return true;
+    }));
+    script << qMakePair(QString("move up"), std::function<bool()>([=]() {
+        auto widgets = window->editor->widgets();
+        if (widgets.count() < 2)
+            return false;
+        widgets.last()->setSelected(true);
+        window->editor->moveUp();
+        return true;
+    }));
+    script << qMakePair(QString("type a mass"), std::function<bool()>([=]() {
+        window->stackedWidget->setCurrentWidget(window->calculator);
+        if (window->calculator->lineEdits.isEmpty())
+            return false;
+        MassLineEdit *line = window->calculator->lineEdits.last();
+        line->clear();
+        typeText(line, "125");
+        return line->grams() == 125;
+    }));
+    script << qMakePair(QString("save"), std::function<bool()>([=]() {
+        window->currentFile = base + "saved.rcp";
+        bool queued = window->on_actionSaveRecipe_triggered();
+        IoExecutor::instance().waitForDone();
+        return queued && QFile::exists(base + "saved.rcp");
+    }));
+    script << qMakePair(QString("export pdf"), std::function<bool()>([=]() {
+        window->exportPdf(base + "saved.pdf");
+        return QFile::exists(base + "saved.pdf");
+    }));
+
+    // opening and saving parse and serialize on the I/O thread, so its
+    // allocations count towards the steps as well
+    AllocTrack::share();
+    IoExecutor::instance().run<bool>("alloc track", [](IoExecutor::Job &) {
+        AllocTrack::share();
+        return true;
+    });
+    IoExecutor::instance().waitForDone();
+
+    QMap<QString, Budget> budgets = readBudgets(budgetFile);
+    QApplication::processEvents();
+    out << QString("%1 %2 %3  %4\n").arg("operation", -16).arg("allocations", 12).arg("bytes", 12).arg("budget");
+    int failures {0};
+    for (auto &&step : script) {
+        AllocTrack::Counts before = AllocTrack::shared();
+        bool ok = step.second();
+        QApplication::processEvents();
+        IoExecutor::instance().waitForDone();
+        AllocTrack::Counts after = AllocTrack::shared();
+        quint64 allocations = after.allocations - before.allocations;
+        quint64 bytes = after.bytes - before.bytes;
+
+        QString verdict = "-";
+        if (!ok) {
+            verdict = "FAILED";
+            failures++;
+        } else if (budgets.contains(step.first)) {
+            const Budget &budget = budgets.value(step.first);
+            bool over = (budget.allocations && allocations > budget.allocations) ||
+                        (budget.bytes && bytes > budget.bytes);
+            verdict = QString("%1 / %2 %3").arg(budget.allocations).arg(budget.bytes)
+                                           .arg(over ? "OVER" : "ok");
+            if (over)
+                failures++;
+        }
+        out << QString("%1 %2 %3  %4\n").arg(step.first, -16).arg(allocations, 12).arg(bytes, 12).arg(verdict);
+    }
+    out.flush();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#ifndef ALLOCREPORT_H
+#define ALLOCREPORT_H
+
+#include <QString>
+
+class MainWindow;
+
+// Drives a main window through a fixed script of user operations and
+// prints the heap allocations each one caused (see AllocTrack). Budgets
+// are read from a file of "operation = allocations, bytes" lines; a zero
+// or missing limit is not checked.
+class AllocReport {
+public:
+    static int run(MainWindow *window, const QString &recipeFile, const QString &budgetFile);
+};
+
+#endif // ALLOCREPORT_H
@@ -0,0 +1,115 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "alloctrack.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local quint64 allocations {0};
+    thread_local quint64 bytes {0};
+    thread_local bool sharing {false};
+    std::atomic<quint64> sharedAllocations {0};
+    std::atomic<quint64> sharedBytes {0};
+
+    inline void count(std::size_t size) {
+        allocations++;
+        bytes += size;
+        if (sharing) {
+            sharedAllocations.fetch_add(1, std::memory_order_relaxed);
+            sharedBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+}
+
+namespace AllocTrack {
+    Counts current() {
+        Counts counts;
+        counts.allocations = allocations;
+        counts.bytes = bytes;
+        return counts;
+    }
+
+    void share() {
+        sharing = true;
+    }
+
+    Counts shared() {
+        Counts counts;
+        counts.allocations = sharedAllocations.load();
+        counts.bytes = sharedBytes.load();
+        return counts;
+    }
+}
+
+#ifdef __GLIBC__
+
+// Qt's containers and strings allocate with malloc rather than operator
+// new, so on glibc the malloc family itself is interposed; operator new
+// ends up here as well.
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+
+    void *malloc(size_t size) {
+        count(size);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t n, size_t size) {
+        count(n * size);
+        return __libc_calloc(n, size);
+    }
+
+    void *realloc(void *pointer, size_t size) {
+        count(size);
+        return __libc_realloc(pointer, size);
+    }
+}
+
+#else
+
+// Elsewhere only operator new is seen, which misses the allocations of
+// Qt's own containers.
+void *operator new(std::size_t size) {
+    count(size);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    count(size);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <QtGlobal>
+
+// Heap counters for builds configured with CONFIG += alloctrack. Counts are
+// kept per thread, so pool threads writing snapshots or scanning the
+// library do not leak into the numbers of the GUI thread. Threads that
+// called share() also add to one set of counters across them, which is
+// how work handed to the I/O thread is charged to the operation.
+namespace AllocTrack {
+    struct Counts {
+        quint64 allocations;
+        quint64 bytes;
+    };
+
+    Counts current();
+    void share();
+    Counts shared();
+}
+
+#endif // ALLOCTRACK_H
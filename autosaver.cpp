@@ -0,0 +1,157 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "autosaver.h"
+#include "diagnostics.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+static void writeSnapshot(const QString &dirPath, int counter, const Recipe &recipe,
+                          const QHash<int, QString> &names, const QString &origin) {
+    Diagnostics::ScopedTimer timer("autosave write");
+    QDir dir(dirPath);
+    QString name = QString("snapshot-%1.rcp").arg(counter, 6, 10, QChar('0'));
+    if (!recipe.write(dir.filePath(name), names))
+        return;
+    QSaveFile originFile(dir.filePath("origin"));
+    if (originFile.open(QIODevice::WriteOnly)) {
+        originFile.write(origin.toUtf8());
+        originFile.commit();
+    }
+    QStringList snapshots = dir.entryList(QStringList("snapshot-*.rcp"), QDir::Files, QDir::Name);
+    while (snapshots.count() > Autosaver::keptVersions)
+        dir.remove(snapshots.takeFirst());
+}
+
+Autosaver::Autosaver(QObject *parent) : QObject(parent) {
+    connect(&watcher, &QFutureWatcher<void>::finished, this, &Autosaver::writeFinished);
+}
+
+Autosaver::~Autosaver() {
+    watcher.waitForFinished();
+    delete lock;
+}
+
+QString Autosaver::recoveryPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/recovery";
+}
+
+// Only called from the GUI thread; the recipe is copied here and written
+// by a pool thread. While a write is running, newer snapshots replace each
+// other so that at most one write is ever queued behind it. names are
+// the ones still being typed, see Recipe::toText().
+void Autosaver::snapshot(const Recipe &recipe, const QString &origin, const QHash<int, QString> &names) {
+    if (recipe == lastRecipe && names == lastNames)
+        return;
+    lastRecipe = recipe;
+    lastNames = names;
+    if (watcher.isRunning()) {
+        pendingRecipe = recipe;
+        pendingNames = names;
+        pendingOrigin = origin;
+        hasPending = true;
+        return;
+    }
+    startWrite(recipe, names, origin);
+}
+
+void Autosaver::startWrite(const Recipe &recipe, const QHash<int, QString> &names, const QString &origin) {
+    if (session.isEmpty()) {
+        QDir root(recoveryPath());
+        if (!root.exists())
+            root.mkpath(".");
+        QString name = QString("%1-%2").arg(QCoreApplication::applicationPid())
+                                        .arg(QDateTime::currentMSecsSinceEpoch());
+        lock = new QLockFile(root.filePath(name + ".lock"));
+        lock->setStaleLockTime(0);  // never stale while this process runs
+        if (!lock->tryLock(0) || !root.mkdir(name)) {
+            qWarning() << tr("error creating recovery directory %1").arg(root.filePath(name));
+            delete lock;
+            lock = nullptr;
+            return;
+        }
+        session = name;
+    }
+    Diagnostics::ioStarted();
+    watcher.setFuture(QtConcurrent::run(writeSnapshot, recoveryPath() + '/' + session, ++counter, recipe, names, origin));
+}
+
+void Autosaver::writeFinished() {
+    Diagnostics::ioFinished();
+    if (!hasPending)
+        return;
+    hasPending = false;
+    startWrite(pendingRecipe, pendingNames, pendingOrigin);
+    pendingRecipe = Recipe();
+    pendingNames.clear();
+}
+
+// Called on a clean exit: the snapshots of this session are no longer needed.
+void Autosaver::discard() {
+    hasPending = false;
+    watcher.waitForFinished();
+    if (session.isEmpty())
+        return;
+    delete lock;
+    lock = nullptr;
+    removeSession(session);
+    session.clear();
+}
+
+// A session whose lock can be taken belongs to a process that is no longer
+// running, i.e. one that did not reach discard(). Without a stale time
+// only a dead owner counts, however old the lock; a lock from another
+// host is never taken.
+QStringList Autosaver::crashedSessions() {
+    QStringList sessions;
+    QDir root(recoveryPath());
+    for (auto &&name : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Time)) {
+        QLockFile sessionLock(root.filePath(name + ".lock"));
+        sessionLock.setStaleLockTime(0);
+        if (sessionLock.tryLock(0)) {
+            sessionLock.unlock();
+            sessions.append(name);
+        }
+    }
+    return sessions;
+}
+
+QString Autosaver::latestSnapshot(const QString &session, QString *origin) {
+    QDir dir(recoveryPath() + '/' + session);
+    QStringList snapshots = dir.entryList(QStringList("snapshot-*.rcp"), QDir::Files, QDir::Name);
+    if (snapshots.isEmpty())
+        return QString();
+    if (origin) {
+        QFile originFile(dir.filePath("origin"));
+        if (originFile.open(QIODevice::ReadOnly))
+            *origin = QString::fromUtf8(originFile.readAll());
+    }
+    return dir.filePath(snapshots.last());
+}
+
+void Autosaver::removeSession(const QString &session) {
+    QDir root(recoveryPath());
+    QDir(root.filePath(session)).removeRecursively();
+    QFile::remove(root.filePath(session + ".lock"));
+}
@@ -0,0 +1,44 @@
+#ifndef AUTOSAVER_H
+#define AUTOSAVER_H
+
+#include "recipe.h"
+#include <QFutureWatcher>
+#include <QObject>
+
+class QLockFile;
+
+class Autosaver : public QObject {
+    Q_OBJECT
+
+public:
+    explicit Autosaver(QObject *parent = nullptr);
+    ~Autosaver();
+    void snapshot(const Recipe &recipe, const QString &origin,
+                  const QHash<int, QString> &names = QHash<int, QString>());
+    void discard();
+
+    static QStringList crashedSessions();
+    static QString latestSnapshot(const QString &session, QString *origin = nullptr);
+    static void removeSession(const QString &session);
+
+    static const int keptVersions {5};
+
+private slots:
+    void writeFinished();
+
+private:
+    void startWrite(const Recipe &recipe, const QHash<int, QString> &names, const QString &origin);
+    static QString recoveryPath();
+    QFutureWatcher<void> watcher;
+    QLockFile *lock { nullptr };
+    QString session;
+    Recipe lastRecipe;
+    QHash<int, QString> lastNames;
+    Recipe pendingRecipe;
+    QHash<int, QString> pendingNames;
+    QString pendingOrigin;
+    bool hasPending { false };
+    int counter { 0 };
+};
+
+#endif // AUTOSAVER_H
@@ -0,0 +1,448 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "calcserver.h"
+#include "catalog.h"
+#include "ingredient.h"
+#include "units.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+
+namespace {
+    const int MaxHeaderSize = 16 * 1024;
+    const int MaxBodySize = 1024 * 1024;
+    const int MaxConnectionsPerWorker = 256;
+    const int MaxPipelined = 32;   // requests answered per read before yielding
+    const int IdleTimeout = 15000;  // ms
+    const int DefaultSearchLimit = 20;
+    const int MaxSearchLimit = 200;
+
+    struct Request {
+        QByteArray method;
+        QByteArray path;
+        QUrlQuery query;
+        QByteArray body;
+        bool keepAlive;
+    };
+
+    struct Response {
+        int status;
+        QJsonObject body;
+    };
+
+    struct CatalogEntry {
+        QString name;
+        QString folded;
+        int calories;
+        QString category;
+    };
+
+    // Read-only copy of the whole catalog, taken before the workers start so
+    // lookups need no locking.
+    struct CatalogSnapshot {
+        QVector<CatalogEntry> entries;
+        QHash<QString, int> byFolded;
+    };
+
+    QSharedPointer<const CatalogSnapshot> snapshot;
+
+    QSharedPointer<const CatalogSnapshot> takeSnapshot() {
+        QSharedPointer<CatalogSnapshot> catalog(new CatalogSnapshot);
+        for (auto &&shard : Catalog::shards()) {
+            Ingredient ingredient;
+            for (auto &&line : Catalog::shardLines(shard.id)) {
+                if (!Catalog::parseLine(line, &ingredient))
+                    continue;
+                QString folded = Catalog::fold(ingredient.name());
+                if (catalog->byFolded.contains(folded))
+                    continue;
+                catalog->byFolded.insert(folded, catalog->entries.size());
+                catalog->entries.append(CatalogEntry{ingredient.name(), folded, ingredient.calories(), shard.title});
+            }
+        }
+        return catalog;
+    }
+
+    const char *reason(int status) {
+        switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 422: return "Unprocessable Entity";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+        }
+    }
+
+    QByteArray serialize(const Response &response, bool keepAlive) {
+        QByteArray body = QJsonDocument(response.body).toJson(QJsonDocument::Compact);
+        QByteArray head = "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reason(response.status) + "\r\n"
+                          "Content-Type: application/json; charset=utf-8\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: " + (keepAlive ? "keep-alive" : "close") + "\r\n\r\n";
+        return head + body;
+    }
+
+    Response error(int status, const QString &message) {
+        QJsonObject body;
+        body["error"] = message;
+        return Response{status, body};
+    }
+
+    QJsonObject entryObject(const CatalogEntry &entry) {
+        QJsonObject object;
+        object["name"] = entry.name;
+        object["kcal"] = entry.calories;
+        object["category"] = entry.category;
+        return object;
+    }
+
+    // An ingredient of a posted recipe. Names stay plain strings: interning
+    // them would let every request grow the process-wide name pool, which
+    // never shrinks.
+    struct PostedItem {
+        QString name;
+        int calories;
+        QString mass;
+    };
+
+    // .rcp text (as Recipe::fromText() reads it) or the JSON form; unknown
+    // calories are taken from the catalog
+    bool parseRecipe(const Request &request, QVector<PostedItem> *items, QString *problem) {
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(request.body, &parseError);
+        if (parseError.error != QJsonParseError::NoError) {
+            for (auto &&line : QString::fromUtf8(request.body).split('\n')) {
+                if (line.startsWith('#'))
+                    break;
+                QStringList fields = line.split(" > ");
+                if (fields.count() >= 3)
+                    items->append(PostedItem {fields.at(0), fields.at(1).toInt(), fields.at(2)});
+            }
+            if (items->isEmpty()) {
+                *problem = "body is neither a recipe in JSON nor in .rcp form";
+                return false;
+            }
+            return true;
+        }
+        QJsonObject object = document.object();
+        for (auto &&value : object.value("ingredients").toArray()) {
+            QJsonObject ingredient = value.toObject();
+            QString name = ingredient.value("name").toString();
+            if (name.isEmpty()) {
+                *problem = "ingredient without a name";
+                return false;
+            }
+            int calories;
+            if (ingredient.contains("kcal")) {
+                calories = ingredient.value("kcal").toInt();
+            } else {
+                int i = snapshot->byFolded.value(Catalog::fold(name), -1);
+                if (i < 0) {
+                    *problem = QString("unknown ingredient \"%1\"; give its kcal").arg(name);
+                    return false;
+                }
+                calories = snapshot->entries.at(i).calories;
+            }
+            QJsonValue mass = ingredient.value("mass");
+            items->append(PostedItem {name, calories, mass.isDouble() ? QString::number(mass.toDouble())
+                                                                      : mass.toString()});
+        }
+        return true;
+    }
+
+    // the same sums as Recipe::totalCalories() and totalMass()
+    QJsonObject totals(const QVector<PostedItem> &recipe) {
+        QJsonArray items;
+        double calories = 0;
+        int grams = 0;
+        for (auto &&item : recipe) {
+            int itemGrams = Units::grams(item.mass, Units::measure(item.name));
+            double itemCalories = item.calories * itemGrams / 100.0;
+            calories += itemCalories;
+            grams += itemGrams;
+            QJsonObject object;
+            object["name"] = item.name;
+            object["mass"] = item.mass;
+            object["grams"] = itemGrams;
+            object["kcal"] = qRound(itemCalories);
+            items.append(object);
+        }
+        QJsonObject object;
+        object["ingredients"] = items;
+        object["kcal"] = qRound(calories);
+        object["grams"] = grams;
+        object["kcalPer100g"] = grams ? qRound(calories * 100 / grams) : 0;
+        return object;
+    }
+
+    Response evaluate(const Request &request, double factor) {
+        QVector<PostedItem> items;
+        QString problem;
+        if (!parseRecipe(request, &items, &problem))
+            return error(422, problem);
+        if (factor != 1)
+            for (auto &&item : items)
+                item.mass = Units::scaled(item.mass, factor);
+        return Response{200, totals(items)};
+    }
+
+    Response lookup(const Request &request) {
+        QString name = request.query.queryItemValue("name", QUrl::FullyDecoded);
+        int i = snapshot->byFolded.value(Catalog::fold(name), -1);
+        if (i < 0)
+            return error(404, QString("no catalog entry named \"%1\"").arg(name));
+        return Response{200, entryObject(snapshot->entries.at(i))};
+    }
+
+    // entries starting with the query first, then those containing it
+    Response search(const Request &request) {
+        QString q = Catalog::fold(request.query.queryItemValue("q", QUrl::FullyDecoded));
+        int limit = request.query.queryItemValue("limit").toInt();
+        limit = limit > 0 ? qMin(limit, MaxSearchLimit) : DefaultSearchLimit;
+        QJsonArray prefix, inner;
+        for (auto &&entry : snapshot->entries) {
+            if (prefix.size() >= limit)
+                break;
+            int pos = entry.folded.indexOf(q);
+            if (pos == 0)
+                prefix.append(entryObject(entry));
+            else if (pos > 0 && prefix.size() + inner.size() < limit)
+                inner.append(entryObject(entry));
+        }
+        for (int i = 0; i < inner.size() && prefix.size() < limit; i++)
+            prefix.append(inner.at(i));
+        QJsonObject body;
+        body["results"] = prefix;
+        return Response{200, body};
+    }
+
+    Response route(const Request &request) {
+        bool post = request.method == "POST";
+        if (request.path == "/recipe/evaluate" || request.path == "/recipe/scale") {
+            if (!post)
+                return error(405, "use POST");
+            double factor = 1;
+            if (request.path == "/recipe/scale") {
+                bool ok;
+                factor = request.query.queryItemValue("factor").replace(',', '.').toDouble(&ok);
+                if (!ok || factor <= 0)
+                    return error(400, "factor must be a positive number");
+            }
+            return evaluate(request, factor);
+        }
+        if (request.path == "/catalog/lookup" || request.path == "/catalog/search") {
+            if (request.method != "GET")
+                return error(405, "use GET");
+            return request.path == "/catalog/lookup" ? lookup(request) : search(request);
+        }
+        return error(404, "no such endpoint");
+    }
+
+    enum ParseResult { Incomplete, Complete, Invalid };
+
+    // Takes one request off the front of buffer; status is set for Invalid.
+    ParseResult takeRequest(QByteArray *buffer, Request *request, int *status) {
+        int headerEnd = buffer->indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            *status = 431;
+            return buffer->size() > MaxHeaderSize ? Invalid : Incomplete;
+        }
+        QList<QByteArray> lines = buffer->left(headerEnd).split('\n');
+        QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        *status = 400;
+        if (requestLine.size() != 3 || !requestLine.at(2).startsWith("HTTP/1."))
+            return Invalid;
+        bool http10 = requestLine.at(2) == "HTTP/1.0";
+        qint64 length {0};
+        bool keepAlive = !http10;
+        for (int i = 1; i < lines.size(); i++) {
+            const QByteArray &line = lines.at(i);
+            int colon = line.indexOf(':');
+            if (colon < 0)
+                continue;
+            QByteArray name = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+            if (name == "content-length") {
+                bool ok;
+                length = value.toLongLong(&ok);
+                if (!ok || length < 0)
+                    return Invalid;
+            } else if (name == "transfer-encoding") {
+                *status = 411;
+                return Invalid;
+            } else if (name == "connection") {
+                value = value.toLower();
+                if (value == "close")
+                    keepAlive = false;
+                else if (value == "keep-alive")
+                    keepAlive = true;
+            }
+        }
+        if (length > MaxBodySize) {
+            *status = 413;
+            return Invalid;
+        }
+        int total = headerEnd + 4 + int(length);
+        if (buffer->size() < total)
+            return Incomplete;
+
+        QByteArray target = requestLine.at(1);
+        int question = target.indexOf('?');
+        request->method = requestLine.at(0);
+        request->path = question < 0 ? target : target.left(question);
+        request->query = QUrlQuery(question < 0 ? QString() : QString::fromUtf8(target.mid(question + 1)).replace('+', ' '));
+        request->body = buffer->mid(headerEnd + 4, int(length));
+        request->keepAlive = keepAlive;
+        buffer->remove(0, total);
+        return Complete;
+    }
+}
+
+CalcServer::CalcServer(QObject *parent) : QTcpServer(parent) {}
+
+CalcServer::~CalcServer() {
+    close();
+    for (auto &&thread : threads) {
+        thread->quit();
+        thread->wait();
+    }
+    qDeleteAll(threads);
+}
+
+bool CalcServer::start(const QHostAddress &address, quint16 port, int threadCount) {
+    snapshot = takeSnapshot();
+    if (threadCount <= 0)
+        threadCount = QThread::idealThreadCount();
+    for (int i = 0; i < threadCount; i++) {
+        auto thread = new QThread;
+        auto worker = new CalcWorker;
+        worker->moveToThread(thread);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread->start();
+        threads.append(thread);
+        workers.append(worker);
+    }
+    return listen(address, port);
+}
+
+// Called on the listening thread; the socket itself is created by the
+// worker so that all of its I/O happens there.
+void CalcServer::incomingConnection(qintptr socketDescriptor) {
+    CalcWorker *worker = workers.at(nextWorker);
+    nextWorker = (nextWorker + 1) % workers.size();
+    QMetaObject::invokeMethod(worker, [worker, socketDescriptor]() { worker->accept(socketDescriptor); },
+                              Qt::QueuedConnection);
+}
+
+CalcWorker::CalcWorker(QObject *parent) : QObject(parent) {}
+
+void CalcWorker::accept(qintptr socketDescriptor) {
+    auto socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+    if (connections.size() >= MaxConnectionsPerWorker) {
+        socket->write(serialize(error(503, "too many connections"), false));
+        socket->disconnectFromHost();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        return;
+    }
+    if (!idleTimer) {
+        idleTimer = new QTimer(this);
+        connect(idleTimer, &QTimer::timeout, this, &CalcWorker::closeIdle);
+        idleTimer->start(IdleTimeout / 3);
+    }
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connections.insert(socket, Connection{QByteArray(), QDateTime::currentMSecsSinceEpoch()});
+    connect(socket, &QTcpSocket::readyRead, this, &CalcWorker::readRequests);
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+        connections.remove(socket);
+        socket->deleteLater();
+    });
+}
+
+void CalcWorker::readRequests() {
+    auto socket = qobject_cast<QTcpSocket *>(sender());
+    auto it = connections.find(socket);
+    if (it == connections.end())
+        return;
+    QByteArray received = socket->readAll();
+    if (!received.isEmpty()) {
+        it->buffer += received;
+        it->lastActive = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    QByteArray out;
+    bool keepAlive = true;
+    bool yielded = false;
+    for (int answered = 0; keepAlive; answered++) {
+        if (answered == MaxPipelined) {
+            yielded = true;
+            break;
+        }
+        Request request;
+        int status;
+        ParseResult result = takeRequest(&it->buffer, &request, &status);
+        if (result == Incomplete)
+            break;
+        if (result == Invalid) {
+            out += serialize(error(status, reason(status)), false);
+            keepAlive = false;
+            break;
+        }
+        keepAlive = request.keepAlive;
+        out += serialize(route(request), keepAlive);
+    }
+    if (!out.isEmpty())
+        socket->write(out);
+    if (!keepAlive) {
+        connections.remove(socket);
+        socket->disconnectFromHost();
+    } else if (yielded && !it->buffer.isEmpty()) {
+        // more pipelined requests than one turn allows: continue after
+        // the other connections of this worker had theirs; a partial
+        // request waits for the socket's own readyRead
+        QMetaObject::invokeMethod(socket, "readyRead", Qt::QueuedConnection);
+    }
+}
+
+void CalcWorker::closeIdle() {
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<QTcpSocket *> idle;
+    for (auto it = connections.constBegin(); it != connections.constEnd(); ++it)
+        if (now - it->lastActive > IdleTimeout)
+            idle.append(it.key());
+    for (auto &&socket : idle) {
+        connections.remove(socket);
+        socket->disconnectFromHost();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef CALCSERVER_H
+#define CALCSERVER_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QVector>
+
+class CalcWorker;
+class QThread;
+class QTcpSocket;
+class QTimer;
+
+/* Small HTTP/1.1 JSON service for the --serve mode:
+ *   POST /recipe/evaluate          totals of a recipe
+ *   POST /recipe/scale?factor=F    the same recipe with every mass scaled
+ *   GET  /catalog/lookup?name=N    one catalog entry, matched loosely
+ *   GET  /catalog/search?q=Q       catalog entries containing Q
+ * A recipe is posted either as .rcp text or as JSON:
+ *   {"ingredients": [{"name": "Αλεύρι λευκό", "mass": "1 φλ"}, ...]}
+ * where "kcal" may be given per ingredient and is otherwise looked up.
+ * Connections are spread over a fixed set of worker threads, each running
+ * its own event loop, and kept alive between requests. */
+class CalcServer : public QTcpServer {
+    Q_OBJECT
+
+public:
+    explicit CalcServer(QObject *parent = nullptr);
+    ~CalcServer() override;
+    bool start(const QHostAddress &address, quint16 port, int threadCount = 0);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    QVector<QThread *> threads {};
+    QVector<CalcWorker *> workers {};
+    int nextWorker { 0 };
+};
+
+// Owns the connections handed to one worker thread.
+class CalcWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CalcWorker(QObject *parent = nullptr);
+
+    void accept(qintptr socketDescriptor);
+
+private slots:
+    void readRequests();
+    void closeIdle();
+
+private:
+    struct Connection {
+        QByteArray buffer;
+        qint64 lastActive;
+    };
+    QHash<QTcpSocket *, Connection> connections {};
+    QTimer *idleTimer { nullptr };
+};
+
+#endif // CALCSERVER_H
@@ -0,0 +1,591 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catalog.h"
+#include "catalogsync.h"
+#include "ingredient.h"
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QCollator>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QLockFile>
+#include <QMutex>
+#include <QObject>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTextCodec>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+    const int ChunkBits = 12;
+    const int ChunkSize = 1 << ChunkBits;
+    const int MaxChunks = 4096;
+
+    struct Entry {
+        QString name;
+        quint32 key;
+        mutable QAtomicPointer<QCollatorSortKey> sortKey {};  // set on first use
+    };
+
+    // Entries live in fixed-size chunks that are never moved or freed, so a
+    // published id can be resolved without taking the lock.
+    struct Pool {
+        Pool() : collator(QLocale(QLocale::Greek, QLocale::Greece)) { store(QString(""), 0, true); }
+
+        quint32 store(const QString &name, quint32 key, bool self) {
+            quint32 id = quint32(count.loadAcquire());
+            int chunk = int(id >> ChunkBits);
+            if (chunk >= MaxChunks)
+                qFatal("Catalog: name pool exhausted");
+            Entry *entries = chunks[chunk].loadAcquire();
+            if (!entries) {
+                entries = new Entry[ChunkSize];
+                chunks[chunk].storeRelease(entries);
+            }
+            Entry &entry = entries[id & (ChunkSize - 1)];
+            entry.name = name;
+            entry.key = self ? id : key;
+            ids.insert(name, id);
+            count.storeRelease(int(id + 1));
+            return id;
+        }
+
+        const Entry *at(quint32 id) const {
+            if (id >= quint32(count.loadAcquire()))
+                return nullptr;
+            return &chunks[id >> ChunkBits].loadAcquire()[id & (ChunkSize - 1)];
+        }
+
+        QAtomicPointer<Entry> chunks[MaxChunks];
+        QAtomicInt count {0};
+        QMutex mutex;
+        QHash<QString, quint32> ids {};
+        QCollator collator;  // used with mutex held
+    };
+
+    Pool &pool() {
+        static Pool p;
+        return p;
+    }
+
+    // "name = calories"; comments and malformed lines give false
+    bool splitLine(const QString &line, QString *name, int *calories) {
+        if (line.startsWith('#'))
+            return false;
+        int separator = line.lastIndexOf('=');
+        if (separator < 0)
+            return false;
+        *name = line.left(separator).trimmed();
+        bool ok;
+        *calories = line.mid(separator + 1).trimmed().toInt(&ok);
+        return ok && !name->isEmpty();
+    }
+
+    QStringList readLines(const QString &fileName) {
+        QStringList lines;
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return lines;
+        QTextStream in(&file);
+        in.setCodec(QTextCodec::codecForName("UTF-8"));
+        while (!in.atEnd()) {
+            QString line = in.readLine();
+            if (!line.trimmed().isEmpty())
+                lines.append(line);
+        }
+        return lines;
+    }
+
+    /* Lines in catalog order: by the collation key of their name, then by
+     * the line itself. names holds the name id of each line, so that a
+     * comparison is one compare of keys already kept in the pool. Lines
+     * that are not entries (comments, malformed lines) have id 0 and are
+     * not interned: they go last, in plain locale order. */
+    struct SortedLines {
+        QStringList lines {};
+        QVector<quint32> names {};
+    };
+
+    int compareLines(const SortedLines &a, int i, const SortedLines &b, int j) {
+        quint32 first = a.names.at(i), second = b.names.at(j);
+        if (!first || !second)
+            return first ? -1 : second ? 1 : QString::localeAwareCompare(a.lines.at(i), b.lines.at(j));
+        int order = Catalog::compareNames(first, second);
+        return order ? order : a.lines.at(i).compare(b.lines.at(j));
+    }
+
+    SortedLines sortLines(const QStringList &lines) {
+        QVector<quint32> names;
+        names.reserve(lines.size());
+        Ingredient ingredient;
+        for (auto &&line : lines)
+            names.append(Catalog::parseLine(line, &ingredient) ? ingredient.nameId() : 0);
+        SortedLines unsorted {lines, names};
+        QVector<int> order(lines.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&unsorted](int a, int b) {
+            return compareLines(unsorted, a, unsorted, b) < 0;
+        });
+        SortedLines sorted;
+        sorted.lines.reserve(lines.size());
+        sorted.names.reserve(lines.size());
+        for (int i : order) {
+            sorted.lines.append(lines.at(i));
+            sorted.names.append(names.at(i));
+        }
+        return sorted;
+    }
+
+    // Merges two sorted lists, dropping lines that appear in both.
+    SortedLines mergeLines(const SortedLines &a, const SortedLines &b) {
+        SortedLines merged;
+        merged.lines.reserve(a.lines.size() + b.lines.size());
+        merged.names.reserve(a.lines.size() + b.lines.size());
+        int i = 0, j = 0;
+        while (i < a.lines.size() || j < b.lines.size()) {
+            bool first = j == b.lines.size() || (i < a.lines.size() && compareLines(a, i, b, j) <= 0);
+            const SortedLines &from = first ? a : b;
+            int &at = first ? i : j;
+            if (merged.lines.isEmpty() || merged.lines.last() != from.lines.at(at)) {
+                merged.lines.append(from.lines.at(at));
+                merged.names.append(from.names.at(at));
+            }
+            at++;
+        }
+        return merged;
+    }
+
+    // what ingredient equality compares: folded name and calories
+    quint64 entryKey(const Ingredient &ingredient) {
+        return quint64(Catalog::key(ingredient.nameId())) << 32 | quint32(ingredient.calories());
+    }
+
+    // the same, hashed from the text, for entries that are not interned
+    uint entryHash(const QString &name, int calories) {
+        return qHash(name.toCaseFolded(), uint(calories));
+    }
+
+    /* The built-in catalog is split by category into :/catalog/<id>.cal,
+     * listed with their titles in :/catalog/index.cal. Only that index is
+     * read up front; a shard is read the first time something asks for its
+     * lines and then kept. extended.cal is one more shard, re-read whenever
+     * it changes on disk. Every shard is kept sorted, and the whole catalog
+     * is the merge of the sorted shards. */
+    struct ShardStore {
+        QMutex mutex;
+        QList<Catalog::Shard> index {};
+        bool hasIndex { false };
+        QHash<QString, SortedLines> loaded {};
+        qint64 userStamp { -1 };
+        SortedLines builtin {};
+        bool hasBuiltin { false };
+        SortedLines all {};
+        qint64 allStamp { -2 };
+        QHash<QString, QSet<quint64>> keys {};
+        QMultiHash<uint, QString> hashes {};  // entryHash -> built-in shard
+        bool hasHashes { false };
+        QList<Ingredient> builtinEntries {};
+        bool hasBuiltinEntries { false };
+
+        const QList<Catalog::Shard> &indexed() {
+            if (!hasIndex) {
+                for (auto &&line : readLines(":/catalog/index.cal")) {
+                    int separator = line.indexOf('=');
+                    if (line.startsWith('#') || separator < 0)
+                        continue;
+                    index.append(Catalog::Shard{line.left(separator).trimmed(), line.mid(separator + 1).trimmed()});
+                }
+                index.append(Catalog::Shard{QString(Catalog::UserShard), QObject::tr("Προσθήκες χρήστη")});
+                hasIndex = true;
+            }
+            return index;
+        }
+
+        SortedLines lines(const QString &id) {
+            if (id == Catalog::UserShard) {
+                QFileInfo ext(Catalog::extendedFileName());
+                qint64 stamp = ext.exists() ? ext.lastModified().toMSecsSinceEpoch() * 1000003 + ext.size() : 0;
+                if (stamp != userStamp) {
+                    loaded.insert(id, sortLines(readLines(ext.filePath())));
+                    userStamp = stamp;
+                }
+                return loaded.value(id);
+            }
+            auto it = loaded.constFind(id);
+            if (it != loaded.constEnd())
+                return it.value();
+            return loaded.insert(id, sortLines(readLines(":/catalog/" + id + ".cal"))).value();
+        }
+
+        // entry keys of a built-in shard, built the first time it is asked
+        const QSet<quint64> &entryKeys(const QString &id) {
+            auto it = keys.constFind(id);
+            if (it != keys.constEnd())
+                return it.value();
+            QSet<quint64> shardKeys;
+            Ingredient ingredient;
+            for (auto &&line : lines(id).lines)
+                if (Catalog::parseLine(line, &ingredient))
+                    shardKeys.insert(entryKey(ingredient));
+            return keys.insert(id, shardKeys).value();
+        }
+
+        // The entry hash of every built-in entry, with its shard. The
+        // shards are streamed through once for it, neither kept nor
+        // interned, so only a hit loads the one shard that can hold it.
+        const QMultiHash<uint, QString> &builtinHashes() {
+            if (!hasHashes) {
+                QString name;
+                int calories;
+                for (auto &&shard : indexed())
+                    if (shard.id != Catalog::UserShard)
+                        for (auto &&line : readLines(":/catalog/" + shard.id + ".cal"))
+                            if (splitLine(line, &name, &calories))
+                                hashes.insert(entryHash(name, calories), shard.id);
+                hasHashes = true;
+            }
+            return hashes;
+        }
+    };
+
+    ShardStore &shardStore() {
+        static ShardStore store;
+        return store;
+    }
+}
+
+namespace Catalog {
+    // Each spelling also points at the id of its case-folded form, which is
+    // what ingredient equality compares.
+    quint32 intern(const QString &name) {
+        if (name.isEmpty())
+            return 0;
+        Pool &p = pool();
+        QMutexLocker locker(&p.mutex);
+        auto it = p.ids.constFind(name);
+        if (it != p.ids.constEnd())
+            return it.value();
+
+        QString folded = name.toCaseFolded();
+        if (folded == name)
+            return p.store(name, 0, true);
+        auto k = p.ids.constFind(folded);
+        quint32 key = k != p.ids.constEnd() ? k.value() : p.store(folded, 0, true);
+        return p.store(name, key, false);
+    }
+
+    QString name(quint32 id) {
+        const Entry *entry = pool().at(id);
+        return entry ? entry->name : QString();
+    }
+
+    quint32 key(quint32 id) {
+        const Entry *entry = pool().at(id);
+        return entry ? entry->key : id;
+    }
+
+    int size() {
+        return pool().count.loadAcquire();
+    }
+
+    // The key id of name when it or its case-folded form is in the pool, 0
+    // otherwise. Unlike intern() it never grows the pool, so it is the one
+    // to use for text coming from outside, e.g. the --serve requests.
+    quint32 lookup(const QString &name) {
+        if (name.isEmpty())
+            return 0;
+        Pool &p = pool();
+        QMutexLocker locker(&p.mutex);
+        auto it = p.ids.constFind(name);
+        if (it == p.ids.constEnd())
+            it = p.ids.constFind(name.toCaseFolded());
+        if (it == p.ids.constEnd())
+            return 0;
+        const Entry *entry = p.at(it.value());
+        return entry ? entry->key : 0;
+    }
+
+    // Greek collation order of two names, 0 only for the same spelling. The
+    // sort key of a name is made the first time it is compared and kept
+    // with it, so sorting and merging compare keys rather than collating
+    // the strings again.
+    int compareNames(quint32 a, quint32 b) {
+        if (a == b)
+            return 0;
+        Pool &p = pool();
+        const Entry *first = p.at(a);
+        const Entry *second = p.at(b);
+        if (!first || !second)
+            return first ? 1 : second ? -1 : int(a) - int(b);
+        const QCollatorSortKey *keys[2] = {first->sortKey.loadAcquire(), second->sortKey.loadAcquire()};
+        if (!keys[0] || !keys[1]) {
+            QMutexLocker locker(&p.mutex);
+            const Entry *entries[2] = {first, second};
+            for (int i = 0; i < 2; i++) {
+                keys[i] = entries[i]->sortKey.loadAcquire();
+                if (!keys[i]) {
+                    auto key = new QCollatorSortKey(p.collator.sortKey(entries[i]->name));
+                    entries[i]->sortKey.storeRelease(key);
+                    keys[i] = key;
+                }
+            }
+        }
+        int order = keys[0]->compare(*keys[1]);
+        return order ? order : first->name.compare(second->name);
+    }
+
+    // Loose comparison form of a name: accents dropped, case folded, final
+    // sigma treated as a plain one and runs of whitespace collapsed.
+    QString fold(const QString &text) {
+        QString decomposed = text.normalized(QString::NormalizationForm_D);
+        QString folded;
+        folded.reserve(decomposed.size());
+        for (auto &&ch : decomposed)
+            if (ch.category() != QChar::Mark_NonSpacing)
+                folded.append(ch);
+        return folded.toCaseFolded().replace(QChar(0x03C2), QChar(0x03C3)).simplified();
+    }
+
+    // "name = calories"; comments and malformed lines are rejected
+    bool parseLine(const QString &line, Ingredient *ingredient) {
+        QString name;
+        int calories;
+        if (!splitLine(line, &name, &calories))
+            return false;
+        *ingredient = Ingredient(name, calories);
+        return true;
+    }
+
+    QList<Ingredient> readFile(const QString &fileName) {
+        QList<Ingredient> entries;
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return entries;
+        QTextStream in(&file);
+        in.setCodec(QTextCodec::codecForName("UTF-8"));
+        Ingredient ingredient;
+        while (!in.atEnd())
+            if (parseLine(in.readLine(), &ingredient))
+                entries.append(ingredient);
+        return entries;
+    }
+
+    QString extendedFileName() {
+        QDir dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        return dataDir.path() + "/extended.cal";
+    }
+
+    /* extended.cal may be shared by several instances, on one machine or on
+     * terminals sharing a profile. Every writer takes <file>.lock, re-reads
+     * the file, applies its change to what is there now and replaces the
+     * file atomically, so changes made by others meanwhile are merged
+     * rather than overwritten. The lock is held for one read and one write
+     * only; a lock left behind by a crashed instance counts as stale after
+     * StaleLockTime and is taken over. These calls touch the disk and
+     * belong on the I/O thread. */
+    const int LockTimeout = 5000;     // ms to wait for another writer
+    const int StaleLockTime = 15000;  // ms
+
+    // The resulting value of every name in touched goes to the sync log
+    // while the lock is still held, so the log follows the file's order of
+    // changes; CatalogSync passes none for the changes it replays.
+    bool editExtended(const std::function<bool(QStringList *lines)> &edit, const QStringList &touched) {
+        QString fileName = extendedFileName();
+        QDir().mkpath(QFileInfo(fileName).path());
+        QLockFile lock(fileName + ".lock");
+        lock.setStaleLockTime(StaleLockTime);
+        if (!lock.tryLock(LockTimeout)) {
+            qWarning() << "Catalog: cannot lock" << fileName << "error" << lock.error();
+            return false;
+        }
+        QStringList lines;
+        QFile in(fileName);
+        if (in.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QTextStream data(&in);
+            data.setCodec(QTextCodec::codecForName("UTF-8"));
+            while (!data.atEnd())
+                lines.append(data.readLine());
+            in.close();
+        }
+        if (!edit(&lines))
+            return true;  // nothing to change
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            return false;
+        QTextStream out(&file);
+        out.setCodec(QTextCodec::codecForName("UTF-8"));
+        for (auto &&line : lines)
+            out << line << '\n';
+        out.flush();
+        if (out.status() != QTextStream::Ok || !file.commit())
+            return false;
+        if (!touched.isEmpty())
+            CatalogSync::record(CatalogSync::changes(lines, touched));
+        return true;
+    }
+
+    // Appends the entries that neither the built-in catalog nor extended.cal
+    // has yet.
+    bool addEntries(const QList<Ingredient> &entries) {
+        QList<Ingredient> added;
+        for (auto &&entry : entries)
+            if (!isBuiltin(entry))
+                added.append(entry);
+        if (added.isEmpty())
+            return true;
+        QStringList names;
+        for (auto &&entry : added)
+            names.append(entry.name());
+        return editExtended([&added](QStringList *lines) {
+            QList<Ingredient> known;
+            Ingredient ingredient;
+            for (auto &&line : *lines)
+                if (parseLine(line, &ingredient))
+                    known.append(ingredient);
+            bool changed = false;
+            for (auto &&entry : added)
+                if (!known.contains(entry)) {
+                    lines->append(entry.name() + " = " + QString::number(entry.calories()));
+                    known.append(entry);
+                    changed = true;
+                }
+            return changed;
+        }, names);
+    }
+
+    // Drops every line of extended.cal equal to line.
+    bool removeEntry(const QString &line) {
+        Ingredient ingredient;
+        QStringList names;
+        if (parseLine(line, &ingredient))
+            names.append(ingredient.name());
+        return editExtended([&line](QStringList *lines) {
+            return lines->removeAll(line) > 0;
+        }, names);
+    }
+
+    // Drops one line equal to each of the given ones, so that of several
+    // identical lines the ones not listed stay.
+    bool removeLines(const QStringList &dropped) {
+        Ingredient ingredient;
+        QStringList names;
+        for (auto &&line : dropped)
+            if (parseLine(line, &ingredient))
+                names.append(ingredient.name());
+        return editExtended([&dropped](QStringList *lines) {
+            bool changed = false;
+            for (auto &&line : dropped)
+                changed |= lines->removeOne(line);
+            return changed;
+        }, names);
+    }
+
+    // Records the new value of an ingredient in extended.cal: earlier lines
+    // with the same folded name are dropped, everything else keeps its place.
+    bool setCalories(const QString &name, int calories) {
+        QString folded = fold(name);
+        return editExtended([&](QStringList *lines) {
+            Ingredient ingredient;
+            for (int i = lines->size() - 1; i >= 0; i--)
+                if (parseLine(lines->at(i), &ingredient) && fold(ingredient.name()) == folded)
+                    lines->removeAt(i);
+            lines->append(name + " = " + QString::number(calories));
+            return true;
+        }, QStringList(name));
+    }
+
+    QList<Shard> shards() {
+        ShardStore &store = shardStore();
+        QMutexLocker locker(&store.mutex);
+        return store.indexed();
+    }
+
+    QStringList shardLines(const QString &id, qint64 *stamp) {
+        ShardStore &store = shardStore();
+        QMutexLocker locker(&store.mutex);
+        QStringList lines = store.lines(id).lines;
+        if (stamp)
+            *stamp = store.userStamp;
+        return lines;
+    }
+
+    // Every distinct line of the built-in catalog and extended.cal, in
+    // catalog order, as the list dialogs show them. This is the one call
+    // that loads the whole catalog; the built-in shards are merged once and
+    // only extended.cal is merged in again when it changes, which also
+    // changes stamp.
+    QStringList entryLines(qint64 *stamp) {
+        ShardStore &store = shardStore();
+        QMutexLocker locker(&store.mutex);
+        SortedLines user = store.lines(UserShard);
+        if (store.allStamp != store.userStamp) {
+            if (!store.hasBuiltin) {
+                for (auto &&shard : store.indexed())
+                    if (shard.id != UserShard)
+                        store.builtin = mergeLines(store.builtin, store.lines(shard.id));
+                store.hasBuiltin = true;
+            }
+            store.all = mergeLines(store.builtin, user);
+            store.allStamp = store.userStamp;
+        }
+        if (stamp)
+            *stamp = store.allStamp;
+        return store.all.lines;
+    }
+
+    // one shard, or the whole catalog for an empty id
+    QStringList lines(const QString &shard, qint64 *stamp) {
+        return shard.isEmpty() ? entryLines(stamp) : shardLines(shard, stamp);
+    }
+
+    // parsed once; the built-in shards never change
+    QList<Ingredient> builtinEntries() {
+        ShardStore &store = shardStore();
+        QMutexLocker locker(&store.mutex);
+        if (!store.hasBuiltinEntries) {
+            Ingredient ingredient;
+            for (auto &&shard : store.indexed())
+                if (shard.id != UserShard)
+                    for (auto &&line : store.lines(shard.id).lines)
+                        if (parseLine(line, &ingredient))
+                            store.builtinEntries.append(ingredient);
+            store.hasBuiltinEntries = true;
+        }
+        return store.builtinEntries;
+    }
+
+    // A miss, the usual answer for an entry the user adds, is decided by
+    // the hashes alone; a hit is confirmed against the shard it names.
+    bool isBuiltin(const Ingredient &ingredient) {
+        ShardStore &store = shardStore();
+        QMutexLocker locker(&store.mutex);
+        quint64 key = entryKey(ingredient);
+        auto candidates = store.builtinHashes().values(entryHash(ingredient.name(), ingredient.calories()));
+        for (auto &&shard : candidates)
+            if (store.entryKeys(shard).contains(key))
+                return true;
+        return false;
+    }
+}
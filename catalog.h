@@ -0,0 +1,50 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+class Ingredient;
+
+// Process-wide pool of ingredient names. Every distinct spelling is stored
+// once and handed out as a small integer id; ids stay valid for the lifetime
+// of the program and may be read from any thread. Id 0 is the empty name.
+namespace Catalog {
+    quint32 intern(const QString &name);
+    QString name(quint32 id);
+    quint32 key(quint32 id);
+    quint32 lookup(const QString &name);
+    int size();
+    int compareNames(quint32 a, quint32 b);
+
+    QString fold(const QString &text);
+
+    bool parseLine(const QString &line, Ingredient *ingredient);
+    QList<Ingredient> readFile(const QString &fileName);
+    QString extendedFileName();
+    // rewrites extended.cal under its cross-process lock; see catalog.cpp
+    bool editExtended(const std::function<bool(QStringList *lines)> &edit,
+                      const QStringList &touched = QStringList());
+    bool addEntries(const QList<Ingredient> &entries);
+    bool removeEntry(const QString &line);
+    bool removeLines(const QStringList &lines);
+    bool setCalories(const QString &name, int calories);
+
+    // categories of the built-in catalog, plus UserShard for extended.cal
+    struct Shard {
+        QString id;
+        QString title;
+    };
+    const char UserShard[] = "user";
+
+    QList<Shard> shards();
+    QStringList shardLines(const QString &id, qint64 *stamp = nullptr);
+    QStringList entryLines(qint64 *stamp = nullptr);
+    QStringList lines(const QString &shard, qint64 *stamp = nullptr);
+    QList<Ingredient> builtinEntries();
+    bool isBuiltin(const Ingredient &ingredient);
+}
+
+#endif // CATALOG_H
@@ -0,0 +1,432 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catalogsync.h"
+#include "catalog.h"
+#include "ingredient.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QLockFile>
+#include <QObject>
+#include <QSaveFile>
+#include <QSet>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QUuid>
+
+using CatalogSync::Operation;
+
+namespace {
+    const quint32 Magic {0x4E435359};  // "NCSY"
+    const quint32 Version {1};
+    const int LockTimeout = 5000;  // ms to wait for a sync of another instance
+
+    // offsets keys besides the replica ids
+    const char LocalKey[] = "local";        // bytes of the local log merged
+    const char ExportKey[] = "export";      // bytes of it in the shared folder
+    const char SnapshotKey[] = "snapshot";  // entries older than the log recorded
+
+    /* The offsets are small and rewritten on every sync. The winners are
+     * one per name in the catalog, so they are spread by name over
+     * WinnerBuckets append-only logs in winners/, in the oplog format. A
+     * sync reads only the buckets of the names its new operations touch,
+     * appends the winners it changed, and rewrites a bucket whole only once
+     * most of it is overridden; a later line of a name overrides earlier
+     * ones. */
+    const int WinnerBuckets = 256;
+
+    struct Bucket {
+        qint64 logged;  // bytes of complete lines in the file
+        int lines;
+        int names;
+    };
+
+    struct State {
+        QHash<QString, qint64> offsets;
+        QHash<QString, Operation> winners;  // folded name -> operation in force
+        QHash<int, Bucket> buckets;  // the ones loaded into winners
+    };
+
+    // stable across runs and Qt versions, unlike qHash()
+    int bucketOf(const QString &key) {
+        return quint8(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).at(0)) % WinnerBuckets;
+    }
+
+    QString bucketPath(int bucket) {
+        return dataPath("winners/" + QString::number(bucket, 16).rightJustified(2, '0') + ".log");
+    }
+
+    QString dataPath(const QString &name) {
+        return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + '/' + name;
+    }
+
+    bool newer(const Operation &a, const Operation &b) {
+        return a.clock != b.clock ? a.clock > b.clock : a.id > b.id;
+    }
+
+    // "clock<TAB>id<TAB>set|remove<TAB>name<TAB>calories", clock in hex
+    QByteArray format(const Operation &op) {
+        QString name = op.name;
+        name.replace('\t', ' ').replace('\n', ' ');
+        QString line = QString::number(op.clock, 16).rightJustified(16, '0') + '\t' + op.id + '\t' +
+                (op.remove ? "remove" : "set") + '\t' + name + '\t' + QString::number(op.calories) + '\n';
+        return line.toUtf8();
+    }
+
+    bool parse(QByteArray line, Operation *op) {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        QList<QByteArray> fields = line.split('\t');
+        if (fields.size() != 5 || (fields.at(2) != "set" && fields.at(2) != "remove"))
+            return false;
+        bool clockOk, caloriesOk;
+        op->clock = fields.at(0).toLongLong(&clockOk, 16);
+        op->id = QString::fromLatin1(fields.at(1));
+        op->remove = fields.at(2) == "remove";
+        op->name = QString::fromUtf8(fields.at(3));
+        op->calories = fields.at(4).toInt(&caloriesOk);
+        return clockOk && caloriesOk && !op->id.isEmpty() && !op->name.isEmpty();
+    }
+
+    // The operations on the complete lines past *offset, which moves past
+    // them; a line still being written is left for the next sync. A file
+    // shorter than the offset was replaced and is read again from the start.
+    QList<Operation> readTail(const QString &fileName, qint64 *offset) {
+        QList<Operation> ops;
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return ops;
+        if (file.size() < *offset)
+            *offset = 0;
+        if (!file.seek(*offset))
+            return ops;
+        QByteArray data = file.readAll();
+        data.truncate(data.lastIndexOf('\n') + 1);
+        *offset += data.size();
+        Operation op;
+        for (auto &&line : data.split('\n'))
+            if (parse(line, &op))
+                ops.append(op);
+        return ops;
+    }
+
+    qint64 readClock() {
+        QFile file(dataPath("catalog.clock"));
+        if (!file.open(QIODevice::ReadOnly))
+            return 0;
+        return file.readAll().trimmed().toLongLong(nullptr, 16);
+    }
+
+    void writeClock(qint64 clock) {
+        QSaveFile file(dataPath("catalog.clock"));
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(QByteArray::number(clock, 16));
+            file.commit();
+        }
+    }
+
+    // Hybrid logical clock: the wall time when it has moved on, otherwise
+    // one tick past the last stamp, so stamps only grow even when the
+    // system clock is set back.
+    qint64 tick(qint64 last) {
+        return qMax(QDateTime::currentMSecsSinceEpoch() << 16, last + 1);
+    }
+
+    State loadState() {
+        State state;
+        QFile file(dataPath("catalog.sync"));
+        if (!file.open(QIODevice::ReadOnly))
+            return state;
+        QDataStream in(&file);
+        in.setVersion(QDataStream::Qt_5_0);
+        quint32 magic, version;
+        in >> magic >> version;
+        if (in.status() != QDataStream::Ok || magic != Magic || version != Version)
+            return state;
+        in >> state.offsets;
+        if (in.status() != QDataStream::Ok)
+            return State();
+        return state;
+    }
+
+    // Loads the winners of every bucket that holds one of keys.
+    void loadWinners(State *state, const QSet<QString> &keys) {
+        for (auto &&key : keys) {
+            int bucket = bucketOf(key);
+            if (state->buckets.contains(bucket))
+                continue;
+            Bucket loaded {0, 0, 0};
+            QList<Operation> ops = readTail(bucketPath(bucket), &loaded.logged);
+            for (auto &&op : ops) {
+                QString name = Catalog::fold(op.name);
+                if (!state->winners.contains(name))
+                    loaded.names++;
+                state->winners.insert(name, op);
+            }
+            loaded.lines = ops.size();
+            state->buckets.insert(bucket, loaded);
+        }
+    }
+
+    // changed holds the names whose winner this sync replaced.
+    bool saveState(const State &state, const QSet<QString> &changed) {
+        QHash<int, QStringList> byBucket;
+        for (auto &&key : changed)
+            byBucket[bucketOf(key)].append(key);
+        QDir().mkpath(dataPath("winners"));
+        for (auto it = byBucket.constBegin(); it != byBucket.constEnd(); ++it) {
+            const Bucket &bucket = state.buckets.value(it.key());
+            QByteArray data;
+            if (bucket.lines + it->size() > 2 * bucket.names + 16) {
+                for (auto w = state.winners.constBegin(); w != state.winners.constEnd(); ++w)
+                    if (bucketOf(w.key()) == it.key())
+                        data += format(w.value());
+                QSaveFile file(bucketPath(it.key()));
+                if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+                    return false;
+                continue;
+            }
+            for (auto &&key : it.value())
+                data += format(state.winners.value(key));
+            // a line cut short by an earlier failed append is dropped first
+            QFile file(bucketPath(it.key()));
+            if (!file.open(QIODevice::ReadWrite) || !file.resize(bucket.logged) || !file.seek(bucket.logged) ||
+                    file.write(data) != data.size() || !file.flush())
+                return false;
+        }
+
+        QSaveFile file(dataPath("catalog.sync"));
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+        QDataStream out(&file);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << Magic << Version << state.offsets;
+        return out.status() == QDataStream::Ok && file.commit();
+    }
+
+    // Brings the shared copy of this machine's log up to the first length
+    // bytes of the local one: appended when the copy is the one written by
+    // the last sync, rewritten whole otherwise.
+    bool exportLog(const QString &fileName, qint64 exported, qint64 length) {
+        QFileInfo copy(fileName);
+        qint64 done = copy.exists() && copy.size() == exported && exported <= length ? exported : 0;
+        if (copy.exists() && done == length)
+            return true;
+        QByteArray bytes;
+        if (length > 0) {
+            QFile local(dataPath("catalog.oplog"));
+            if (!local.open(QIODevice::ReadOnly) || !local.seek(done))
+                return false;
+            bytes = local.read(length - done);
+        }
+        if (done == 0) {
+            QSaveFile file(fileName);
+            return file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size() && file.commit();
+        }
+        QFile file(fileName);
+        return file.open(QIODevice::Append) && file.write(bytes) == bytes.size() && file.flush();
+    }
+}
+
+namespace CatalogSync {
+    QString replicaId() {
+        QSettings settings;
+        QString id = settings.value("catalogReplica").toString();
+        if (id.isEmpty()) {
+            id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+            settings.setValue("catalogReplica", id);
+        }
+        return id;
+    }
+
+    // The last line of a name is the one in force, as in the list dialogs.
+    QList<Operation> changes(const QStringList &lines, const QStringList &touched) {
+        QList<Operation> ops;
+        QHash<QString, int> position;
+        for (auto &&name : touched) {
+            QString key = Catalog::fold(name);
+            if (position.contains(key))
+                continue;
+            position.insert(key, ops.size());
+            ops.append(Operation {0, QString(), true, name, 0});
+        }
+        Ingredient ingredient;
+        for (auto &&line : lines) {
+            if (!Catalog::parseLine(line, &ingredient))
+                continue;
+            auto it = position.constFind(Catalog::fold(ingredient.name()));
+            if (it == position.constEnd())
+                continue;
+            Operation &op = ops[it.value()];
+            op.remove = false;
+            op.name = ingredient.name();
+            op.calories = ingredient.calories();
+        }
+        return ops;
+    }
+
+    void record(QList<Operation> operations) {
+        if (operations.isEmpty())
+            return;
+        qint64 clock = readClock();
+        QByteArray data;
+        for (auto &&op : operations) {
+            clock = tick(clock);
+            op.clock = clock;
+            op.id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+            data += format(op);
+        }
+        QDir().mkpath(dataPath(QString()));
+        QFile log(dataPath("catalog.oplog"));
+        if (!log.open(QIODevice::Append) || log.write(data) != data.size())
+            qWarning() << "CatalogSync: cannot append to" << log.fileName();
+        writeClock(clock);
+    }
+
+    Report sync(const QString &folder) {
+        Report report {0, 0, 0, QString()};
+        QDir shared(folder);
+        if (folder.isEmpty() || !shared.exists()) {
+            report.error = QObject::tr("Ο φάκελος συγχρονισμού %1 δεν υπάρχει").arg(QDir::toNativeSeparators(folder));
+            return report;
+        }
+        QDir().mkpath(dataPath(QString()));
+        QLockFile lock(dataPath("catalog.sync.lock"));
+        if (!lock.tryLock(LockTimeout)) {
+            report.error = QObject::tr("Ο συγχρονισμός εκτελείται ήδη από άλλο παράθυρο");
+            return report;
+        }
+        State state = loadState();
+        QString me = replicaId();
+
+        // entries made before there was a log join it as this machine's
+        if (!state.offsets.contains(SnapshotKey)) {
+            bool recorded = Catalog::editExtended([](QStringList *lines) {
+                QStringList names;
+                Ingredient ingredient;
+                for (auto &&line : *lines)
+                    if (Catalog::parseLine(line, &ingredient))
+                        names.append(ingredient.name());
+                record(changes(*lines, names));
+                return false;
+            });
+            if (recorded)
+                state.offsets.insert(SnapshotKey, 1);
+        }
+
+        qint64 localOffset = state.offsets.value(LocalKey);
+        QList<Operation> incoming = readTail(dataPath("catalog.oplog"), &localOffset);
+        report.exported = incoming.size();
+        if (!exportLog(shared.filePath(me + ".oplog"), state.offsets.value(ExportKey), localOffset)) {
+            report.error = QObject::tr("Σφάλμα εγγραφής στον φάκελο συγχρονισμού %1").arg(QDir::toNativeSeparators(folder));
+            return report;
+        }
+        state.offsets.insert(LocalKey, localOffset);
+        state.offsets.insert(ExportKey, localOffset);
+
+        for (auto &&entry : shared.entryList(QStringList("*.oplog"), QDir::Files, QDir::Name)) {
+            QString replica = QFileInfo(entry).completeBaseName();
+            if (replica == me)
+                continue;
+            qint64 offset = state.offsets.value(replica);
+            QList<Operation> ops = readTail(shared.filePath(entry), &offset);
+            state.offsets.insert(replica, offset);
+            report.imported += ops.size();
+            incoming += ops;
+        }
+
+        if (incoming.isEmpty()) {
+            if (!saveState(state, QSet<QString>()))
+                report.error = QObject::tr("Σφάλμα αποθήκευσης της κατάστασης συγχρονισμού");
+            return report;
+        }
+        QSet<QString> touched;
+        for (auto &&op : incoming)
+            touched.insert(Catalog::fold(op.name));
+        loadWinners(&state, touched);
+
+        // Every name with a new operation gets the value of the winning one,
+        // even when that is older than what the file has: a local edit may
+        // lose to a remote one stamped later.
+        QHash<QString, QString> wanted;  // folded name -> line, empty to remove
+        QSet<QString> won;
+        qint64 latest = 0;
+        for (auto &&op : incoming) {
+            latest = qMax(latest, op.clock);
+            QString key = Catalog::fold(op.name);
+            auto it = state.winners.find(key);
+            if (it == state.winners.end() || newer(op, it.value())) {
+                state.winners.insert(key, op);
+                won.insert(key);
+            }
+            wanted.insert(key, QString());
+        }
+        for (auto it = wanted.begin(); it != wanted.end(); ++it) {
+            const Operation &op = state.winners.value(it.key());
+            if (!op.remove)
+                it.value() = op.name + " = " + QString::number(op.calories);
+        }
+
+        bool applied = wanted.isEmpty() || Catalog::editExtended([&](QStringList *lines) {
+            // stamps made here from now on order after everything seen
+            if (latest > readClock())
+                writeClock(latest);
+            QStringList result;
+            QHash<QString, QStringList> before;
+            Ingredient ingredient;
+            for (auto &&line : *lines) {
+                QString key;
+                if (Catalog::parseLine(line, &ingredient))
+                    key = Catalog::fold(ingredient.name());
+                auto it = wanted.constFind(key);
+                if (key.isEmpty() || it == wanted.constEnd()) {
+                    result.append(line);
+                    continue;
+                }
+                // the first line of a name takes the winner's place
+                if (!before.contains(key) && !it.value().isEmpty())
+                    result.append(it.value());
+                before[key].append(line);
+            }
+            for (auto it = wanted.constBegin(); it != wanted.constEnd(); ++it) {
+                if (!before.contains(it.key()) && !it.value().isEmpty())
+                    result.append(it.value());
+                QStringList now = it.value().isEmpty() ? QStringList() : QStringList(it.value());
+                if (before.value(it.key()) != now)
+                    report.changed++;
+            }
+            if (!report.changed)
+                return false;
+            *lines = result;
+            return true;
+        });
+        if (!applied) {
+            report.error = QObject::tr("Σφάλμα ενημέρωσης της λίστας υλικών");
+            return report;  // the state is not saved, so the next sync retries
+        }
+        if (!saveState(state, won))
+            report.error = QObject::tr("Σφάλμα αποθήκευσης της κατάστασης συγχρονισμού");
+        return report;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef CATALOGSYNC_H
+#define CATALOGSYNC_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/* Keeps the personal catalogs of several machines in step without a
+ * server. Every change to extended.cal is also appended to a local
+ * operation log as "set name = calories" or "remove name", stamped with a
+ * hybrid logical clock and a unique id. sync() trades logs through a
+ * shared folder, one <replica>.oplog per machine and written only by it,
+ * and replays the operations not seen yet: per folded ingredient name the
+ * operation with the greatest (clock, id) wins, so every machine ends up
+ * with the same entries whatever order they sync in. Each log is read
+ * from where the previous sync stopped. */
+namespace CatalogSync {
+    struct Operation {
+        qint64 clock;  // ms since the epoch << 16 | logical counter
+        QString id;
+        bool remove;
+        QString name;
+        int calories;
+    };
+
+    struct Report {
+        int exported;
+        int imported;
+        int changed;  // catalog entries added, updated or removed
+        QString error;
+    };
+
+    // the current value of each touched name in lines, as operations
+    // without clock and id
+    QList<Operation> changes(const QStringList &lines, const QStringList &touched);
+    // with the extended.cal lock held
+    void record(QList<Operation> operations);
+    Report sync(const QString &folder);
+    QString replicaId();
+}
+
+#endif // CATALOGSYNC_H
@@ -17,6 +17,7 @@
  */
 
 #include "collectioneditorwidget.h"
+#include "diagnostics.h"
 #include "ingredientwidget.h"
 #include <QCheckBox>
 #include <QFile>
@@ -37,38 +38,84 @@ CollectionEditorWidget::CollectionEditorWidget(QWidget *parent) : CollectionPage
     this->setLayout(caloriesGridLayout);
 }
 
+// Reuses the widgets of previous rebuilds; surplus ones are hidden and
+// parked in _spareWidgets until the recipe grows again.
 void CollectionEditorWidget::updateDisplay() {
+    Diagnostics::ScopedTimer timer("editor updateDisplay");
     setUpdatesEnabled(false);  // to avoid screen flicker
 
-    auto caloriesWidgets = findChildren<IngredientWidget *>();
-    for (auto &&widget : caloriesWidgets)
-        widget->close();
-    caloriesGridLayout->invalidate();
-
-    int rowsPerColumn = qCeil(static_cast<float>(_tmpIngredients.size()) / columns());
-    for (int i = 0; i < _tmpIngredients.size(); i++) {
-        int column = (i / rowsPerColumn);
-        int row = i % rowsPerColumn;
-        auto ingr = _tmpIngredients.at(i);
-        auto widget = new IngredientWidget(ingr, this);
-        widget->setObjectName(QString::fromUtf8("ingLabel") + QString::number(i));
+    while (_widgets.size() > _tmpIngredients.size()) {
+        auto widget = _widgets.takeLast();
+        caloriesGridLayout->removeWidget(widget);
+        widget->hide();
+        _spareWidgets.append(widget);
+    }
+    while (_widgets.size() < _tmpIngredients.size()) {
+        if (!_spareWidgets.isEmpty()) {
+            _widgets.append(_spareWidgets.takeLast());
+            continue;
+        }
+        auto widget = new IngredientWidget(this);
+        widget->setObjectName(QString::fromUtf8("ingLabel") + QString::number(_widgets.size()));
         widget->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred, QSizePolicy::Label));
-        widget->setAttribute(Qt::WA_DeleteOnClose);
         widget->setCaloriesValidator(validator);
-        if (row == 0)
-            widget->setHeaderVisible(true);
-        caloriesGridLayout->addWidget(widget, row, column * columns());
         connect(widget, &IngredientWidget::stateChanged,      this, &CollectionEditorWidget::stateUpdates);
+        connect(widget, &IngredientWidget::nameEdited,        this, [this]() { _modified = true; });
         connect(widget, &IngredientWidget::ingredientChanged, this, [=](const Ingredient &ingr) {
+            int i = _widgets.indexOf(widget);
+            if (i < 0)
+                return;
             _tmpIngredients.replace(i, ingr);
             _modified = true;
         });
-        if (i == _tmpIngredients.size() - 1)
-            _lastWidget = widget;
+        _widgets.append(widget);
     }
+
+    for (int i = 0; i < _tmpIngredients.size(); i++) {
+        auto widget = _widgets.at(i);
+        widget->setIngredient(_tmpIngredients.at(i));
+        widget->setSelected(false);
+        widget->show();
+    }
+    _lastWidget = _widgets.isEmpty() ? nullptr : _widgets.last();
+    placeWidgets();
+    setUpdatesEnabled(true);
+}
+
+// Names typed but not yet committed (the field still has focus) are
+// applied to _tmpIngredients.
+void CollectionEditorWidget::commitEdits() {
+    for (auto &&widget : _widgets)
+        widget->commitName();
+}
+
+// The same names by ingredient index, left uncommitted and not interned.
+QHash<int, QString> CollectionEditorWidget::pendingNames() const {
+    QHash<int, QString> names;
+    for (int i = 0; i < _widgets.count() && i < _tmpIngredients.count(); i++)
+        if (_widgets.at(i)->isNamePending())
+            names.insert(i, _widgets.at(i)->pendingName());
+    return names;
+}
+
+void CollectionEditorWidget::relayout() {
+    setUpdatesEnabled(false);
+    placeWidgets();
     setUpdatesEnabled(true);
 }
 
+void CollectionEditorWidget::placeWidgets() {
+    int rowsPerColumn = qMax(1, qCeil(static_cast<float>(_widgets.size()) / columns()));
+    for (int i = 0; i < _widgets.size(); i++) {
+        auto widget = _widgets.at(i);
+        int column = (i / rowsPerColumn);
+        int row = i % rowsPerColumn;
+        caloriesGridLayout->removeWidget(widget);
+        widget->setHeaderVisible(row == 0);
+        caloriesGridLayout->addWidget(widget, row, column);
+    }
+}
+
 void CollectionEditorWidget::addIngredient() {
     auto ingr = Ingredient("new", 0);
     addNew(ingr);
@@ -87,38 +134,34 @@ void CollectionEditorWidget::addNew(Ingredient ingr) {
 
 void CollectionEditorWidget::removeSelected() {
     QList<int> selections;
-    auto caloriesWidgets = findChildren<IngredientWidget *>();
-    if (caloriesWidgets.count() == 0)
+    if (_widgets.count() == 0)
         return;
-    for (auto &&widget : caloriesWidgets)
-        if (widget->isSelected())
-            selections.append(caloriesWidgets.indexOf(widget));
-    if (selections.count() == caloriesWidgets.count()) {
+    for (int i = 0; i < _widgets.count(); i++)
+        if (_widgets.at(i)->isSelected())
+            selections.append(i);
+    if (selections.count() == _widgets.count()) {
         selections.clear();
-    } else {
-        for (auto &&widget : caloriesWidgets)
-            if (widget->isSelected()) {
-                _tmpIngredients.removeOne(widget->ingredient());
-                updateDisplay();
-                Ingredients::ingredients = _tmpIngredients;
-                _modified = true;
-            }
+    } else if (!selections.isEmpty()) {
+        for (int i = selections.count() - 1; i >= 0; i--)
+            _tmpIngredients.removeAt(selections.at(i));
+        updateDisplay();
+        Ingredients::ingredients = _tmpIngredients;
+        _modified = true;
     }
     emit itemRemoved(selections);
 }
 
 void CollectionEditorWidget::moveUp() {
-    auto caloriesWidgets = findChildren<IngredientWidget *>();
     int count {0};
-    for (int i = 1; i < caloriesWidgets.count(); i++)
-        if (caloriesWidgets.at(i)->isSelected())
+    for (int i = 1; i < _widgets.count(); i++)
+        if (_widgets.at(i)->isSelected())
             count++;
     if (count > 1) {
         emit itemClimbed(-1);
         return;
     }
-    for (int i = 1; i < caloriesWidgets.count(); i++)
-        if (caloriesWidgets.at(i)->isSelected()) {
+    for (int i = 1; i < _widgets.count(); i++)
+        if (_widgets.at(i)->isSelected()) {
             #if QT_VERSION >= 0x050E02
                 _tmpIngredients.swapItemsAt(i, i-1);
             #else
@@ -128,23 +171,22 @@ void CollectionEditorWidget::moveUp() {
             updateDisplay();
             _modified = true;
             emit itemClimbed(i);
-            auto boxes = findChildren<QCheckBox *>();
-            boxes.at(i+boxes.count()/2-1)->setChecked(true);
+            _widgets.at(i-1)->setSelected(true);
+            return;
         }
 }
 
 void CollectionEditorWidget::moveDown() {
-    auto caloriesWidgets = findChildren<IngredientWidget *>();
     int count {0};
-    for (int i = 0; i < caloriesWidgets.count()-1; i++)
-        if (caloriesWidgets.at(i)->isSelected())
+    for (int i = 0; i < _widgets.count()-1; i++)
+        if (_widgets.at(i)->isSelected())
             count++;
     if (count > 1) {
         emit itemDescended(-1);
         return;
     }
-    for (int i = 0; i < caloriesWidgets.count()-1; i++)
-        if (caloriesWidgets.at(i)->isSelected()) {
+    for (int i = 0; i < _widgets.count()-1; i++)
+        if (_widgets.at(i)->isSelected()) {
             #if QT_VERSION >= 0x050E02
                 _tmpIngredients.swapItemsAt(i, i+1);
             #else
@@ -154,17 +196,14 @@ void CollectionEditorWidget::moveDown() {
             updateDisplay();
             _modified = true;
             emit itemDescended(i);
-            auto boxes = findChildren<QCheckBox *>();
-            boxes.at(i+boxes.count()/2+1)->setChecked(true);
+            _widgets.at(i+1)->setSelected(true);
+            return;
         }
 }
 
 void CollectionEditorWidget::stateUpdates() {
     IngredientWidget *w = qobject_cast<IngredientWidget *>(sender());
-    auto box = w->findChildren<QCheckBox *>();
-    auto theBox = box.at(0);
-    auto boxes = findChildren<QCheckBox *>();
-    for (int i = 0; i < boxes.count(); i++)
-        if (boxes.at(i) == theBox)
-            emit stateChanged(i);
+    int i = _widgets.indexOf(w);
+    if (i >= 0)
+        emit stateChanged(i);
 }
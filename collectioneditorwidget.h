@@ -4,6 +4,7 @@
 #include "collectionpage.h"
 #include "ingredient.h"
 #include "mainwindow.h"
+#include <QHash>
 
 class QGridLayout;
 class QIntValidator;
@@ -16,17 +17,21 @@ public:
     explicit CollectionEditorWidget(QWidget *parent = nullptr);
     ~CollectionEditorWidget() override {}
     void updateDisplay() override;
+    void relayout() override;
     void addNew(Ingredient);
+    void commitEdits();
+    QHash<int, QString> pendingNames() const;
     inline bool isModified() const { return _modified; }
     inline void setModified(bool modified) { _modified = modified; }
     IngredientWidget *lastWidget() const { return _lastWidget; }
+    const QList<IngredientWidget *> &widgets() const { return _widgets; }
 
 signals:
     void editorChanged();
-    void itemAdded(QString name);
+    void itemAdded(const QString &name);
     void itemClimbed(int i);
     void itemDescended(int i);
-    void itemRemoved(QList<int> selections);
+    void itemRemoved(const QList<int> &selections);
     void stateChanged(int boxNum);
 
 public slots:
@@ -37,9 +42,12 @@ public slots:
     void stateUpdates();
 
 private:
+    void placeWidgets();
     QGridLayout *caloriesGridLayout;
     QIntValidator *validator;
     IngredientWidget* _lastWidget { nullptr };
+    QList<IngredientWidget *> _widgets {};
+    QList<IngredientWidget *> _spareWidgets {};
     QString newName;
     bool _modified { false };
     
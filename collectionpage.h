@@ -20,6 +20,7 @@ public:
     
 protected:
     virtual void updateDisplay() = 0;
+    virtual void relayout() = 0;
     
 private:
     static int _columns;
@@ -18,54 +18,61 @@
 
 #include "combo.h"
 #include "ui_combo.h"
+#include "catalog.h"
 #include "ingredient.h"
-#include <QAbstractItemView>
-#include <QCompleter>
-#include <QDir>
-#include <QFile>
-#include <QStandardPaths>
-#include <QTextCodec>
-#include <QTextStream>
+#include "ioexecutor.h"
+#include <QRegularExpression>
+#include <QSettings>
+#include <QSignalBlocker>
 
 Combo::Combo(QWidget *parent) : QDialog(parent), ui(new Ui::Combo) {
     ui->setupUi(this);
-    QFile file(":/combined.cal");
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        return;
-    QTextStream reader(&file);
-    reader.setCodec(QTextCodec::codecForName("UTF-8"));
-    QStringList combolist;
-    while (!reader.atEnd()) {
-        QString line = reader.readLine();
-        combolist.append(line);
+    {
+        QSignalBlocker blocker(ui->category);
+        ui->category->addItem(tr("Όλες οι κατηγορίες"));
+        for (auto &&shard : Catalog::shards())
+            ui->category->addItem(shard.title, shard.id);
+        QSettings settings;
+        QString last = settings.value("catalogCategory", Catalog::shards().value(0).id).toString();
+        ui->category->setCurrentIndex(qMax(0, ui->category->findData(last)));
     }
-    QDir dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    if (dataDir.exists()) {
-        QFile ext(dataDir.path() + "/extended.cal");
-        if (ext.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream extdata(&ext);
-            extdata.setCodec(QTextCodec::codecForName("UTF-8"));
-            QStringList extIngr;
-            while (!extdata.atEnd()) {
-                QString extline = extdata.readLine();
-                extIngr.append(extline);
-            }
-            for (auto &&line : extIngr)
-                if (!combolist.contains(line)) {
-                    combolist.append(line);
-                }
-        }
-    }
-    combolist.sort();
-    for (auto &&item : combolist)
-        ui->comboBox->addItem(item);
-
-    auto completer = new QCompleter(combolist, Q_NULLPTR);
-    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    reload();
 }
 
 Combo::~Combo() { delete ui; }
 
+void Combo::reset() {
+    newIng = Ingredient();
+    reload(false);
+}
+
+// Same as DropList::reload(): read on the I/O thread, already in catalog
+// order.
+void Combo::reload(bool force) {
+    if (!force && !loading.isFinished())
+        return;  // the load in flight fills the list anyway
+    QString shard = ui->category->currentData().toString();
+    loading.cancel();
+    loading = IoExecutor::instance().run<QPair<QStringList, qint64>>("catalog lines", [shard](IoExecutor::Job &) {
+        qint64 stamp;
+        QStringList lines = Catalog::lines(shard, &stamp);
+        return qMakePair(lines, stamp);
+    });
+    IoExecutor::then<QPair<QStringList, qint64>>(loading, this, [this, force](const QPair<QStringList, qint64> &lines) {
+        if (!force && lines.second == catalogStamp)
+            return;
+        catalogStamp = lines.second;
+        ui->comboBox->clear();
+        ui->comboBox->addItems(lines.first);
+    });
+}
+
+void Combo::on_category_currentIndexChanged(int) {
+    QSettings settings;
+    settings.setValue("catalogCategory", ui->category->currentData());
+    reload();
+}
+
 void Combo::on_addButton_clicked() {
     QString selected = ui->comboBox->currentText();
     QRegularExpression tagExp(" = ");
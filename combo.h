@@ -3,6 +3,9 @@
 
 #include "ingredient.h"
 #include <QDialog>
+#include <QFuture>
+#include <QPair>
+#include <QStringList>
 
 namespace Ui { class Combo; }
 
@@ -13,13 +16,18 @@ public:
     explicit Combo(QWidget *parent = nullptr);
     ~Combo();
     Ingredient getNewIng() const { return newIng; }
+    void reset();
 
 private slots:
     void on_addButton_clicked();
+    void on_category_currentIndexChanged(int index);
 
 private:
+    void reload(bool force = true);
     Ui::Combo *ui;
     Ingredient newIng;
+    qint64 catalogStamp { -1 };
+    QFuture<QPair<QStringList, qint64>> loading {};
 };
 
 #endif // COMBO_H
@@ -0,0 +1,195 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cookbook.h"
+#include "recipe.h"
+#include "recipegraph.h"
+#include <QApplication>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QPageLayout>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QScreen>
+#include <QTextDocument>
+#include <QThread>
+#include <QtConcurrent>
+
+/* The book is produced in two parallel passes over the selected recipes.
+ * The first one only counts the pages of every recipe, which is what the
+ * table of contents needs. The second one lays the recipes out again, a few
+ * at a time, and the GUI thread paints each finished document into the PDF
+ * and drops it, so only a window of laid out recipes is ever in memory. A
+ * recipe that cannot be read has no document; the count pass reports it
+ * and stops the export. */
+
+static QTextDocument *layoutRecipe(const QString &fileName, const QSizeF &pageSize, const QFont &font) {
+    Recipe recipe;
+    if (!recipe.read(fileName))
+        return nullptr;
+    RecipeGraph::instance().update(&recipe, fileName);
+    auto doc = new QTextDocument;
+    doc->setDefaultFont(font);
+    doc->setPageSize(pageSize);
+    doc->setHtml(recipe.toHtml(QFileInfo(fileName).completeBaseName()));
+    doc->pageCount();  // forces the layout while still on the worker thread
+    return doc;
+}
+
+struct PageCounter {
+    typedef int result_type;
+    QSizeF pageSize;
+    QFont font;
+    int operator()(const QString &fileName) const {
+        QScopedPointer<QTextDocument> doc(layoutRecipe(fileName, pageSize, font));
+        return doc ? doc->pageCount() : -1;
+    }
+};
+
+struct RecipeLayouter {
+    typedef QTextDocument *result_type;
+    QSizeF pageSize;
+    QFont font;
+    QThread *target;
+    QTextDocument *operator()(const QString &fileName) const {
+        QTextDocument *doc = layoutRecipe(fileName, pageSize, font);
+        if (doc)
+            doc->moveToThread(target);
+        return doc;
+    }
+};
+
+Cookbook::Cookbook(QObject *parent) : QObject(parent) {}
+
+void Cookbook::cancel() {
+    canceled = true;
+    if (watcher)
+        watcher->cancel();
+}
+
+// Runs a nested event loop until the future is done, so that the progress
+// dialog stays responsive and can cancel the job.
+template <typename T>
+QList<T> Cookbook::wait(const QFuture<T> &future, int progressOffset) {
+    QFutureWatcher<T> futureWatcher;
+    QEventLoop loop;
+    connect(&futureWatcher, &QFutureWatcher<T>::finished, &loop, &QEventLoop::quit);
+    connect(&futureWatcher, &QFutureWatcher<T>::progressValueChanged, this, [=](int value) {
+        emit progressValueChanged(progressOffset + value);
+    });
+    watcher = &futureWatcher;
+    futureWatcher.setFuture(future);
+    loop.exec();
+    watcher = nullptr;
+    return future.results();
+}
+
+bool Cookbook::write(const QStringList &files, const QString &fileName) {
+    canceled = false;
+    _errorString.clear();
+    QPdfWriter writer(fileName);
+    writer.setResolution(qRound(QApplication::primaryScreen()->logicalDotsPerInchY()));
+    writer.setPageSize(QPageSize(QPageSize::A4));
+    writer.setPageMargins(QMarginsF(15, 15, 15, 15), QPageLayout::Millimeter);
+    writer.setTitle(QFileInfo(fileName).completeBaseName());
+    writer.setCreator(QApplication::applicationName());
+
+    QRect paintRect = writer.pageLayout().paintRectPixels(writer.resolution());
+    QFont font = QApplication::font();
+    qreal footer = QFontMetricsF(font).height() * 2;
+    QSizeF pageSize(paintRect.width(), paintRect.height() - footer);
+
+    emit progressRangeChanged(0, files.count() * 2);
+    PageCounter counter {pageSize, font};
+    QList<int> pageCounts = wait(QtConcurrent::mapped(files, counter), 0);
+    if (canceled || pageCounts.count() != files.count()) {
+        _errorString = tr("Η εξαγωγή ακυρώθηκε");
+        return false;
+    }
+    int unreadable = pageCounts.indexOf(-1);
+    if (unreadable >= 0) {
+        _errorString = tr("Σφάλμα ανοίγματος αρχείου: %1").arg(files.at(unreadable));
+        return false;
+    }
+
+    // the contents pages are numbered too, so repeat until their count settles
+    QTextDocument contents;
+    contents.setDefaultFont(font);
+    contents.setPageSize(pageSize);
+    int contentsPages {1};
+    for (int pass = 0; pass < 4; pass++) {
+        QString html = "<p style='text-align: center'><b><h2>" + tr("Περιεχόμενα") + "</h2></b></p><table width='100%'>";
+        int page = contentsPages + 1;
+        for (int i = 0; i < files.count(); i++) {
+            html += "<tr><td>" + QFileInfo(files.at(i)).completeBaseName().toHtmlEscaped() +
+                    "</td><td align='right'>" + QString::number(page) + "</td></tr>";
+            page += pageCounts.at(i);
+        }
+        contents.setHtml(html + "</table>");
+        if (contents.pageCount() == contentsPages)
+            break;
+        contentsPages = contents.pageCount();
+    }
+
+    QPainter painter;
+    if (!painter.begin(&writer)) {
+        _errorString = tr("Σφάλμα δημιουργίας του αρχείου %1").arg(fileName);
+        return false;
+    }
+    int pageNumber {1};
+    auto paintDocument = [&](QTextDocument *doc) {
+        for (int p = 0; p < doc->pageCount(); p++) {
+            if (pageNumber > 1)
+                writer.newPage();
+            painter.save();
+            painter.translate(0, -p * pageSize.height());
+            doc->drawContents(&painter, QRectF(QPointF(0, p * pageSize.height()), pageSize));
+            painter.restore();
+            painter.drawText(QRectF(0, pageSize.height(), pageSize.width(), footer),
+                             Qt::AlignCenter, QString::number(pageNumber));
+            pageNumber++;
+        }
+    };
+    paintDocument(&contents);
+
+    int window = qMax(1, QThread::idealThreadCount() * 2);
+    RecipeLayouter layouter {pageSize, font, QThread::currentThread()};
+    for (int first = 0; first < files.count() && !canceled; first += window) {
+        QStringList chunk = files.mid(first, window);
+        QList<QTextDocument *> docs = wait(QtConcurrent::mapped(chunk, layouter), files.count() + first);
+        for (int i = 0; i < docs.count(); i++) {
+            // gone since it was counted: the contents would not match
+            if (!docs.at(i) && !canceled) {
+                _errorString = tr("Σφάλμα ανοίγματος αρχείου: %1").arg(chunk.at(i));
+                canceled = true;
+            }
+            if (!canceled)
+                paintDocument(docs.at(i));
+            delete docs.at(i);
+        }
+    }
+    painter.end();
+    if (canceled) {
+        if (_errorString.isEmpty())
+            _errorString = tr("Η εξαγωγή ακυρώθηκε");
+        return false;
+    }
+    emit progressValueChanged(files.count() * 2);
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef COOKBOOK_H
+#define COOKBOOK_H
+
+#include <QFuture>
+#include <QObject>
+#include <QStringList>
+
+class QFutureWatcherBase;
+
+class Cookbook : public QObject {
+    Q_OBJECT
+
+public:
+    explicit Cookbook(QObject *parent = nullptr);
+    bool write(const QStringList &files, const QString &fileName);
+    QString errorString() const { return _errorString; }
+
+public slots:
+    void cancel();
+
+signals:
+    void progressRangeChanged(int minimum, int maximum);
+    void progressValueChanged(int value);
+
+private:
+    template <typename T> QList<T> wait(const QFuture<T> &future, int progressOffset);
+    QFutureWatcherBase *watcher { nullptr };
+    QString _errorString;
+    bool canceled { false };
+};
+
+#endif // COOKBOOK_H
@@ -0,0 +1,181 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dedupe.h"
+#include <QHash>
+#include <QVector>
+#include <algorithm>
+
+namespace {
+    const int MaxBlock = 400;  // larger blocks are too generic to say anything
+
+    class DisjointSets {
+    public:
+        explicit DisjointSets(int count) : parent(count), size(count, 1) {
+            for (int i = 0; i < count; i++)
+                parent[i] = i;
+        }
+
+        int find(int i) {
+            while (parent[i] != i) {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        }
+
+        void unite(int a, int b) {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+                return;
+            if (size[a] < size[b])
+                std::swap(a, b);
+            parent[b] = a;
+            size[a] += size[b];
+        }
+
+    private:
+        QVector<int> parent;
+        QVector<int> size;
+    };
+
+    // Levenshtein distance, giving up as soon as it must exceed limit.
+    int boundedDistance(const QString &a, const QString &b, int limit) {
+        if (qAbs(a.size() - b.size()) > limit)
+            return limit + 1;
+        QVector<int> previous(b.size() + 1), current(b.size() + 1);
+        for (int j = 0; j <= b.size(); j++)
+            previous[j] = j;
+        for (int i = 1; i <= a.size(); i++) {
+            current[0] = i;
+            int rowMin = i;
+            for (int j = 1; j <= b.size(); j++) {
+                int cost = a.at(i - 1) == b.at(j - 1) ? 0 : 1;
+                current[j] = qMin(qMin(previous[j] + 1, current[j - 1] + 1), previous[j - 1] + cost);
+                rowMin = qMin(rowMin, current[j]);
+            }
+            if (rowMin > limit)
+                return limit + 1;
+            std::swap(previous, current);
+        }
+        return previous[b.size()];
+    }
+
+    int distanceLimit(const QString &name) {
+        return name.size() < 5 ? 0 : name.size() < 10 ? 1 : 2;
+    }
+
+    bool similarCalories(int a, int b) {
+        return a == b || a == 0 || b == 0 || qAbs(a - b) <= qMax(5, qMax(a, b) / 10);
+    }
+
+    QStringList blockingKeys(const QString &folded) {
+        QStringList keys;
+        QString compact = QString(folded).remove(' ');
+        keys.append("p:" + compact.left(3));
+        keys.append("s:" + compact.right(3));
+        for (auto &&word : folded.split(' '))
+            if (word.size() >= 4)
+                keys.append("w:" + word.left(4));
+        return keys;
+    }
+}
+
+namespace Dedupe {
+    bool isPlaceholder(const Ingredient &ingredient) {
+        QString folded = Catalog::fold(ingredient.name());
+        return folded.isEmpty() || folded == "new";
+    }
+
+    QList<Cluster> findClusters(const QList<Ingredient> &entries, int firstEditable) {
+        int count = entries.size();
+        QVector<QString> folded(count);
+        QHash<QString, int> exact;
+        QHash<QString, QVector<int>> blocks;
+        DisjointSets sets(count);
+        QList<int> placeholders;
+
+        for (int i = 0; i < count; i++) {
+            if (i >= firstEditable && isPlaceholder(entries.at(i))) {
+                placeholders.append(i);
+                continue;
+            }
+            folded[i] = Catalog::fold(entries.at(i).name());
+            auto it = exact.constFind(folded.at(i));
+            if (it != exact.constEnd()) {
+                sets.unite(it.value(), i);
+                continue;  // its twin already stands for it in every block
+            }
+            exact.insert(folded.at(i), i);
+            for (auto &&key : blockingKeys(folded.at(i)))
+                blocks[key].append(i);
+        }
+
+        for (auto &&block : blocks) {
+            if (block.size() > MaxBlock)
+                continue;
+            for (int x = 0; x < block.size(); x++) {
+                int a = block.at(x);
+                for (int y = x + 1; y < block.size(); y++) {
+                    int b = block.at(y);
+                    if (a < firstEditable && b < firstEditable)
+                        continue;
+                    if (sets.find(a) == sets.find(b))
+                        continue;
+                    if (!similarCalories(entries.at(a).calories(), entries.at(b).calories()))
+                        continue;
+                    int limit = qMin(distanceLimit(folded.at(a)), distanceLimit(folded.at(b)));
+                    if (limit && boundedDistance(folded.at(a), folded.at(b), limit) <= limit)
+                        sets.unite(a, b);
+                }
+            }
+        }
+
+        QHash<int, int> clusterOf;
+        QList<Cluster> clusters;
+        for (int i = 0; i < count; i++) {
+            if (folded.at(i).isEmpty())
+                continue;
+            int root = sets.find(i);
+            if (!clusterOf.contains(root)) {
+                clusterOf.insert(root, clusters.size());
+                clusters.append(Cluster {{}, -1});
+            }
+            clusters[clusterOf.value(root)].members.append(i);
+        }
+
+        QList<Cluster> result;
+        for (auto &&cluster : clusters) {
+            if (cluster.members.size() < 2 || cluster.members.last() < firstEditable)
+                continue;
+            // a built-in entry wins, then the first one that has calories
+            cluster.keep = cluster.members.first();
+            if (cluster.keep >= firstEditable)
+                for (int i : cluster.members)
+                    if (entries.at(i).calories()) {
+                        cluster.keep = i;
+                        break;
+                    }
+            result.append(cluster);
+        }
+        if (!placeholders.isEmpty())
+            result.append(Cluster {placeholders, -1});
+        return result;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+#include "ingredient.h"
+#include <QList>
+
+// Groups catalog entries that very likely describe the same ingredient:
+// names equal once folded (accents, case, whitespace), or within a small
+// edit distance with similar calories. Candidate pairs only come from
+// entries sharing a blocking key, so the cost grows with the size of the
+// blocks rather than with the square of the catalog.
+namespace Dedupe {
+    struct Cluster {
+        QList<int> members;  // indexes into the entries, ascending
+        int keep;            // suggested survivor, or -1 when all are placeholders
+    };
+
+    // entries before firstEditable are reference entries (the built-in
+    // catalog); they anchor clusters but are never proposed for removal
+    QList<Cluster> findClusters(const QList<Ingredient> &entries, int firstEditable);
+
+    bool isPlaceholder(const Ingredient &ingredient);
+}
+
+#endif // DEDUPE_H
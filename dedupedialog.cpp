@@ -0,0 +1,164 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dedupedialog.h"
+#include "ui_dedupedialog.h"
+#include "ioexecutor.h"
+#include <QFile>
+#include <QFont>
+#include <QMessageBox>
+#include <QTextCodec>
+#include <QTextStream>
+#include <QTreeWidgetItem>
+
+DedupeDialog::DedupeDialog(const Contents &contents, QWidget *parent) :
+    QDialog(parent), ui(new Ui::DedupeDialog), contents(contents)
+{
+    ui->setupUi(this);
+    populate();
+}
+
+DedupeDialog::~DedupeDialog() { delete ui; }
+
+DedupeDialog::Contents DedupeDialog::load() {
+    Contents read {Catalog::builtinEntries(), QList<int>(), QStringList(), 0, QList<Dedupe::Cluster>()};
+    read.firstEditable = read.entries.size();
+
+    QFile file(Catalog::extendedFileName());
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&file);
+        in.setCodec(QTextCodec::codecForName("UTF-8"));
+        Ingredient ingredient;
+        while (!in.atEnd()) {
+            read.lines.append(in.readLine());
+            if (Catalog::parseLine(read.lines.last(), &ingredient)) {
+                read.entries.append(ingredient);
+                read.lineOf.append(read.lines.size() - 1);
+            }
+        }
+    }
+    read.clusters = Dedupe::findClusters(read.entries, read.firstEditable);
+    return read;
+}
+
+void DedupeDialog::populate() {
+    ui->treeWidget->clear();
+    int removable {0};
+    for (int c = 0; c < contents.clusters.size(); c++) {
+        const auto &cluster = contents.clusters.at(c);
+        auto top = new QTreeWidgetItem(ui->treeWidget);
+        top->setFlags(top->flags() | Qt::ItemIsUserCheckable);
+        top->setCheckState(0, Qt::Checked);
+        top->setData(0, Qt::UserRole, c);
+        for (int i : cluster.members) {
+            auto child = new QTreeWidgetItem(top);
+            const Ingredient &ingr = contents.entries.at(i);
+            child->setText(0, ingr.name());
+            child->setText(1, QString::number(ingr.calories()));
+            child->setText(2, i < contents.firstEditable ? tr("βασική λίστα") : QString());
+            child->setData(0, Qt::UserRole, i);
+            if (i >= contents.firstEditable)
+                removable++;
+        }
+        setKeep(c, cluster.keep);
+        top->setExpanded(true);
+    }
+    for (int column = 0; column < ui->treeWidget->columnCount(); column++)
+        ui->treeWidget->resizeColumnToContents(column);
+    ui->summary->setText(contents.clusters.isEmpty()
+                         ? tr("Δεν βρέθηκαν διπλότυπα υλικά.")
+                         : tr("%1 ομάδες πιθανών διπλοτύπων, %2 εγγραφές της προσωπικής λίστας. "
+                              "Διπλό κλικ σε υλικό για να οριστεί ως αυτό που θα διατηρηθεί.")
+                           .arg(contents.clusters.size()).arg(removable));
+}
+
+// The kept member is shown in bold and named on the cluster row.
+void DedupeDialog::setKeep(int cluster, int member) {
+    contents.clusters[cluster].keep = member;
+    auto top = ui->treeWidget->topLevelItem(cluster);
+    for (int i = 0; i < top->childCount(); i++) {
+        auto child = top->child(i);
+        QFont font = child->font(0);
+        font.setBold(child->data(0, Qt::UserRole).toInt() == member);
+        child->setFont(0, font);
+    }
+    top->setText(0, member < 0 ? tr("Κενές εγγραφές (θα αφαιρεθούν όλες)")
+                               : tr("Διατήρηση: %1").arg(contents.entries.at(member).name()));
+    top->setText(1, member < 0 ? QString() : QString::number(contents.entries.at(member).calories()));
+}
+
+void DedupeDialog::on_treeWidget_itemDoubleClicked(QTreeWidgetItem *item) {
+    auto top = item->parent();
+    if (!top)
+        return;
+    int cluster = top->data(0, Qt::UserRole).toInt();
+    if (contents.clusters.at(cluster).keep < 0)
+        return;
+    setKeep(cluster, item->data(0, Qt::UserRole).toInt());
+}
+
+void DedupeDialog::setAllChecked(bool checked) {
+    for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
+        ui->treeWidget->topLevelItem(i)->setCheckState(0, checked ? Qt::Checked : Qt::Unchecked);
+}
+
+void DedupeDialog::on_selectAllButton_clicked() { setAllChecked(true); }
+
+void DedupeDialog::on_selectNoneButton_clicked() { setAllChecked(false); }
+
+// The removal waits for the catalog lock on the I/O thread; the dialog
+// stays open, its buttons disabled, until it is done.
+void DedupeDialog::accept() {
+    if (writing)
+        return;
+    QStringList dropped;
+    for (int c = 0; c < contents.clusters.size(); c++) {
+        if (ui->treeWidget->topLevelItem(c)->checkState(0) != Qt::Checked)
+            continue;
+        for (int i : contents.clusters.at(c).members)
+            if (i >= contents.firstEditable && i != contents.clusters.at(c).keep)
+                dropped.append(contents.lines.at(contents.lineOf.at(i - contents.firstEditable)));
+    }
+    if (dropped.isEmpty()) {
+        QDialog::accept();
+        return;
+    }
+    writing = true;
+    ui->buttonBox->setEnabled(false);
+    // The lines are matched by text against the file as it is then, so
+    // entries another instance added since the dialog was opened survive;
+    // unrelated lines, comments included, keep their place.
+    QFuture<bool> written = IoExecutor::instance().run<bool>("dedupe catalog", [dropped](IoExecutor::Job &) {
+        return Catalog::removeLines(dropped);
+    });
+    IoExecutor::then<bool>(written, this, [this](bool ok) {
+        writing = false;
+        ui->buttonBox->setEnabled(true);
+        if (!ok) {
+            QMessageBox::warning(this, windowTitle(), tr("Σφάλμα αποθήκευσης της λίστας υλικών"));
+            return;
+        }
+        QDialog::accept();
+    });
+}
+
+// Closing mid-write would drop the result of the removal unseen.
+void DedupeDialog::reject() {
+    if (!writing)
+        QDialog::reject();
+}
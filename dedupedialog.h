@@ -0,0 +1,48 @@
+#ifndef DEDUPEDIALOG_H
+#define DEDUPEDIALOG_H
+
+#include "dedupe.h"
+#include <QDialog>
+#include <QStringList>
+
+class QTreeWidgetItem;
+namespace Ui { class DedupeDialog; }
+
+class DedupeDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    // the catalog as read by load(), which touches the disk and is meant
+    // for the I/O thread
+    struct Contents {
+        QList<Ingredient> entries;
+        QList<int> lineOf;  // extended.cal line of each editable entry
+        QStringList lines;
+        int firstEditable;
+        QList<Dedupe::Cluster> clusters;
+    };
+
+    explicit DedupeDialog(const Contents &contents, QWidget *parent = nullptr);
+    ~DedupeDialog();
+    bool hasClusters() const { return !contents.clusters.isEmpty(); }
+    static Contents load();
+
+public slots:
+    void accept() override;
+    void reject() override;
+
+private slots:
+    void on_treeWidget_itemDoubleClicked(QTreeWidgetItem *item);
+    void on_selectAllButton_clicked();
+    void on_selectNoneButton_clicked();
+
+private:
+    void populate();
+    void setKeep(int cluster, int member);
+    void setAllChecked(bool checked);
+    Ui::DedupeDialog *ui;
+    Contents contents;
+    bool writing {false};
+};
+
+#endif // DEDUPEDIALOG_H
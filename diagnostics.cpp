@@ -0,0 +1,83 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "diagnostics.h"
+#include <QAtomicInt>
+#include <QMutex>
+
+namespace {
+    const int FrameWindow = 240;  // frames kept for the histogram
+
+    QMutex mutex;
+    QMap<QString, Diagnostics::Timing> timingMap;
+    QAtomicInt pending;
+    qint64 frames[FrameWindow];
+    int frameCount {0};
+    int nextFrame {0};
+}
+
+namespace Diagnostics {
+    // Called from the GUI thread and from pool threads alike; the lock is
+    // held for a map lookup only.
+    void record(const char *operation, qint64 usecs) {
+        QMutexLocker locker(&mutex);
+        auto it = timingMap.find(QLatin1String(operation));
+        if (it == timingMap.end())
+            it = timingMap.insert(QLatin1String(operation), Timing{0, 0, 0, 0});
+        it->last = usecs;
+        it->max = qMax(it->max, usecs);
+        it->total += usecs;
+        it->count++;
+    }
+
+    QMap<QString, Timing> timings() {
+        QMutexLocker locker(&mutex);
+        return timingMap;
+    }
+
+    void ioStarted() { pending.ref(); }
+
+    void ioFinished() { pending.deref(); }
+
+    int pendingIo() { return pending.loadAcquire(); }
+
+    void recordFrame(qint64 usecs) {
+        QMutexLocker locker(&mutex);
+        frames[nextFrame] = usecs;
+        nextFrame = (nextFrame + 1) % FrameWindow;
+        frameCount = qMin(frameCount + 1, FrameWindow);
+    }
+
+    const QVector<int> &frameBuckets() {
+        static const QVector<int> buckets {4, 8, 16, 33, 50, 100, 250, 1000};
+        return buckets;
+    }
+
+    QVector<int> frameHistogram() {
+        const QVector<int> &buckets = frameBuckets();
+        QVector<int> histogram(buckets.size() + 1, 0);
+        QMutexLocker locker(&mutex);
+        for (int i = 0; i < frameCount; i++) {
+            int bucket = 0;
+            while (bucket < buckets.size() && frames[i] >= buckets.at(bucket) * 1000)
+                bucket++;
+            histogram[bucket]++;
+        }
+        return histogram;
+    }
+}
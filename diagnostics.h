@@ -0,0 +1,45 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+// Cheap always-on counters behind the diagnostics dock: how long the page
+// rebuilds and calculations took, how much background I/O is in flight and
+// how long the window took to paint its recent frames.
+namespace Diagnostics {
+    // durations in microseconds
+    struct Timing {
+        qint64 last;
+        qint64 max;
+        qint64 total;
+        int count;
+    };
+
+    void record(const char *operation, qint64 usecs);
+    QMap<QString, Timing> timings();
+
+    // times the enclosing scope under a static operation name
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(const char *operation) : operation(operation) { timer.start(); }
+        ~ScopedTimer() { record(operation, timer.nsecsElapsed() / 1000); }
+
+    private:
+        const char *operation;
+        QElapsedTimer timer;
+    };
+
+    void ioStarted();
+    void ioFinished();
+    int pendingIo();
+
+    void recordFrame(qint64 usecs);
+    // upper bounds in ms of the histogram buckets; the last one is open
+    const QVector<int> &frameBuckets();
+    QVector<int> frameHistogram();
+}
+
+#endif // DIAGNOSTICS_H
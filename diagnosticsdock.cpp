@@ -0,0 +1,106 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "diagnosticsdock.h"
+#include "diagnostics.h"
+#include <QHeaderView>
+#include <QStackedWidget>
+#include <QTimer>
+#include <QTreeWidget>
+
+namespace {
+    const int RefreshInterval = 500;  // ms
+    const int BarWidth = 30;
+
+    QString milliseconds(qint64 usecs) {
+        return QString::number(usecs / 1000.0, 'f', 1) + " ms";
+    }
+}
+
+DiagnosticsDock::DiagnosticsDock(QStackedWidget *pages, QWidget *parent) :
+    QDockWidget(tr("Διαγνωστικά"), parent),
+    pages(pages)
+{
+    setObjectName("diagnostics");
+    tree = new QTreeWidget(this);
+    tree->setColumnCount(2);
+    tree->setHeaderLabels(QStringList() << tr("Μέτρηση") << tr("Τιμή"));
+    tree->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+    tree->setRootIsDecorated(false);
+    QFont mono("monospace");
+    mono.setStyleHint(QFont::TypeWriter);
+    tree->setFont(mono);
+    setWidget(tree);
+
+    // Sampling only runs while the dock is visible, so leaving it closed
+    // costs nothing beyond the counters themselves.
+    timer = new QTimer(this);
+    timer->setInterval(RefreshInterval);
+    connect(timer, &QTimer::timeout, this, &DiagnosticsDock::refresh);
+    connect(this, &QDockWidget::visibilityChanged, this, [this](bool visible) {
+        if (visible) {
+            refresh();
+            timer->start();
+        } else {
+            timer->stop();
+        }
+    });
+}
+
+void DiagnosticsDock::refresh() {
+    tree->setUpdatesEnabled(false);
+    tree->clear();
+
+    auto section = new QTreeWidgetItem(tree, QStringList(tr("Γραφικά στοιχεία ανά σελίδα")));
+    for (int i = 0; i < pages->count(); i++) {
+        QWidget *page = pages->widget(i);
+        new QTreeWidgetItem(section, QStringList() << QString::fromLatin1(page->metaObject()->className())
+                                                   << QString::number(page->findChildren<QWidget *>().count()));
+    }
+
+    section = new QTreeWidgetItem(tree, QStringList(tr("Διάρκεια λειτουργιών (τελευταία / μέγιστη / μέση)")));
+    const auto timings = Diagnostics::timings();
+    for (auto it = timings.cbegin(); it != timings.cend(); ++it) {
+        const Diagnostics::Timing &timing = it.value();
+        new QTreeWidgetItem(section, QStringList() << it.key()
+                            << QString("%1 / %2 / %3 (×%4)").arg(milliseconds(timing.last),
+                                                                 milliseconds(timing.max),
+                                                                 milliseconds(timing.total / qMax(1, timing.count)))
+                                                             .arg(timing.count));
+    }
+
+    new QTreeWidgetItem(tree, QStringList() << tr("Εργασίες αρχείων σε εξέλιξη")
+                                            << QString::number(Diagnostics::pendingIo()));
+
+    section = new QTreeWidgetItem(tree, QStringList(tr("Χρόνος σχεδίασης καρέ")));
+    const QVector<int> &buckets = Diagnostics::frameBuckets();
+    const QVector<int> histogram = Diagnostics::frameHistogram();
+    int most = 1;
+    for (int count : histogram)
+        most = qMax(most, count);
+    for (int i = 0; i < histogram.size(); i++) {
+        QString label = i < buckets.size() ? QString("< %1 ms").arg(buckets.at(i))
+                                           : QString("≥ %1 ms").arg(buckets.last());
+        int bar = histogram.at(i) ? qMax(1, histogram.at(i) * BarWidth / most) : 0;
+        new QTreeWidgetItem(section, QStringList() << label
+                            << QString("%1 %2").arg(histogram.at(i), 4).arg(QString(bar, QChar(0x2588))));
+    }
+
+    tree->expandAll();
+    tree->setUpdatesEnabled(true);
+}
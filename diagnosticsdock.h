@@ -0,0 +1,25 @@
+#ifndef DIAGNOSTICSDOCK_H
+#define DIAGNOSTICSDOCK_H
+
+#include <QDockWidget>
+
+class QStackedWidget;
+class QTimer;
+class QTreeWidget;
+
+class DiagnosticsDock : public QDockWidget {
+    Q_OBJECT
+
+public:
+    explicit DiagnosticsDock(QStackedWidget *pages, QWidget *parent = nullptr);
+
+private slots:
+    void refresh();
+
+private:
+    QStackedWidget *pages;
+    QTreeWidget *tree;
+    QTimer *timer;
+};
+
+#endif // DIAGNOSTICSDOCK_H
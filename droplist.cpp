@@ -18,40 +18,26 @@
 
 #include "droplist.h"
 #include "ui_droplist.h"
+#include "catalog.h"
+#include "ioexecutor.h"
 #include <QAbstractItemView>
-#include <QCompleter>
-#include <QDir>
-#include <QFile>
 #include <QList>
 #include <QListView>
-#include <QSaveFile>
-#include <QStandardPaths>
-#include <QTextCodec>
-#include <QTextStream>
+#include <QSettings>
+#include <QSignalBlocker>
 
 DropList::DropList(QWidget *parent) : QDialog(parent), ui(new Ui::DropList) {
     ui->setupUi(this);
-    read(":/combined.cal");
-    QDir dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    if (dataDir.exists()) {
-        QFile ext(dataDir.path() + "/extended.cal");
-        if (!ext.open(QIODevice::ReadOnly | QIODevice::Text))
-            return;
-        QTextStream extdata(&ext);
-        extdata.setCodec(QTextCodec::codecForName("UTF-8"));
-        QStringList extIngr;
-        while (!extdata.atEnd()) {
-            QString extline = extdata.readLine();
-            extIngr.append(extline);
-        }
-        for (auto &&line : extIngr)
-            if (!combolist.contains(line)) {
-                ui->listWidget->addItem(line);
-                combolist.append(line);
-            }
+    {
+        QSignalBlocker blocker(ui->category);
+        ui->category->addItem(tr("Όλες οι κατηγορίες"));
+        for (auto &&shard : Catalog::shards())
+            ui->category->addItem(shard.title, shard.id);
+        QSettings settings;
+        QString last = settings.value("catalogCategory", Catalog::shards().value(0).id).toString();
+        ui->category->setCurrentIndex(qMax(0, ui->category->findData(last)));
     }
-    auto completer = new QCompleter(combolist, Q_NULLPTR);
-    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    reload();
 }
 
 DropList::~DropList() { delete ui; }
@@ -63,17 +49,40 @@ QStringList DropList::selectedItems() const {
     return selected;
 }
 
-void DropList::read(const QString& filename) {
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        return;
-    QTextStream reader(&file);
-    reader.setCodec(QTextCodec::codecForName("UTF-8"));
-    while (!reader.atEnd()) {
-        QString line = reader.readLine();
-        ui->listWidget->addItem(line);
-        combolist.append(line);
-    }
+// The dialog is kept between uses: clear the previous selection and pick
+// up catalog changes made since it was filled.
+void DropList::reset() {
+    ui->listWidget2->clear();
+    reload(false);
+}
+
+// Only the chosen category is read from the catalog, already in catalog
+// order; the full list is loaded just for "all categories". The lines come
+// from the I/O thread, and a newer request cancels one still in flight.
+// Unless forced, the list is refilled only when extended.cal changed.
+void DropList::reload(bool force) {
+    if (!force && !loading.isFinished())
+        return;  // the load in flight fills the list anyway
+    QString shard = ui->category->currentData().toString();
+    loading.cancel();
+    loading = IoExecutor::instance().run<QPair<QStringList, qint64>>("catalog lines", [shard](IoExecutor::Job &) {
+        qint64 stamp;
+        QStringList lines = Catalog::lines(shard, &stamp);
+        return qMakePair(lines, stamp);
+    });
+    IoExecutor::then<QPair<QStringList, qint64>>(loading, this, [this, force](const QPair<QStringList, qint64> &lines) {
+        if (!force && lines.second == catalogStamp)
+            return;
+        catalogStamp = lines.second;
+        ui->listWidget->clear();
+        ui->listWidget->addItems(lines.first);
+    });
+}
+
+void DropList::on_category_currentIndexChanged(int) {
+    QSettings settings;
+    settings.setValue("catalogCategory", ui->category->currentData());
+    reload();
 }
 
 void DropList::on_listWidget_itemDoubleClicked(QListWidgetItem *item) {
@@ -94,34 +103,14 @@ void DropList::on_deselectButton_clicked() {
     delete item;
 }
 
+// Only entries of the personal list can go; built-in lines are left alone
+// by Catalog::removeEntry().
 void DropList::on_removeButton_clicked() {
     if (ui->listWidget->currentItem() == NULL)
         return;
-    QDir dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    if (!dataDir.exists())
-        dataDir.mkpath(".");
-    QFile file(dataDir.path() + "/extended.cal");
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        return;
-    QTextStream reader(&file);
-    reader.setCodec(QTextCodec::codecForName("UTF-8"));
-    QStringList lines;
-    while (!reader.atEnd()) {
-        QString line = reader.readLine();
-        if (line != ui->listWidget->currentItem()->text())
-            lines.append(line);
-    }
-    file.close();
-    QFile newFile(dataDir.path() + "/extended.cal");
-    if (!newFile.open(QIODevice::WriteOnly | QIODevice::Text))
-        return;
-    QTextStream writer(&newFile);
-    writer.setCodec(QTextCodec::codecForName("UTF-8"));
-    QString linesStr;
-    for (auto &&line : lines)
-        linesStr += line + "\n";
-    QByteArray ba = linesStr.toLocal8Bit();
-    const char *lineCharArray = ba.data();
-    newFile.write(lineCharArray);
-    ui->listWidget->takeItem(ui->listWidget->currentRow());
+    QString line = ui->listWidget->currentItem()->text();
+    delete ui->listWidget->takeItem(ui->listWidget->currentRow());
+    IoExecutor::instance().run<bool>("remove catalog entry", [line](IoExecutor::Job &) {
+        return Catalog::removeEntry(line);
+    });
 }
@@ -2,7 +2,9 @@
 #define DROPLIST_H
 
 #include <QDialog>
+#include <QFuture>
 #include <QListWidget>
+#include <QPair>
 #include "ingredients.h"
 
 namespace Ui { class DropList; }
@@ -14,9 +16,10 @@ public:
     explicit DropList(QWidget *parent = nullptr);
     ~DropList();
     QStringList selectedItems() const;
-    void read(const QString &filename);
+    void reset();
 
 private slots:
+    void on_category_currentIndexChanged(int index);
     void on_listWidget_itemDoubleClicked(QListWidgetItem *item);
     void on_listWidget2_itemDoubleClicked();
     void on_deselectButton_clicked();
@@ -24,8 +27,10 @@ private slots:
     void on_selectButton_clicked();
 
 private:
+    void reload(bool force = true);
     Ui::DropList *ui;
-    QStringList combolist;
+    qint64 catalogStamp { -1 };
+    QFuture<QPair<QStringList, qint64>> loading {};
 };
 
 #endif // DROPLIST_H
@@ -6,6 +6,9 @@
 const QString APPNAME("NefChef");
 const QString VERSION("2.9.1");
 const QString CONTRIBUTORS("Dimitris Psathas, Asterios Dimitriou");
+const int AUTOSAVE_INTERVAL(20000);  // ms between recovery snapshots
+const int PREWARM_DELAY(300);        // ms of idle time between lazy construction steps
+const int CATALOG_FLUSH_DELAY(2000); // ms new catalog entries are gathered before one locked write
 const QString br("<br/>");
 const QString plh("Οδηγίες εκτέλεσης της συνταγής "
                   "(στην εξαγωγή σε PDF εισάγονται αυτόματα bullet points σε κάθε χειροκίνητη αλλαγή σειράς)");
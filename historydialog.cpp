@@ -0,0 +1,84 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "historydialog.h"
+#include "ui_historydialog.h"
+#include "ioexecutor.h"
+#include <QFileInfo>
+#include <QPushButton>
+
+// history comes loaded from the I/O thread; see MainWindow::on_actionHistory_triggered()
+HistoryDialog::HistoryDialog(const QSharedPointer<RecipeHistory> &history, QWidget *parent) :
+    QDialog(parent), ui(new Ui::HistoryDialog), history(history)
+{
+    ui->setupUi(this);
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setText(tr("Επαναφορά"));
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
+    QString location = history->location();
+    // newest first
+    const auto &revisions = history->revisions();
+    for (int i = revisions.size() - 1; i >= 0; i--)
+        ui->listWidget->addItem(describe(revisions.at(i)));
+    title = QFileInfo(location).completeBaseName();
+    setWindowTitle(tr("Ιστορικό: %1").arg(QFileInfo(location).fileName()));
+    if (!revisions.isEmpty())
+        ui->listWidget->setCurrentRow(0);
+}
+
+HistoryDialog::~HistoryDialog() { delete ui; }
+
+QString HistoryDialog::describe(const RecipeHistory::Revision &revision) const {
+    QStringList changes;
+    if (revision.added)
+        changes.append(tr("+%1 υλικά").arg(revision.added));
+    if (revision.removed)
+        changes.append(tr("-%1 υλικά").arg(revision.removed));
+    if (revision.changed)
+        changes.append(tr("%1 δοσολογίες").arg(revision.changed));
+    if (revision.instructions)
+        changes.append(tr("οδηγίες"));
+    QString time = revision.time.toString("dd/MM/yyyy HH:mm:ss");
+    return changes.isEmpty() ? time : time + "  —  " + changes.join(", ");
+}
+
+// Rebuilding a revision reads the history file, so it runs on the I/O
+// thread; moving on to another row cancels a read not yet started.
+void HistoryDialog::on_listWidget_currentRowChanged(int row) {
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
+    preview.cancel();
+    if (row < 0)
+        return;
+    int revision = history->revisions().size() - 1 - row;
+    QSharedPointer<RecipeHistory> source = history;
+    preview = IoExecutor::instance().run<Preview>("history revision", [source, revision](IoExecutor::Job &) {
+        Preview read {false, Recipe(), QString()};
+        read.ok = source->recipeAt(revision, &read.recipe);
+        if (!read.ok)
+            read.error = source->errorString();
+        return read;
+    });
+    IoExecutor::then<Preview>(preview, this, [this](const Preview &read) {
+        ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(read.ok);
+        if (!read.ok) {
+            ui->preview->setPlainText(read.error);
+            return;
+        }
+        selected = read.recipe;
+        ui->preview->setHtml(selected.toHtml(title));
+    });
+}
@@ -0,0 +1,38 @@
+#ifndef HISTORYDIALOG_H
+#define HISTORYDIALOG_H
+
+#include "recipehistory.h"
+#include <QDialog>
+#include <QFuture>
+#include <QSharedPointer>
+
+namespace Ui { class HistoryDialog; }
+
+class HistoryDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit HistoryDialog(const QSharedPointer<RecipeHistory> &history, QWidget *parent = nullptr);
+    ~HistoryDialog();
+    bool isEmpty() const { return history->revisions().isEmpty(); }
+    Recipe selectedRecipe() const { return selected; }
+
+private slots:
+    void on_listWidget_currentRowChanged(int row);
+
+private:
+    struct Preview {
+        bool ok;
+        Recipe recipe;
+        QString error;
+    };
+
+    QString describe(const RecipeHistory::Revision &revision) const;
+    Ui::HistoryDialog *ui;
+    QSharedPointer<RecipeHistory> history;  // shared with the revision reads
+    QFuture<Preview> preview;
+    Recipe selected;
+    QString title;
+};
+
+#endif // HISTORYDIALOG_H
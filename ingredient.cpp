@@ -18,53 +18,6 @@
 
 #include "ingredient.h"
 
-class IngredientData : public QSharedData {
-public:
-    IngredientData() {}
-    IngredientData(const IngredientData &other)
-        : QSharedData(other), name(other.name), calories(other.calories) {}
-    ~IngredientData() {}
-
-    QString name;
-    int calories;
-};
-
-Ingredient::Ingredient() : d(new IngredientData) {
-    d->name = QString("");
-    d->calories = 0;
-}
-
-Ingredient::Ingredient(const QString &name, int calories) : d(new IngredientData) {
-    d->name = name;
-    d->calories = calories;
-}
-
-Ingredient::Ingredient(const Ingredient &rhs) : d(rhs.d) {}
-
-Ingredient &Ingredient::operator=(const Ingredient &rhs) {
-    if (this != &rhs)
-        d.operator=(rhs.d);
-    return *this;
-}
-
-Ingredient::~Ingredient() {}
-
-void Ingredient::setName(const QString &name) {
-    d->name = name;
-}
-
-void Ingredient::setCalories(int calories) {
-    d->calories = calories;
-}
-
-QString Ingredient::name() const {
-    return d->name;
-}
-
-int Ingredient::calories() const {
-    return d->calories;
-}
-
 QDebug operator<<(QDebug debug, const Ingredient &ingr) {
     QDebugStateSaver saver(debug);
     debug.noquote() << "Ingredient(" << ingr.name() << ", " << ingr.calories() << ")";
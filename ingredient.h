@@ -1,36 +1,37 @@
 #ifndef INGREDIENT_H
 #define INGREDIENT_H
 
+#include "catalog.h"
 #include <QDebug>
 #include <QList>
-#include <QSharedDataPointer>
-
-class IngredientData;
 
+// An ingredient is a catalog name id plus its calories per 100g; copies are
+// two integers and the name text is shared through Catalog.
 class Ingredient {
 public:
-    Ingredient();
-    Ingredient(const QString &name, int calories);
-    Ingredient(const Ingredient&);
-    Ingredient &operator=(const Ingredient&);
-    ~Ingredient();
+    Ingredient() {}
+    Ingredient(const QString &name, int calories) : _name(Catalog::intern(name)), _calories(calories) {}
 
-    void setName(const QString &name);
-    void setCalories(int calories);
+    void setName(const QString &name) { _name = Catalog::intern(name); }
+    void setCalories(int calories) { _calories = calories; }
 
-    QString name() const;
-    int calories() const;
+    QString name() const { return Catalog::name(_name); }
+    quint32 nameId() const { return _name; }
+    int calories() const { return _calories; }
 
 private:
-    QSharedDataPointer<IngredientData> d;
+    quint32 _name {0};
+    qint32 _calories {0};
 };
 
 inline bool operator==(const Ingredient &lhs, const Ingredient &rhs) {
-    return lhs.name().toLower() == rhs.name().toLower() && lhs.calories() == rhs.calories();
+    return lhs.calories() == rhs.calories() &&
+            (lhs.nameId() == rhs.nameId() || Catalog::key(lhs.nameId()) == Catalog::key(rhs.nameId()));
 }
 
+// catalog (Greek collation) order of the names
 inline bool operator<(const Ingredient &lhs, const Ingredient &rhs) {
-    return lhs.name() < rhs.name();
+    return Catalog::compareNames(lhs.nameId(), rhs.nameId()) < 0;
 }
 
 inline QList<Ingredient> operator-(const QList<Ingredient> &lhs, const QList<Ingredient> &rhs) {
@@ -42,6 +43,6 @@ inline QList<Ingredient> operator-(const QList<Ingredient> &lhs, const QList<Ing
 }
 
 QDebug operator<<(QDebug debug, const Ingredient &ingr);
-Q_DECLARE_TYPEINFO(Ingredient, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(Ingredient, Q_PRIMITIVE_TYPE);
 
 #endif // INGREDIENT_H
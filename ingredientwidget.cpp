@@ -31,7 +31,13 @@ IngredientWidget::IngredientWidget(const Ingredient& ingr, QWidget *parent) :
     ui->lineEditName->setText(_ingredient.name());
     ui->lineEditCalories->setText(QString::number(_ingredient.calories()));
 
-    connect(ui->lineEditName,     &QLineEdit::textEdited, this, &IngredientWidget::setIngredientName);
+    // names enter the shared pool only once typed in full, not on every keystroke
+    connect(ui->lineEditName,     &QLineEdit::textEdited, this, [this](const QString &name) {
+        _pendingName = name;
+        _namePending = true;
+        emit nameEdited();
+    });
+    connect(ui->lineEditName,     &QLineEdit::editingFinished, this, &IngredientWidget::commitName);
     connect(ui->lineEditCalories, &QLineEdit::textEdited, this, &IngredientWidget::setIngredientCalories);
 }
 
@@ -43,8 +49,13 @@ void IngredientWidget::setCaloriesValidator(const QValidator *validator) {
 
 Ingredient IngredientWidget::ingredient() const { return _ingredient; }
 
-void IngredientWidget::setIngredientName(const QString &name) {
-    _ingredient.setName(name);
+// Applies a name still being typed; called when the field is left and
+// before the editor's ingredients are read.
+void IngredientWidget::commitName() {
+    if (!_namePending)
+        return;
+    _namePending = false;
+    _ingredient.setName(_pendingName);
     emit ingredientChanged(_ingredient);
 }
 
@@ -53,10 +64,18 @@ void IngredientWidget::setIngredientCalories(const QString &calories) {
     emit ingredientChanged(_ingredient);
 }
 
-void IngredientWidget::setIngredient(const Ingredient &ingr) { _ingredient = ingr; }
+void IngredientWidget::setIngredient(const Ingredient &ingr) {
+    _ingredient = ingr;
+    _namePending = false;
+    setText(ingr);
+}
 
 bool IngredientWidget::isSelected() const { return ui->checkBoxSelect->isChecked(); }
 
+void IngredientWidget::setSelected(bool selected) {
+    ui->checkBoxSelect->setChecked(selected);
+}
+
 void IngredientWidget::setFocus() {
     ui->lineEditName->setFocus();
 }
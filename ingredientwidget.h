@@ -19,22 +19,28 @@ public:
     Ingredient ingredient() const;
     void setIngredient(const Ingredient &ingr);
     bool isSelected() const;
+    void setSelected(bool selected);
     void setFocus();
     void setHeaderVisible(bool visible);
+    void commitName();
+    bool isNamePending() const { return _namePending; }
+    QString pendingName() const { return _pendingName; }
 
 signals:
     void ingredientChanged(const Ingredient &ingr);
+    void nameEdited();
     void stateChanged();
 
 private slots:
     void on_checkBoxSelect_stateChanged(int arg1);
     void setText(const Ingredient& ingr);
-    void setIngredientName(const QString &name);
     void setIngredientCalories(const QString &calories);
 
 private:
     Ui::IngredientWidget *ui;
     Ingredient _ingredient;
+    QString _pendingName {};
+    bool _namePending { false };
 };
 
 #endif // INGREDIENTWIDGET_H
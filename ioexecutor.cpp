@@ -0,0 +1,43 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ioexecutor.h"
+
+IoExecutor::IoExecutor() {
+    pool.setMaxThreadCount(1);
+    pool.setExpiryTimeout(-1);
+}
+
+IoExecutor &IoExecutor::instance() {
+    static IoExecutor executor;
+    return executor;
+}
+
+void IoExecutor::submitted() {
+    Diagnostics::ioStarted();
+    if (queued.fetchAndAddOrdered(1) == 0)
+        emit busyChanged(true);
+}
+
+// Called on the I/O thread; receivers on the GUI thread get the signal
+// queued.
+void IoExecutor::finished() {
+    Diagnostics::ioFinished();
+    if (queued.fetchAndAddOrdered(-1) == 1)
+        emit busyChanged(false);
+}
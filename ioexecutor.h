@@ -0,0 +1,109 @@
+#ifndef IOEXECUTOR_H
+#define IOEXECUTOR_H
+
+#include "diagnostics.h"
+#include <QAtomicInt>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <functional>
+
+/* One thread of its own for file operations: opening and saving recipes,
+ * reading and rewriting the personal catalog, packing archives. A slow
+ * disk or network home directory then delays a result instead of freezing
+ * the window. Jobs run one at a time in the order they were submitted, so
+ * a save is on disk before a later read of the same file. run() hands back
+ * a QFuture that can be watched and canceled; then() delivers its result
+ * on the caller's thread through the watcher's queued signals. */
+class IoExecutor : public QObject {
+    Q_OBJECT
+
+public:
+    // What a job sees of its future: progress reporting and cancellation.
+    class Job {
+    public:
+        explicit Job(QFutureInterfaceBase *future) : future(future) {}
+        bool isCanceled() const { return future->isCanceled(); }
+        void setProgressRange(int minimum, int maximum) { future->setProgressRange(minimum, maximum); }
+        void setProgress(int value) { future->setProgressValue(value); }
+
+    private:
+        QFutureInterfaceBase *future;
+    };
+
+    static IoExecutor &instance();
+    bool isBusy() const { return queued.loadAcquire() > 0; }
+    void waitForDone() { pool.waitForDone(); }
+
+    template <typename T>
+    QFuture<T> run(const char *operation, const std::function<T(Job &)> &work);
+
+    // done is skipped when the future was canceled or context is gone
+    template <typename T>
+    static void then(const QFuture<T> &future, QObject *context, const std::function<void(const T &)> &done);
+
+signals:
+    void busyChanged(bool busy);
+
+private:
+    template <typename T> class Runner;
+
+    IoExecutor();
+    void submitted();
+    void finished();
+
+    QThreadPool pool;
+    QAtomicInt queued;
+};
+
+template <typename T>
+class IoExecutor::Runner : public QRunnable {
+public:
+    Runner(const char *operation, const std::function<T(Job &)> &work) : operation(operation), work(work) {
+        future.reportStarted();
+    }
+
+    void run() override {
+        if (!future.isCanceled()) {
+            Diagnostics::ScopedTimer timer(operation);
+            Job job(&future);
+            T result = work(job);
+            if (!future.isCanceled())
+                future.reportResult(result);
+        }
+        future.reportFinished();
+        IoExecutor::instance().finished();
+    }
+
+    QFutureInterface<T> future;
+
+private:
+    const char *operation;
+    std::function<T(Job &)> work;
+};
+
+template <typename T>
+QFuture<T> IoExecutor::run(const char *operation, const std::function<T(Job &)> &work) {
+    auto runner = new Runner<T>(operation, work);
+    QFuture<T> future = runner->future.future();
+    submitted();
+    pool.start(runner);
+    return future;
+}
+
+template <typename T>
+void IoExecutor::then(const QFuture<T> &future, QObject *context, const std::function<void(const T &)> &done) {
+    auto watcher = new QFutureWatcher<T>(context);
+    QObject::connect(watcher, &QFutureWatcherBase::finished, context, [watcher, done]() {
+        QFuture<T> result = watcher->future();
+        watcher->deleteLater();
+        if (!result.isCanceled() && result.resultCount() > 0)
+            done(result.result());
+    });
+    watcher->setFuture(future);
+}
+
+#endif // IOEXECUTOR_H
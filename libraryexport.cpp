@@ -0,0 +1,264 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libraryexport.h"
+#include "catalog.h"
+#include "recipe.h"
+#include "recipearchive.h"
+#include "recipegraph.h"
+#include "units.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSettings>
+#include <QSharedPointer>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtConcurrent>
+
+/* Recipes are read and serialized by the thread pool a window at a time;
+ * QtConcurrent::mapped keeps the results in input order. While the GUI
+ * thread writes one window out, the next one is already being produced,
+ * so memory stays bounded by two windows plus the output buffer whatever
+ * the size of the library. */
+
+namespace {
+    const int WindowPerThread = 64;
+    const int FlushSize = 1 << 20;  // bytes buffered before each write
+    const char CsvHeader[] = "record,recipe,ingredient,kcal,mass,grams,instructions\n";
+
+    typedef QHash<QString, QSharedPointer<RecipeArchive>> Archives;
+
+    QByteArray csvField(const QString &text) {
+        static const QRegularExpression special("[,\"\\r\\n]");
+        if (!text.contains(special))
+            return text.toUtf8();
+        return '"' + QString(text).replace('"', "\"\"").toUtf8() + '"';
+    }
+
+    QByteArray csvRow(const QStringList &fields) {
+        QByteArray row;
+        for (int i = 0; i < fields.count(); i++) {
+            if (i)
+                row += ',';
+            row += csvField(fields.at(i));
+        }
+        return row + '\n';
+    }
+
+    QByteArray jsonLine(const QJsonObject &object) {
+        return QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+    }
+
+    QByteArray ingredientRecord(const Ingredient &ingredient, LibraryExport::Format format) {
+        if (format == LibraryExport::Csv)
+            return csvRow(QStringList() << "ingredient" << QString() << ingredient.name()
+                                        << QString::number(ingredient.calories()) << QString() << QString() << QString());
+        QJsonObject object;
+        object["type"] = "ingredient";
+        object["name"] = ingredient.name();
+        object["kcal"] = ingredient.calories();
+        return jsonLine(object);
+    }
+
+    QByteArray recipeRecord(const QString &name, const Recipe &recipe, LibraryExport::Format format) {
+        if (format == LibraryExport::Csv) {
+            QByteArray rows = csvRow(QStringList() << "recipe" << name << QString()
+                                                   << QString::number(qRound(recipe.totalCalories())) << QString()
+                                                   << QString::number(recipe.totalMass()) << recipe.instructions);
+            for (auto &&item : recipe.items)
+                rows += csvRow(QStringList() << "item" << name << item.ingredient.name()
+                                             << QString::number(item.ingredient.calories()) << item.mass
+                                             << QString::number(Units::grams(item.mass, item.ingredient)) << QString());
+            return rows;
+        }
+        QJsonArray items;
+        for (auto &&item : recipe.items) {
+            QJsonObject object;
+            object["name"] = item.ingredient.name();
+            object["kcal"] = item.ingredient.calories();
+            object["mass"] = item.mass;
+            object["grams"] = Units::grams(item.mass, item.ingredient);
+            items.append(object);
+        }
+        QJsonObject object;
+        object["type"] = "recipe";
+        object["name"] = name;
+        object["kcal"] = qRound(recipe.totalCalories());
+        object["grams"] = recipe.totalMass();
+        object["ingredients"] = items;
+        object["instructions"] = recipe.instructions;
+        return jsonLine(object);
+    }
+
+    // Runs on pool threads. The archives are opened beforehand and only
+    // read here, which RecipeArchive allows concurrently.
+    struct RecipeSerializer {
+        typedef QByteArray result_type;
+        QDir library;
+        const Archives *archives;
+        LibraryExport::Format format;
+        QByteArray operator()(const QString &location) const {
+            Recipe recipe;
+            QString archiveName, name;
+            if (RecipeArchive::splitLocation(location, &archiveName, &name)) {
+                const QSharedPointer<RecipeArchive> archive = archives->value(archiveName);
+                if (!archive || !archive->read(name, &recipe))
+                    return QByteArray();
+                name = RecipeArchive::location(library.relativeFilePath(archiveName), name);
+            } else {
+                if (!recipe.read(location))
+                    return QByteArray();
+                name = library.relativeFilePath(location);
+                name.chop(4);  // ".rcp"
+            }
+            RecipeGraph::instance().update(&recipe, location);
+            return recipeRecord(name, recipe, format);
+        }
+    };
+}
+
+LibraryExport::LibraryExport(QObject *parent) : QObject(parent) {}
+
+LibraryExport::Format LibraryExport::formatFor(const QString &fileName) {
+    return QFileInfo(fileName).suffix().compare("csv", Qt::CaseInsensitive) == 0 ? Csv : JsonLines;
+}
+
+QString LibraryExport::defaultLibraryPath() {
+    QSettings settings;
+    return settings.value("libraryPath",
+                          QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)).toString();
+}
+
+void LibraryExport::cancel() {
+    canceled = true;
+    if (watcher)
+        watcher->cancel();
+}
+
+bool LibraryExport::checkCanceled() {
+    if (!canceled && cancelCheck && cancelCheck())
+        cancel();
+    return canceled;
+}
+
+// Same nested event loop as Cookbook::wait, so a progress dialog can
+// cancel the export.
+QList<QByteArray> LibraryExport::wait(const QFuture<QByteArray> &future, int progressOffset) {
+    QFutureWatcher<QByteArray> futureWatcher;
+    QEventLoop loop;
+    connect(&futureWatcher, &QFutureWatcher<QByteArray>::finished, &loop, &QEventLoop::quit);
+    connect(&futureWatcher, &QFutureWatcher<QByteArray>::progressValueChanged, this, [=](int value) {
+        emit progressValueChanged(progressOffset + value);
+        checkCanceled();
+    });
+    watcher = &futureWatcher;
+    futureWatcher.setFuture(future);
+    if (!future.isFinished())
+        loop.exec();
+    watcher = nullptr;
+    return future.results();
+}
+
+bool LibraryExport::write(const QString &libraryPath, const QString &fileName, Format format) {
+    canceled = false;
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        _errorString = tr("Σφάλμα δημιουργίας του αρχείου %1").arg(fileName);
+        return false;
+    }
+
+    QStringList locations;
+    Archives archives;
+    QDir library(libraryPath);
+    if (!libraryPath.isEmpty() && library.exists()) {
+        QStringList files;
+        QDirIterator it(libraryPath, QStringList() << "*.rcp" << "*." + RecipeArchive::suffix,
+                        QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            files.append(it.next());
+        files.sort();  // the same library always gives the same extract
+        for (auto &&path : files) {
+            if (!RecipeArchive::isArchive(path)) {
+                locations.append(path);
+                continue;
+            }
+            QSharedPointer<RecipeArchive> archive(new RecipeArchive(path));
+            if (!archive->open())
+                continue;
+            archives.insert(path, archive);
+            for (auto &&name : archive->names())
+                locations.append(RecipeArchive::location(path, name));
+        }
+    }
+
+    QByteArray buffer;
+    bool ok = true;
+    auto append = [&](const QByteArray &data) {
+        buffer += data;
+        if (buffer.size() >= FlushSize) {
+            ok = ok && file.write(buffer) == buffer.size();
+            buffer.clear();
+        }
+    };
+
+    emit progressRangeChanged(0, locations.count());
+    if (format == Csv)
+        append(CsvHeader);
+    for (auto &&line : Catalog::entryLines()) {
+        Ingredient ingredient;
+        if (Catalog::parseLine(line, &ingredient))
+            append(ingredientRecord(ingredient, format));
+    }
+
+    int window = qMax(1, QThread::idealThreadCount() * WindowPerThread);
+    RecipeSerializer serializer {library, &archives, format};
+    QFuture<QByteArray> next;
+    if (!locations.isEmpty())
+        next = QtConcurrent::mapped(locations.mid(0, window), serializer);
+    for (int first = 0; first < locations.count() && !checkCanceled() && ok; first += window) {
+        QList<QByteArray> records = wait(next, first);
+        if (!canceled && first + window < locations.count())
+            next = QtConcurrent::mapped(locations.mid(first + window, window), serializer);
+        for (auto &&record : records)
+            append(record);
+    }
+    next.waitForFinished();  // archives must outlive the workers
+
+    if (!buffer.isEmpty())
+        ok = ok && file.write(buffer) == buffer.size();
+    if (canceled) {
+        file.cancelWriting();
+        _errorString = tr("Η εξαγωγή ακυρώθηκε");
+        return false;
+    }
+    if (!ok || !file.commit()) {
+        _errorString = tr("Σφάλμα εγγραφής του αρχείου %1").arg(fileName);
+        return false;
+    }
+    emit progressValueChanged(locations.count());
+    return true;
+}
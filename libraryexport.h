@@ -0,0 +1,46 @@
+#ifndef LIBRARYEXPORT_H
+#define LIBRARYEXPORT_H
+
+#include <QFuture>
+#include <QObject>
+#include <QStringList>
+#include <functional>
+
+class QFutureWatcherBase;
+
+// Writes the ingredient catalog and every recipe of the library (.rcp files
+// and the entries of .rca archives) to one line-delimited JSON or CSV file.
+// write() may run on the I/O thread; a cancel check then stands in for the
+// cancel() slot, which only works on the thread that runs write().
+class LibraryExport : public QObject {
+    Q_OBJECT
+
+public:
+    enum Format { JsonLines, Csv };
+
+    explicit LibraryExport(QObject *parent = nullptr);
+    bool write(const QString &libraryPath, const QString &fileName, Format format);
+    QString errorString() const { return _errorString; }
+    void setCancelCheck(const std::function<bool()> &check) { cancelCheck = check; }
+
+    static Format formatFor(const QString &fileName);
+    static QString defaultLibraryPath();
+
+public slots:
+    void cancel();
+
+signals:
+    void progressRangeChanged(int minimum, int maximum);
+    void progressValueChanged(int value);
+
+private:
+    QFuture<QByteArray> start(const QStringList &locations);
+    QList<QByteArray> wait(const QFuture<QByteArray> &future, int progressOffset);
+    bool checkCanceled();
+    QFutureWatcherBase *watcher { nullptr };
+    std::function<bool()> cancelCheck;
+    QString _errorString;
+    bool canceled { false };
+};
+
+#endif // LIBRARYEXPORT_H
@@ -16,17 +16,139 @@
  * NefChef. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "calcserver.h"
+#include "catalogsync.h"
 #include "global.h"
+#include "libraryexport.h"
 #include "mainwindow.h"
+#include "singleinstance.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QScopedPointer>
+
+#ifdef NEFCHEF_ALLOCTRACK
+#include "allocreport.h"
+#include <QStandardPaths>
+#endif
+
+// --serve, --export and --sync-catalog need no display, so they run without the GUI.
+static bool isHeadless(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        QByteArray arg(argv[i]);
+        if (arg == "--serve" || arg == "--export" || arg.startsWith("--export=")
+                || arg == "--sync-catalog" || arg.startsWith("--sync-catalog="))
+            return true;
+    }
+    return false;
+}
 
 int main(int argc, char *argv[]) {
-    QApplication app(argc, argv);
+    QElapsedTimer startup;
+    startup.start();
+    QScopedPointer<QCoreApplication> app(isHeadless(argc, argv) ? new QCoreApplication(argc, argv)
+                                                                : new QApplication(argc, argv));
     QApplication::setOrganizationName("DP Software");
     QApplication::setApplicationName(APPNAME);
     QApplication::setApplicationVersion(VERSION);
 
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QApplication::translate("main", "Δημιουργία συνταγών με υπολογισμό θερμίδων"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("files", QApplication::translate("main", "Συνταγές (.rcp) ή συλλογές (.rca) για άνοιγμα."),
+                                 "[files...]");
+    QCommandLineOption exportOption("export",
+                                    QApplication::translate("main", "Εξαγωγή υλικών και συνταγών της βιβλιοθήκης σε JSON Lines ή, για κατάληξη .csv, σε CSV."),
+                                    "file");
+    QCommandLineOption libraryOption("library",
+                                     QApplication::translate("main", "Φάκελος συνταγών για την εξαγωγή."),
+                                     "dir");
+    QCommandLineOption serveOption("serve",
+                                   QApplication::translate("main", "Εκτέλεση ως υπηρεσία HTTP υπολογισμού θερμίδων, χωρίς παράθυρο."));
+    QCommandLineOption portOption("port",
+                                  QApplication::translate("main", "Θύρα της υπηρεσίας (προεπιλογή 8780)."),
+                                  "port", "8780");
+    QCommandLineOption bindOption("bind",
+                                  QApplication::translate("main", "Διεύθυνση ακρόασης της υπηρεσίας (προεπιλογή 127.0.0.1)."),
+                                  "address", "127.0.0.1");
+    QCommandLineOption syncOption("sync-catalog",
+                                  QApplication::translate("main", "Συγχρονισμός της λίστας υλικών μέσω κοινόχρηστου φακέλου."),
+                                  "dir");
+    parser.addOption(exportOption);
+    parser.addOption(libraryOption);
+    parser.addOption(serveOption);
+    parser.addOption(portOption);
+    parser.addOption(bindOption);
+    parser.addOption(syncOption);
+#ifdef NEFCHEF_ALLOCTRACK
+    QCommandLineOption allocReport("alloc-report",
+                                   QApplication::translate("main", "Καταμέτρηση δεσμεύσεων μνήμης ανά λειτουργία στη συνταγή που δίνεται (ή σε δείγμα)."));
+    QCommandLineOption allocBudgets("alloc-budgets",
+                                    QApplication::translate("main", "Αρχείο με όρια «λειτουργία = δεσμεύσεις, bytes»."),
+                                    "file");
+    parser.addOption(allocReport);
+    parser.addOption(allocBudgets);
+#endif
+    parser.process(*app);
+
+    if (parser.isSet(exportOption)) {
+        QString fileName = parser.value(exportOption);
+        QString library = parser.isSet(libraryOption) ? parser.value(libraryOption)
+                                                      : LibraryExport::defaultLibraryPath();
+        LibraryExport exporter;
+        if (exporter.write(library, fileName, LibraryExport::formatFor(fileName)))
+            return 0;
+        qCritical("%s", qPrintable(exporter.errorString()));
+        return 1;
+    }
+
+    if (parser.isSet(syncOption)) {
+        CatalogSync::Report report = CatalogSync::sync(parser.value(syncOption));
+        if (!report.error.isEmpty()) {
+            qCritical("%s", qPrintable(report.error));
+            return 1;
+        }
+        qInfo("sent %d, received %d operations, %d entries changed", report.exported, report.imported, report.changed);
+        return 0;
+    }
+
+    if (parser.isSet(serveOption)) {
+        CalcServer server;
+        QHostAddress address(parser.value(bindOption));
+        quint16 port = parser.value(portOption).toUShort();
+        if (address.isNull() || !server.start(address, port)) {
+            qCritical("cannot listen on %s:%s: %s", qPrintable(parser.value(bindOption)),
+                      qPrintable(parser.value(portOption)), qPrintable(server.errorString()));
+            return 1;
+        }
+        qInfo("serving on %s:%d", qPrintable(server.serverAddress().toString()), server.serverPort());
+        return app->exec();
+    }
+
+    QStringList files;
+    for (auto &&arg : parser.positionalArguments())
+        files.append(QFileInfo(arg).absoluteFilePath());
+
+#ifdef NEFCHEF_ALLOCTRACK
+    if (parser.isSet(allocReport)) {
+        QStandardPaths::setTestModeEnabled(true);  // keep history and index writes out of the user's data
+        MainWindow mainWin;
+        mainWin.show();
+        return AllocReport::run(&mainWin, files.value(0), parser.value(allocBudgets));
+    }
+#endif
+
+    SingleInstance instance;
+    if (instance.forward(files))
+        return 0;
+    instance.listen();
+
     MainWindow mainWin;
+    mainWin.setStartupTimer(startup);
+    QObject::connect(&instance, &SingleInstance::openRequested, &mainWin, &MainWindow::openFiles);
+    mainWin.openFiles(files);  // queued; the recipe shows once read on the I/O thread
     mainWin.show();
-    return app.exec();
+    return app->exec();
 }
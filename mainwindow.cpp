@@ -19,26 +19,51 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "adaptor.h"
+#include "autosaver.h"
+#include "catalog.h"
+#include "catalogsync.h"
 #include "collectioneditorwidget.h"
 #include "combo.h"
+#include "cookbook.h"
+#include "dedupedialog.h"
+#include "diagnostics.h"
+#include "diagnosticsdock.h"
 #include "droplist.h"
 #include "global.h"
 #include "helpdialog.h"
+#include "historydialog.h"
 #include "ingredientwidget.h"
+#include "ioexecutor.h"
+#include "libraryexport.h"
 #include "masscalculatorwidget.h"
+#include "masslineedit.h"
+#include "optimizerdialog.h"
+#include "recalculation.h"
+#include "recipearchive.h"
+#include "recipegraph.h"
+#include "recipehistory.h"
+#include "searchdialog.h"
+#include "searchindex.h"
 #include "startpage.h"
+#include "units.h"
 #include <QActionGroup>
 #include <QApplication>
 #include <QCheckBox>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileDialog>
 #include <QFont>
 #include <QFontDialog>
+#include <QHash>
+#include <QInputDialog>
 #include <QLabel>
 #include <QLayout>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QPrinter>
+#include <QProgressDialog>
 #include <QPushButton>
 #include <QSaveFile>
 #include <QScreen>
@@ -49,21 +74,24 @@
 #include <QTextCodec>
 #include <QTextDocument>
 #include <QTextStream>
+#include <QTimer>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
     start(new StartPage),
-    editor(new CollectionEditorWidget),
-    calculator(new MassCalculatorWidget)
+    editor(nullptr),
+    calculator(nullptr),
+    drop(nullptr),
+    combo(nullptr),
+    diagnostics(nullptr),
+    recalculation(nullptr)
 {
     ui->setupUi(this);
 
     stackedWidget = new QStackedWidget(this);
     stackedWidget->setObjectName(QString::fromUtf8("stacked"));
     stackedWidget->addWidget(start);
-    stackedWidget->addWidget(calculator);
-    stackedWidget->addWidget(editor);
 
     QScrollArea *scrollArea  = new QScrollArea();
     scrollArea->setWidgetResizable(true);
@@ -95,6 +123,7 @@ MainWindow::MainWindow(QWidget *parent) :
 
     auto editorActions = new QActionGroup(this);
     editorActions->addAction(ui->actionAddFromList);
+    editorActions->addAction(ui->actionAddRecipe);
     editorActions->addAction(ui->actionAddIngredient);
     editorActions->addAction(ui->actionRemove);
     editorActions->addAction(ui->actionMoveUp);
@@ -106,8 +135,6 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(stackedWidget, &QStackedWidget::currentChanged, this, [=](int page) {
         editorActions->setEnabled(page == 2);
     });
-    connect(ui->actionAddIngredient, &QAction::triggered, editor, &CollectionEditorWidget::addIngredient);
-    connect(ui->actionRemove,        &QAction::triggered, editor, &CollectionEditorWidget::removeSelected);
     connect(ui->actionAddColumn,     &QAction::triggered, this,   [=]() {
         setColumnNumber(editor->columns() + 1);
     });
@@ -130,17 +157,6 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->actionToggleToolbar->setChecked(true);
     readSettings();
 
-    connect(calculator, &MassCalculatorWidget::refresh,         this, &MainWindow::refreshCalc);
-    connect(calculator, &MassCalculatorWidget::refreshMasses,   this, &MainWindow::refreshCalcMasses);
-    connect(editor,     &CollectionEditorWidget::editorChanged, this, [this]() {
-        calculator->updateDisplay();
-        updateExtendedList();
-    });
-    connect(editor,     &CollectionEditorWidget::itemAdded,     this, &MainWindow::addToCalc);
-    connect(editor,     &CollectionEditorWidget::itemClimbed,   this, &MainWindow::calcClimb);
-    connect(editor,     &CollectionEditorWidget::itemDescended, this, &MainWindow::calcDescend);
-    connect(editor,     &CollectionEditorWidget::itemRemoved,   this, &MainWindow::calcRemove);
-    connect(editor,     &CollectionEditorWidget::stateChanged,  this, &MainWindow::stateUpdates);
     connect(start,      &StartPage::create,                     this, [this]() { showDropList(); });
     connect(start,      &StartPage::help,                       this, [this]() { helpPopup(); });
     connect(start,      &StartPage::info,                       this, [this]() { infoPopup(); });
@@ -148,6 +164,32 @@ MainWindow::MainWindow(QWidget *parent) :
 
     showStart();
     selMany = false;
+
+    searchIndex = new SearchIndex(this);
+    start->setIndex(searchIndex);
+    connect(start, &StartPage::openLocation, this, [this](const QString &location) {
+        if (maybeSave())
+            openRecipe(location);
+    });
+    // shown only for file operations that take a noticeable time
+    auto ioBusy = new QLabel(tr("Εργασίες αρχείων σε εξέλιξη..."));
+    ioBusy->hide();
+    statusBar()->addPermanentWidget(ioBusy);
+    connect(&IoExecutor::instance(), &IoExecutor::busyChanged, ioBusy, [ioBusy](bool busy) {
+        if (!busy)
+            ioBusy->setVisible(IoExecutor::instance().isBusy());
+        else
+            QTimer::singleShot(500, ioBusy, [ioBusy]() { ioBusy->setVisible(IoExecutor::instance().isBusy()); });
+    });
+    catalogFlush = new QTimer(this);
+    catalogFlush->setSingleShot(true);
+    catalogFlush->setInterval(CATALOG_FLUSH_DELAY);
+    connect(catalogFlush, &QTimer::timeout, this, &MainWindow::flushCatalog);
+    autosaver = new Autosaver(this);
+    auto autosaveTimer = new QTimer(this);
+    connect(autosaveTimer, &QTimer::timeout, this, &MainWindow::autosave);
+    autosaveTimer->start(AUTOSAVE_INTERVAL);
+    QTimer::singleShot(0, this, &MainWindow::offerRecovery);
 }
 
 MainWindow::~MainWindow() {
@@ -157,27 +199,92 @@ MainWindow::~MainWindow() {
     delete ui;
 }
 
-void MainWindow::refreshCalc() {
-    auto lines = editor->findChildren<QLineEdit *>();
-    auto widgets = editor->findChildren<IngredientWidget *>();
+// The editor and calculator pages are built on first use (or by prewarm()
+// once the window is up), so the first frame only has to show the start page.
+void MainWindow::createPages() {
+    if (editor)
+        return;
+    editor = new CollectionEditorWidget;
+    calculator = new MassCalculatorWidget;
+    stackedWidget->addWidget(calculator);
+    stackedWidget->addWidget(editor);
 
-    QStringList calories;
-    QStringList masses;
+    connect(ui->actionAddIngredient, &QAction::triggered, editor, &CollectionEditorWidget::addIngredient);
+    connect(ui->actionRemove,        &QAction::triggered, editor, &CollectionEditorWidget::removeSelected);
+    connect(calculator, &MassCalculatorWidget::refresh,         this, &MainWindow::refreshCalc);
+    connect(calculator, &MassCalculatorWidget::refreshMasses,   this, &MainWindow::refreshCalcMasses);
+    connect(editor,     &CollectionEditorWidget::editorChanged, this, [this]() {
+        calculator->updateDisplay();
+        updateExtendedList();
+    });
+    connect(editor,     &CollectionEditorWidget::itemAdded,     this, &MainWindow::addToCalc);
+    connect(editor,     &CollectionEditorWidget::itemClimbed,   this, &MainWindow::calcClimb);
+    connect(editor,     &CollectionEditorWidget::itemDescended, this, &MainWindow::calcDescend);
+    connect(editor,     &CollectionEditorWidget::itemRemoved,   this, &MainWindow::calcRemove);
+    connect(editor,     &CollectionEditorWidget::stateChanged,  this, &MainWindow::stateUpdates);
+}
+
+DropList *MainWindow::dropList() {
+    if (!drop)
+        drop = new DropList(this);
+    return drop;
+}
+
+Combo *MainWindow::comboDialog() {
+    if (!combo)
+        combo = new Combo(this);
+    return combo;
+}
+
+// Builds what the first frame did not need, one piece per idle slot so
+// the window stays responsive while it happens.
+void MainWindow::prewarm() {
+    if (!editor)
+        createPages();
+    else if (!drop)
+        dropList();
+    else if (!combo)
+        comboDialog();
+    else
+        return;
+    QTimer::singleShot(PREWARM_DELAY, this, &MainWindow::prewarm);
+}
+
+void MainWindow::setStartupTimer(const QElapsedTimer &timer) {
+    startup = timer;
+}
+
+bool MainWindow::event(QEvent *event) {
+    if (event->type() != QEvent::UpdateRequest)
+        return QMainWindow::event(event);
+    QElapsedTimer frame;
+    frame.start();
+    bool result = QMainWindow::event(event);
+    Diagnostics::recordFrame(frame.nsecsElapsed() / 1000);
+    if (!firstFrame) {
+        firstFrame = true;
+        if (startup.isValid())
+            qInfo("%s: first frame after %lld ms", qPrintable(APPNAME), startup.elapsed());
+        QTimer::singleShot(PREWARM_DELAY, this, &MainWindow::prewarm);
+    }
+    return result;
+}
+
+void MainWindow::refreshCalc() {
+    editor->commitEdits();
+    const auto &ingredients = editor->_tmpIngredients;
+    QStringList masses = calculator->masses();
     QStringList names;
-    QStringList updNames;
 
-    for (int i = 1; i < lines.count(); i+=2)
-        calories.append(lines.at(i)->text());
-    for (auto &&line : calculator->findChildren<QLineEdit *>())
-        masses.append(line->text());
-    for (auto &&widget : widgets)
-        names.append(widget->ingredient().name());
+    for (auto &&ingr : ingredients)
+        names.append(ingr.name());
 
     int masssum {0};
     float kcalsum {0};
-    for (int j = 0; j < masses.count(); j++) {
-        masssum += masses.at(j).toInt();
-        kcalsum += calories.at(j).toInt() * masses.at(j).toInt() / 100.0;
+    for (int j = 0; j < masses.count() && j < ingredients.count(); j++) {
+        int mass = Units::grams(masses.at(j), ingredients.at(j));
+        masssum += mass;
+        kcalsum += ingredients.at(j).calories() * mass / 100.0;
     }
 
     float percentsum {0};
@@ -187,24 +294,19 @@ void MainWindow::refreshCalc() {
     calculator->doRefresh(kcalsum, masssum, percentsum, names);
 }
 
-void MainWindow::refreshCalcMasses(QStringList lastMasses) {
-    auto lines = editor->findChildren<QLineEdit *>();
-    auto widgets = editor->findChildren<IngredientWidget *>();
-
-    QStringList calories;
+void MainWindow::refreshCalcMasses(const QStringList &lastMasses) {
+    const auto &ingredients = editor->_tmpIngredients;
     QStringList names;
-    QStringList updNames;
 
-    for (int i = 1; i < lines.count(); i+=2)
-        calories.append(lines.at(i)->text());
-    for (auto &&widget : widgets)
-        names.append(widget->ingredient().name());
+    for (auto &&ingr : ingredients)
+        names.append(ingr.name());
 
     int masssum {0};
     float kcalsum {0};
-    for (int j = 0; j < lastMasses.count(); j++) {
-        masssum += lastMasses.at(j).toInt();
-        kcalsum += calories.at(j).toInt() * lastMasses.at(j).toInt() / 100.0;
+    for (int j = 0; j < lastMasses.count() && j < ingredients.count(); j++) {
+        int mass = Units::grams(lastMasses.at(j), ingredients.at(j));
+        masssum += mass;
+        kcalsum += ingredients.at(j).calories() * mass / 100.0;
     }
 
     float percentsum {0};
@@ -214,24 +316,83 @@ void MainWindow::refreshCalcMasses(QStringList lastMasses) {
     calculator->doRefreshMasses(kcalsum, masssum, percentsum, names, lastMasses);
 }
 
+Recipe MainWindow::currentRecipe() const {
+    Recipe recipe;
+    if (!editor)
+        return recipe;
+    QStringList masses = calculator->masses();
+    const auto &ingredients = editor->_tmpIngredients;
+    for (int i = 0; i < ingredients.count(); i++) {
+        Recipe::Item item;
+        item.ingredient = ingredients.at(i);
+        item.mass = masses.value(i);
+        recipe.items.append(item);
+    }
+    recipe.instructions = calculator->instruct->toPlainText();
+    return recipe;
+}
+
+void MainWindow::autosave() {
+    if (!editor)
+        return;
+    if (!editor->isModified() && !calculator->isModified())
+        return;
+    if (editor->_tmpIngredients.isEmpty())
+        return;
+    // names still being typed go into the snapshot without being committed
+    autosaver->snapshot(currentRecipe(), currentFile, editor->pendingNames());
+}
+
+void MainWindow::offerRecovery() {
+    for (auto &&session : Autosaver::crashedSessions()) {
+        QString origin;
+        QString snapshot = Autosaver::latestSnapshot(session, &origin);
+        if (snapshot.isEmpty()) {
+            Autosaver::removeSession(session);
+            continue;
+        }
+        bool named = !origin.isEmpty() && !origin.startsWith(':');
+        QMessageBox box(QMessageBox::Warning, QApplication::applicationName(),
+                        tr("Το πρόγραμμα δεν τερματίστηκε κανονικά την προηγούμενη φορά.\n"
+                           "Θέλετε να ανακτήσετε τη συνταγή «%1» από το τελευταίο αντίγραφο ασφαλείας;\n")
+                        .arg(named ? QFileInfo(origin).fileName() : tr("Προσωρινό Αρχείο")),
+                        QMessageBox::Yes | QMessageBox::No,
+                        this);
+        box.setButtonText(QMessageBox::Yes, tr("Ανάκτηση"));
+        box.setButtonText(QMessageBox::No, tr("Απόρριψη"));
+        if (box.exec() == QMessageBox::Yes) {
+            openRecipe(snapshot, [this, session, named, origin](bool ok) {
+                Autosaver::removeSession(session);
+                if (!ok)
+                    return;
+                currentFile = named ? origin : ":/temp.rcp";
+                setWindowTitle(QString("%1 - %2 %3").arg(QApplication::applicationName(),
+                               named ? QFileInfo(origin).fileName() : tr("[Προσωρινό Αρχείο]"),
+                               tr("[Ανακτημένο]")));
+                editor->setModified(true);
+                calculator->setModified(true);
+            });
+            return;
+        }
+        Autosaver::removeSession(session);
+    }
+}
+
 void MainWindow::on_actionSelectMany_toggled(bool arg1) {
     selMany = arg1;
 }
 
 void MainWindow::stateUpdates(int boxNum) {
     if (!selMany) {
-        auto boxes = editor->findChildren<QCheckBox *>();
-        for (int i = 0; i < boxes.count(); i++)
+        auto widgets = editor->widgets();
+        for (int i = 0; i < widgets.count(); i++)
             if (i != boxNum)
-                boxes.at(i)->setCheckState(Qt::CheckState::Unchecked);
+                widgets.at(i)->setSelected(false);
     }
 }
 
-void MainWindow::calcRemove(QList<int> selections) {
-    QList<QLineEdit *> lines = calculator->findChildren<QLineEdit *>();
-    QStringList masses;
-    for (auto &&line : lines)
-        masses.append(line->text());
+void MainWindow::calcRemove(const QList<int> &selections) {
+    QStringList masses = calculator->masses();
     if (selections.count() == 0)
         statusBar()->showMessage(tr("Για αφαίρεση όλων των στοιχείων δημιουργήστε νέα συνταγή"));
     else
@@ -241,7 +402,7 @@ void MainWindow::calcRemove(QList<int> selections) {
     calculator->calculation();
 }
 
-void MainWindow::addToCalc(QString name) {
+void MainWindow::addToCalc(const QString &name) {
     calculator->addIngr(name);
     calculator->calculation();
     updateExtendedList();
@@ -249,10 +410,7 @@ void MainWindow::addToCalc(QString name) {
 
 void MainWindow::calcClimb(int i) {
     if (i != -1) {
-        QList<QLineEdit *> lines = calculator->findChildren<QLineEdit *>();
-        QStringList masses;
-        for (auto &&line : lines)
-            masses.append(line->text());
+        QStringList masses = calculator->masses();
         #if QT_VERSION >= 0x050E02
             masses.swapItemsAt(i, i-1);
         #else
@@ -267,10 +425,7 @@ void MainWindow::calcClimb(int i) {
 
 void MainWindow::calcDescend(int i) {
     if (i >= 0) {
-        QList<QLineEdit *> lines = calculator->findChildren<QLineEdit *>();
-        QStringList masses;
-        for (auto &&line : lines)
-            masses.append(line->text());
+        QStringList masses = calculator->masses();
         #if QT_VERSION >= 0x050E02
             masses.swapItemsAt(i, i+1);
         #else
@@ -287,10 +442,22 @@ void MainWindow::on_actionToggleToolbar_toggled(bool arg1) {
     ui->toolBar->setVisible(arg1);
 }
 
+void MainWindow::on_actionDiagnostics_toggled(bool arg1) {
+    if (!diagnostics) {
+        if (!arg1)
+            return;
+        diagnostics = new DiagnosticsDock(stackedWidget, this);
+        diagnostics->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetFloatable);
+        addDockWidget(Qt::RightDockWidgetArea, diagnostics);
+    }
+    diagnostics->setVisible(arg1);
+}
+
 void MainWindow::setColumnNumber(int columns) {
+    createPages();
     editor->setColumns(columns);
-    editor->updateDisplay();
-    calculator->updateDisplay();
+    editor->relayout();
+    calculator->relayout();
 }
 
 void MainWindow::selectFont() {
@@ -303,6 +470,7 @@ void MainWindow::showStart() {
 }
 
 void MainWindow::showCalculator() {
+    createPages();
     if (editor->isModified()) {
         QMessageBox box(QMessageBox::Warning,QApplication::applicationName(),
                         tr("Θέλετε να ενημερώσετε την τρέχουσα συνταγή με τις τελευταίες αλλαγές;\n"),
@@ -326,11 +494,13 @@ void MainWindow::showCalculator() {
 }
 
 void MainWindow::showEditor() {
+    createPages();
     stackedWidget->setCurrentWidget(editor);
     ui->actionAdaptor->setEnabled(true);
 }
 
 void MainWindow::showDropList() {
+    createPages();
     if (editor->isModified() || calculator->isModified()) {
         QMessageBox box(QMessageBox::Warning,QApplication::applicationName(),
                         tr("Υπάρχουν αλλαγές που δεν αποθηκεύτηκαν.\n"),
@@ -352,13 +522,16 @@ void MainWindow::showDropList() {
         }
     }
 
-    DropList drop(this);
-    int ret = drop.exec();
+    DropList *drop = dropList();
+    flushCatalog();  // the list shows what was just added
+    drop->reset();
+    int ret = drop->exec();
     if (ret == QDialog::Rejected)
         return;
-    if (Ingredients::loadList(drop.selectedItems())) {
+    if (Ingredients::loadList(drop->selectedItems())) {
         editor->_tmpIngredients = Ingredients::ingredients;
-        setColumnNumber(editor->columnsHint());
+        editor->setColumns(editor->columnsHint());
+        editor->updateDisplay();
         setWindowTitle(QString("%1 - %2").arg(QApplication::applicationName(),
                        tr("[Προσωρινό Αρχείο]")));
         currentFile = ":/temp.rcp";
@@ -372,85 +545,116 @@ void MainWindow::showDropList() {
 }
 
 void MainWindow::on_actionAddFromList_triggered() {
-    Combo combo(this);
-    int ret = combo.exec();
+    createPages();
+    Combo *combo = comboDialog();
+    flushCatalog();  // the list shows what was just added
+    combo->reset();
+    int ret = combo->exec();
     if (ret == QDialog::Rejected) {
-        auto widgets = editor->findChildren<QLineEdit *>();
-        if (widgets.isEmpty())
+        if (editor->widgets().isEmpty())
             return;
     }
-    editor->addNew(combo.getNewIng());
+    editor->addNew(combo->getNewIng());
     editor->setModified(true);
 }
 
-void MainWindow::updateExtendedList() {
-    QList<Ingredient> newIngr =  editor->_tmpIngredients - Ingredients::ingredients;
+void MainWindow::on_actionAddRecipe_triggered() {
+    createPages();
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Επιλογή συνταγής"), writeableDir(),
+                                                    QString("Recipies (*.rcp);;Recipe archives (*.rca)"));
+    if (fileName.isEmpty())
+        return;
+    if (RecipeArchive::isArchive(fileName))
+        chooseFromArchive(fileName, [this](const QString &location) { addRecipe(location); });
+    else
+        addRecipe(fileName);
+}
 
-    QDir dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    if (!dataDir.exists())
-        dataDir.mkpath(".");
+// The chosen recipe and the ones it uses are evaluated on the I/O thread;
+// a recipe that already uses the current one is refused.
+void MainWindow::addRecipe(const QString &location) {
+    typedef QPair<double, QString> Evaluation;  // kcal per 100g, or an error
+    bool saved = !currentFile.isEmpty() && !currentFile.startsWith(':');
+    QString current = QDir::cleanPath(currentFile);
+    auto evaluate = [location, saved, current](IoExecutor::Job &) -> Evaluation {
+        RecipeGraph &graph = RecipeGraph::instance();
+        double kcal;
+        if (!graph.evaluate(location, &kcal))
+            return qMakePair(0.0, graph.errorString());
+        if (saved && (QDir::cleanPath(location) == current || graph.uses(location, current)))
+            return qMakePair(0.0, tr("Η συνταγή %1 χρησιμοποιεί ήδη την τρέχουσα· η προσθήκη θα δημιουργούσε κυκλική αναφορά")
+                                  .arg(QFileInfo(location).fileName()));
+        return qMakePair(kcal, QString());
+    };
+    QFuture<Evaluation> evaluated = IoExecutor::instance().run<Evaluation>("evaluate recipe", evaluate);
+    IoExecutor::then<Evaluation>(evaluated, this, [this, location, saved](const Evaluation &kcal) {
+        if (!kcal.second.isEmpty()) {
+            statusBar()->showMessage(kcal.second, 5000);
+            return;
+        }
+        editor->addNew(Ingredient(saved ? RecipeGraph::reference(location, currentFile) : '@' + QDir::cleanPath(location),
+                                  qRound(kcal.first)));
+        editor->setModified(true);
+    });
+}
 
-    QFile comb(":/combined.cal");
-    if (!comb.open(QIODevice::ReadOnly | QIODevice::Text))
+// New ingredients of the recipe are gathered for a while and then written
+// to extended.cal in one go, so the catalog lock shared with other
+// instances is taken once per batch rather than once per edit.
+void MainWindow::updateExtendedList() {
+    if (!editor)
         return;
+    editor->commitEdits();
+    bool added = false;
+    for (auto &&ingredient : editor->_tmpIngredients - Ingredients::ingredients)
+        if (!RecipeGraph::isReference(ingredient.name()) && !pendingEntries.contains(ingredient)) {
+            pendingEntries.append(ingredient);
+            added = true;
+        }
+    if (added)
+        catalogFlush->start();
+}
 
-    QTextStream in(&comb);
-    in.setCodec(QTextCodec::codecForName("UTF-8"));
-    QList<Ingredient> combIngr;
-    while (!in.atEnd()) {
-        QString line = in.readLine();
-        QStringList pair = line.split(" = ");
-        QString name = pair.first();
-        int calories = pair.last().toInt();
-        Ingredient ingr;
-        ingr.setName(name);
-        ingr.setCalories(calories);
-        combIngr.append(ingr);
-    }
-    comb.close();
-
-    QFile ext(dataDir.path() + "/extended.cal");
-    if (!ext.open(QIODevice::ReadOnly | QIODevice::Text))
-        if (!ext.open(QIODevice::Append | QIODevice::Text))
+// Catalog::addEntries() merges the batch into the file as it is on disk
+// and skips what the catalog already has.
+void MainWindow::flushCatalog() {
+    catalogFlush->stop();
+    if (pendingEntries.isEmpty())
+        return;
+    QList<Ingredient> entries = pendingEntries;
+    pendingEntries.clear();
+    flushing = IoExecutor::instance().run<bool>("update catalog", [entries](IoExecutor::Job &) -> bool {
+        if (Catalog::addEntries(entries))
+            return true;
+        qWarning() << QObject::tr("error writing %1").arg(Catalog::extendedFileName());
+        return false;
+    });
+    // e.g. another instance held the lock too long: the entries wait for the
+    // next batch instead of being lost
+    IoExecutor::then<bool>(flushing, this, [this, entries](bool written) {
+        if (written)
             return;
-    QTextStream extdata(&ext);
-    extdata.setCodec(QTextCodec::codecForName("UTF-8"));
-    QList<Ingredient> extIngr;
-    while (!extdata.atEnd()) {
-        QString extline = extdata.readLine();
-        QStringList extpair = extline.split(" = ");
-        QString extname = extpair.first();
-        int extcalories = extpair.last().toInt();
-        Ingredient extingr;
-        extingr.setName(extname);
-        extingr.setCalories(extcalories);
-        extIngr.append(extingr);
-    }
-    ext.close();
+        requeueEntries(entries);
+        statusBar()->showMessage(tr("Τα νέα υλικά δεν γράφτηκαν στη λίστα υλικών· νέα προσπάθεια σε λίγο"), 5000);
+    });
+}
 
-    QString fileName = dataDir.path() + "/extended.cal";
-    QFile file(fileName);
-    if (!file.open(QIODevice::Append | QFile::Text)) {
-        qWarning() << tr("error opening %1").arg(fileName);
-        return;
-    }
-    QTextStream data(&file);
-    data.setCodec(QTextCodec::codecForName("UTF-8"));
-    data.setIntegerBase(10);
-    for (auto &&ingredient : newIngr)
-        if (!extIngr.contains(ingredient) && !combIngr.contains(ingredient))
-            data << ingredient.name() << " = " << ingredient.calories() << '\n';
-    file.close();
+void MainWindow::requeueEntries(const QList<Ingredient> &entries) {
+    for (auto &&entry : entries)
+        if (!pendingEntries.contains(entry))
+            pendingEntries.append(entry);
+    catalogFlush->start();
 }
 
 void MainWindow::on_actionAdaptor_triggered() {
+    createPages();
     Adaptor *adaptor = new Adaptor;
     int ret = adaptor->exec();
     if (ret == QDialog::Rejected)
         return;
 
-    auto lines = calculator->findChildren<QLineEdit *>();
-    QList<int> masses;
+    auto lines = calculator->lineEdits;
+    QStringList masses;
 
     for (auto &&line : lines) {
         if (line->text().isNull())
@@ -461,8 +665,9 @@ void MainWindow::on_actionAdaptor_triggered() {
                 return;
             }
             else {
-                int newMass = line->text().toInt() * adaptor->getFrac();
-                if (newMass == 0) {
+                QString newMass = Units::scaled(line->text(), adaptor->getFrac());
+                Units::Quantity quantity;
+                if (Units::parse(newMass, &quantity) && quantity.amount == 0) {
                     QMessageBox box(QMessageBox::Warning,QApplication::applicationName(),
                                     tr("Μετά τη μετατροπή θα υπάρξουν συστατικά με μηδενική δοσολογία.\n"),
                                     QMessageBox::Cancel | QMessageBox::Ignore,
@@ -475,7 +680,7 @@ void MainWindow::on_actionAdaptor_triggered() {
                     case QMessageBox::Cancel:
                         return;
                     case QMessageBox::Ignore:
-                        masses.append(0);
+                        masses.append("0");
                         break;
                     default:
                         return;
@@ -487,7 +692,7 @@ void MainWindow::on_actionAdaptor_triggered() {
         }
     }
     for (int i = 0; i < masses.count(); i++)
-        lines.at(i)->setText(QString::number(masses.at(i)));
+        lines.at(i)->setText(masses.at(i));
     calculator->setModified(true);
 }
 
@@ -506,132 +711,95 @@ QString writeableDir() {
     return QString();
 }
 
-bool MainWindow::saveRecipeFile(QStringList ingrs) {
+// Asks for the name to save under and makes it the current file; the
+// recipe itself is written by on_actionSaveRecipe_triggered().
+bool MainWindow::chooseSaveFile() {
     QString fileName = QFileDialog::getSaveFileName(this, tr("Αποθήκευση"), writeableDir(),
                                                     QString("Recipies (*.rcp);;Text files (*.txt);;All files (*.*)"));
     if (fileName.isEmpty() || fileName == QFileDialog::Rejected)
         return false;
     QFileInfo fi(fileName);
-    if (fi.suffix().isEmpty())
+    if (fi.suffix().isEmpty()) {
         fileName += ".rcp";
-    QSaveFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly | QFile::Text)) {
-        qWarning() << tr("error opening %1").arg(fileName);
-        return false;
+        fi.setFile(fileName);
     }
-    QTextStream data(&file);
-    data.setCodec(QTextCodec::codecForName("UTF-8"));
-    data.setGenerateByteOrderMark(true);
-    data.setIntegerBase(10);
-    for (auto &&ingredient : ingrs)
-        data << ingredient << '\n';
-    if (data.status() != QTextStream::Ok) {
-        qWarning() << tr("error saving %1").arg(fileName);
-        return false;
-    }
-    file.commit();
     currentFile = fileName;
-    setWindowTitle(QString("%1 - %2%3").arg(QApplication::applicationName(),
-                   fi.fileName(),
-                   fileName.startsWith(':') ? " [Preset]" : ""));
+    setWindowTitle(QString("%1 - %2").arg(QApplication::applicationName(), fi.fileName()));
     return true;
 }
 
-bool MainWindow::on_actionSaveRecipe_triggered() {
-    if (currentFile.isEmpty() || currentFile.startsWith(':')) {
-        if (!on_actionSaveRecipeAs_triggered())
-            return false;
-    }
-    else {
-        if (editor->isModified())
-            updateExtendedList();
-        Ingredients::ingredients = editor->_tmpIngredients;
-        QSaveFile file(currentFile);
-        if (!file.open(QIODevice::WriteOnly | QFile::Text)) {
-            qWarning() << QObject::tr("Σφάλμα ανοίγματος αρχείου: %1").arg(file.errorString());
-            return false;
+// The recipe is copied and written on the I/O thread, so editing goes on
+// at once. Every successful save becomes a revision in the recipe's
+// history, clears its stale mark, stales the recipes using it and may
+// change what the library search finds. A failed save marks the recipe
+// modified again.
+void MainWindow::saveRecipe(const QString &location, const Recipe &recipe) {
+    auto write = [location, recipe](IoExecutor::Job &) -> QString {
+        QString archiveName, name;
+        if (RecipeArchive::splitLocation(location, &archiveName, &name)) {
+            RecipeArchive archive(archiveName);
+            if (!archive.open() || !archive.append(QList<QPair<QString, Recipe>>() << qMakePair(name, recipe)))
+                return archive.errorString();
+        } else if (!recipe.write(location)) {
+            return tr("Σφάλμα αποθήκευσης του αρχείου %1").arg(QDir::toNativeSeparators(location));
         }
-        else {
-            ingrs.clear();
-            auto caloriesWidgets = editor->_tmpIngredients;
-            auto masses = calculator->findChildren<QLineEdit *>();
-            QList<int> kcalList;
-            QStringList labelData;
-            QStringList lineData;
-            for (auto &&widget : caloriesWidgets) {
-                labelData.append(widget.name().replace('=', ':').replace('>', ':'));
-                kcalList.append(widget.calories());
-            }
-            for (auto &&mass : masses)
-                lineData.append(mass->text());
-            if (lineData.count()!=labelData.count())
-                return false;
-            for (int i=0; i<labelData.count(); i++) {
-                QString ingr = labelData[i] + " > " + QString::number(kcalList[i]) + " > " + lineData[i];
-                ingrs.append(ingr);
-            }
-            ingrs.append("#\n" + calculator->instruct->toPlainText());
-
-            QTextStream data(&file);
-            data.setCodec(QTextCodec::codecForName("UTF-8"));
-            data.setGenerateByteOrderMark(true);
-            data.setIntegerBase(10);
-            for (auto &&ingredient : ingrs)
-                data << ingredient << '\n';
-            if (data.status() != QTextStream::Ok) {
-                qWarning() << tr("error saving %1").arg(currentFile);
-                return false;
-            }
-            file.commit();
-            calculator->updateDisplay();
-            calculator->calculation();
-            editor->setModified(false);
-            calculator->setModified(false);
-            statusBar()->showMessage(Ingredients::errorString(), 5000);
-            ingrs.clear();
+        RecipeGraph::instance().invalidate(location);
+        Recalculation::clearStale(location);
+        RecipeHistory history(location);
+        if (!history.load() || !history.record(recipe))
+            qWarning() << history.errorString();
+        return QString();
+    };
+    QFuture<QString> saved = IoExecutor::instance().run<QString>("write recipe", write);
+    saving = saved;
+    IoExecutor::then<QString>(saved, this, [this, location](const QString &error) {
+        searchIndex->refresh();
+        if (error.isEmpty())
+            return;
+        statusBar()->showMessage(error, 5000);
+        if (location == currentFile && editor) {
+            editor->setModified(true);
+            calculator->setModified(true);
         }
+    });
+}
+
+bool MainWindow::on_actionSaveRecipe_triggered() {
+    Diagnostics::ScopedTimer timer("save recipe");
+    if (currentFile.isEmpty() || currentFile.startsWith(':'))
+        return on_actionSaveRecipeAs_triggered();
+    createPages();
+    editor->commitEdits();
+    if (editor->isModified())
+        updateExtendedList();
+    Ingredients::ingredients = editor->_tmpIngredients;
+    if (calculator->masses().count() != editor->_tmpIngredients.count())
+        return false;
+    saveRecipe(currentFile, currentRecipe());
+    if (!RecipeArchive::isLocation(currentFile)) {
+        calculator->updateDisplay();
+        calculator->calculation();
     }
+    editor->setModified(false);
+    calculator->setModified(false);
+    statusBar()->showMessage(Ingredients::errorString(), 5000);
     return true;
 }
 
 bool MainWindow::on_actionSaveRecipeAs_triggered() {
-    if (editor->_tmpIngredients.isEmpty()) {
+    if (!editor || editor->_tmpIngredients.isEmpty()) {
         statusBar()->showMessage(tr("Δεν υπάρχει ανοιχτή συνταγή για αποθήκευση"), 3000);
         return false;
     }
-    else {
-        ingrs.clear();
-        auto caloriesWidgets = editor->_tmpIngredients;
-        auto masses = calculator->findChildren<QLineEdit *>();
-        QList<int> kcalList;
-        QStringList labelData;
-        QStringList lineData;
-        for (auto &&widget : caloriesWidgets) {
-            labelData.append(widget.name().replace('=', ':').replace('>', ':'));
-            kcalList.append(widget.calories());
-        }
-        for (auto &&mass : masses)
-            lineData.append(mass->text());
-        if (lineData.count()!=labelData.count())
-            return false;
-        for (int i = 0; i < labelData.count(); i++) {
-            QString ingr = labelData[i] + " > " + QString::number(kcalList[i]) + " > " + lineData[i];
-            ingrs.append(ingr);
-        }
-        ingrs.append("#\n" + calculator->instruct->toPlainText());
-        if (saveRecipeFile(ingrs)) {
-            editor->setModified(false);
-            calculator->setModified(false);
-            ingrs.clear();
-            on_actionSaveRecipe_triggered();
-            return true;
-        }
-    }
-    return false;
+    if (calculator->masses().count() != editor->_tmpIngredients.count() || !chooseSaveFile())
+        return false;
+    return on_actionSaveRecipe_triggered();
 }
 
-void MainWindow::on_actionOpenRecipe_triggered() {
-    if (editor->isModified() || calculator->isModified()) {
+// Asks about unsaved changes before another recipe replaces the current
+// one; false means the user cancelled.
+bool MainWindow::maybeSave() {
+    if (editor && (editor->isModified() || calculator->isModified())) {
         QMessageBox box(QMessageBox::Warning,QApplication::applicationName(),
                         tr("Υπάρχουν αλλαγές που δεν αποθηκεύτηκαν.\n"),
                         QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel,
@@ -646,75 +814,149 @@ void MainWindow::on_actionOpenRecipe_triggered() {
             on_actionSaveRecipe_triggered();
             break;
         case QMessageBox::Cancel:
-            return;
+            return false;
         default:
             break;
         }
     }
-    instr.clear();
+    return true;
+}
+
+void MainWindow::on_actionOpenRecipe_triggered() {
+    if (!maybeSave())
+        return;
     QString fileName = QFileDialog::getOpenFileName(this, tr("Άνοιγμα αρχείου"), writeableDir(),
-                                                    QString("Recipies (*.rcp);;Text files (*.txt);;All files (*.*)"));
+                                                    QString("Recipies (*.rcp);;Recipe archives (*.rca);;Text files (*.txt);;All files (*.*)"));
     if (fileName.isEmpty())
         return;
-    QFileInfo fi(fileName);
-    setWindowTitle(QString("%1 - %2").arg(QApplication::applicationName(), fi.fileName()));
+    if (RecipeArchive::isArchive(fileName))
+        chooseFromArchive(fileName, [this](const QString &location) { openRecipe(location); });
+    else
+        openRecipe(fileName);
+}
 
-    QFile data(fileName);
-    if (!data.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qWarning() << tr("error opening %1").arg(fileName);
-        return;
-    }
-    QTextStream reader(&data);
-    reader.setCodec(QTextCodec::codecForName("UTF-8"));
-    while (!reader.atEnd()) {
-        QString line = reader.readLine();
-        if (line.startsWith("#"))
-            break;
-        recipeIngrs.append(line);
-    }
-    while (!reader.atEnd()) {
-        QString line = reader.readLine();
-        if (!recipeIngrs.contains(line))
-            instr.append(line);
+// Lets the user pick one recipe of an archive and hands its location to
+// chosen. The names come from the archive index, read on the I/O thread.
+void MainWindow::chooseFromArchive(const QString &fileName, const std::function<void(const QString &)> &chosen) {
+    typedef QPair<QStringList, QString> Names;  // or an error
+    auto read = [fileName](IoExecutor::Job &) -> Names {
+        RecipeArchive archive(fileName);
+        if (!archive.open())
+            return qMakePair(QStringList(), archive.errorString());
+        QStringList names = archive.names();
+        names.sort();
+        return qMakePair(names, QString());
+    };
+    QFuture<Names> index = IoExecutor::instance().run<Names>("archive index", read);
+    IoExecutor::then<Names>(index, this, [this, fileName, chosen](const Names &names) {
+        if (!names.second.isEmpty()) {
+            statusBar()->showMessage(names.second, 5000);
+            return;
+        }
+        bool ok;
+        QString name = QInputDialog::getItem(this, tr("Άνοιγμα από συλλογή"), tr("Συνταγή:"), names.first, 0, false, &ok);
+        if (ok && !name.isEmpty())
+            chosen(RecipeArchive::location(fileName, name));
+    });
+}
+
+// Files given on the command line, or forwarded by a later launch. The
+// window holds one recipe at a time, so with several files the last wins.
+void MainWindow::openFiles(const QStringList &files) {
+    if (isVisible()) {
+        if (isMinimized())
+            showNormal();
+        raise();
+        activateWindow();
     }
-    openRecipe(fileName);
-    currentFile = fileName;
-    recipeIngrs.clear();
+    if (files.isEmpty() || !maybeSave())
+        return;
+    QString location = files.last();
+    if (RecipeArchive::isArchive(location) && !RecipeArchive::isLocation(location))
+        chooseFromArchive(location, [this](const QString &chosen) { openRecipe(chosen); });
+    else
+        openRecipe(location);
 }
 
-void MainWindow::openRecipe(const QString &fileName) {
-    QStringList masses;
+// Opens either a plain .rcp file or a recipe inside an archive, given as
+// "<archive>.rca#<name>". The recipe is read on the I/O thread, with its
+// references to other recipes resolved and the calories changed since it
+// was marked stale applied; a newer open cancels one still in flight.
+// opened, if given, learns whether the recipe is now shown.
+void MainWindow::openRecipe(const QString &location, const std::function<void(bool)> &opened) {
+    auto load = [location](IoExecutor::Job &) -> LoadedRecipe {
+        LoadedRecipe loaded {Recipe(), QFileInfo(location).fileName(), QString(), QString(), 0};
+        QString archiveName, name;
+        if (RecipeArchive::splitLocation(location, &archiveName, &name)) {
+            RecipeArchive archive(archiveName);
+            if (!archive.open() || !archive.read(name, &loaded.recipe)) {
+                loaded.error = archive.errorString();
+                return loaded;
+            }
+            loaded.title = QString("%1 [%2]").arg(name, QFileInfo(archiveName).fileName());
+        } else if (!loaded.recipe.read(location)) {
+            loaded.error = tr("Σφάλμα ανοίγματος αρχείου: %1").arg(location);
+            return loaded;
+        }
+        for (auto &&ingredient : Recalculation::staleIngredients(location))
+            for (auto &&item : loaded.recipe.items)
+                if (Catalog::fold(item.ingredient.name()) == Catalog::fold(ingredient.name()) &&
+                        item.ingredient.calories() != ingredient.calories()) {
+                    item.ingredient.setCalories(ingredient.calories());
+                    loaded.updated++;
+                }
+        RecipeGraph &graph = RecipeGraph::instance();
+        if (!graph.update(&loaded.recipe, location))
+            loaded.warning = graph.errorString();
+        return loaded;
+    };
+    opening.cancel();
+    opening = IoExecutor::instance().run<LoadedRecipe>("open recipe", load);
+    IoExecutor::then<LoadedRecipe>(opening, this, [this, location, opened](const LoadedRecipe &loaded) {
+        Diagnostics::ScopedTimer timer("show recipe");
+        if (!loaded.error.isEmpty()) {
+            qWarning() << loaded.error;
+            statusBar()->showMessage(loaded.error, 5000);
+            if (opened)
+                opened(false);
+            return;
+        }
+        if (!loaded.warning.isEmpty())
+            statusBar()->showMessage(loaded.warning, 5000);
+        showRecipe(loaded.recipe);
+        currentFile = location;
+        setWindowTitle(QString("%1 - %2").arg(QApplication::applicationName(), loaded.title));
+        if (loaded.updated) {
+            editor->setModified(true);
+            calculator->setModified(true);
+            statusBar()->showMessage(tr("Ενημερώθηκαν οι θερμίδες %n υλικών από τη λίστα· αποθηκεύστε για να διατηρηθούν",
+                                        "", loaded.updated), 8000);
+        }
+        if (opened)
+            opened(true);
+    });
+}
+
+void MainWindow::showRecipe(const Recipe &recipe) {
+    createPages();
     editor->_tmpIngredients.clear();
     Ingredients::ingredients.clear();
-    for (auto &&ingr : recipeIngrs) {
-        QStringList items = ingr.split(" > ");
-        QString name = items[0];
-        int calories = items[1].toInt();
-        QString mass = items[2];
-        Ingredient *newIngr = new Ingredient(name, calories);
-        editor->_tmpIngredients.append(*newIngr);
-        Ingredients::ingredients.append(*newIngr);
-        masses.append(mass);
+    for (auto &&item : recipe.items) {
+        editor->_tmpIngredients.append(item.ingredient);
+        Ingredients::ingredients.append(item.ingredient);
     }
 
-    auto caloriesWidgets = findChildren<IngredientWidget *>();
-    for (auto &&widget : caloriesWidgets)
-        widget->close();
     editor->setColumns(1);
     editor->updateDisplay();
     calculator->setColumns(1);
     calculator->updateDisplay();
 
-    auto lines = calculator->findChildren<QLineEdit *>();
-    for (int i = 0; i < masses.count(); i++)
-        lines[lines.count() - masses.count() + i]->setText(masses[i]);
+    auto lines = calculator->lineEdits;
+    for (int i = 0; i < recipe.items.count() && i < lines.count(); i++)
+        lines[i]->setText(recipe.items.at(i).mass);
     calculator->calculation();
 
-    QFileInfo fi(fileName);
-    currentFile = fileName;
-    setWindowTitle(QString("%1 - %2").arg(QApplication::applicationName(), fi.fileName()));
-
-    calculator->instruct->setPlainText(instr.join("\n"));
+    calculator->instruct->setPlainText(recipe.instructions);
     calculator->instruct->verticalScrollBar()->setValue(0);
     stackedWidget->setCurrentWidget(calculator);
     ui->actionCalculator->setChecked(true);
@@ -723,56 +965,364 @@ void MainWindow::openRecipe(const QString &fileName) {
     calculator->setModified(false);
 }
 
-void MainWindow::on_action_export_to_pdf_triggered() {
-    auto caloriesWidgets = editor->_tmpIngredients;
-    QList<int> kcalList;
-    QStringList labelData;
-    QStringList lineData;
-    auto labelsList = calculator->findChildren<QLabel *>();
-    auto linesList = calculator->findChildren<QLineEdit *>();
-    for (auto &&line : linesList)
-        if (!line->text().isEmpty()) {
-            lineData.append(line->text());
-            labelData.append(labelsList[linesList.indexOf(line)+editor->columns()+6]->text());
+void MainWindow::on_actionOptimize_triggered() {
+    if (!editor || editor->_tmpIngredients.isEmpty()) {
+        statusBar()->showMessage(tr("Δεν υπάρχει ανοιχτή συνταγή"), 3000);
+        return;
+    }
+    editor->commitEdits();
+    QList<int> grams;
+    for (auto &&line : calculator->lineEdits)
+        grams.append(line->grams());
+    OptimizerDialog optimizer(editor->_tmpIngredients, grams, this);
+    if (optimizer.exec() != QDialog::Accepted)
+        return;
+    QList<int> masses = optimizer.masses();
+    auto lines = calculator->lineEdits;
+    for (int i = 0; i < masses.count() && i < lines.count(); i++)
+        if (masses.at(i) != lines.at(i)->grams())
+            lines.at(i)->setText(QString::number(masses.at(i)));
+    calculator->calculation();
+    calculator->setModified(true);
+}
+
+void MainWindow::on_actionHistory_triggered() {
+    if (currentFile.isEmpty() || currentFile.startsWith(':')) {
+        statusBar()->showMessage(tr("Η συνταγή δεν έχει αποθηκευτεί ακόμα"), 3000);
+        return;
+    }
+    QString location = currentFile;
+    auto load = [location](IoExecutor::Job &) {
+        QSharedPointer<RecipeHistory> history(new RecipeHistory(location));
+        history->load();
+        return history;
+    };
+    QFuture<QSharedPointer<RecipeHistory>> loaded =
+            IoExecutor::instance().run<QSharedPointer<RecipeHistory>>("history", load);
+    IoExecutor::then<QSharedPointer<RecipeHistory>>(loaded, this, [this, location](const QSharedPointer<RecipeHistory> &loadedHistory) {
+        if (location != currentFile)
+            return;  // another recipe was opened meanwhile
+        HistoryDialog history(loadedHistory, this);
+        if (history.isEmpty()) {
+            QString error = loadedHistory->errorString();
+            statusBar()->showMessage(error.isEmpty() ? tr("Δεν υπάρχει ιστορικό για αυτή τη συνταγή") : error, 3000);
+            return;
+        }
+        if (history.exec() != QDialog::Accepted)
+            return;
+        showRecipe(history.selectedRecipe());
+        editor->setModified(true);
+        calculator->setModified(true);
+    });
+}
+
+void MainWindow::on_actionSearch_triggered() {
+    SearchDialog search(searchIndex, this);
+    if (search.exec() != QDialog::Accepted || search.selectedLocation().isEmpty())
+        return;
+    if (maybeSave())
+        openRecipe(search.selectedLocation());
+}
+
+void MainWindow::on_actionDedupe_triggered() {
+    flushCatalog();  // entries still batched take part too
+    QFuture<DedupeDialog::Contents> loaded =
+            IoExecutor::instance().run<DedupeDialog::Contents>("dedupe scan", [](IoExecutor::Job &) {
+        return DedupeDialog::load();
+    });
+    IoExecutor::then<DedupeDialog::Contents>(loaded, this, [this](const DedupeDialog::Contents &contents) {
+        DedupeDialog dedupe(contents, this);
+        if (!dedupe.hasClusters()) {
+            statusBar()->showMessage(tr("Δεν βρέθηκαν διπλότυπα υλικά"), 4000);
+            return;
         }
-    for (auto &&widget : caloriesWidgets)
-        for (auto &&label : labelData)
-            if (widget.name().startsWith(label))
-                kcalList.append(widget.calories());
+        if (dedupe.exec() == QDialog::Accepted)
+            statusBar()->showMessage(tr("Η λίστα υλικών ενημερώθηκε"), 4000);
+    });
+}
 
-    QString fileName = QFileDialog::getSaveFileName(nullptr, "Export PDF", writeableDir() + currentFile.remove(".rcp"), "*.pdf");
+// Stores the corrected calories of an ingredient in the personal list and
+// brings the library recipes using it up to date in the background. The
+// catalog is read and written on the I/O thread.
+void MainWindow::on_actionEditCalories_triggered() {
+    if (recalculation && recalculation->isRunning()) {
+        statusBar()->showMessage(tr("Ο επανυπολογισμός συνταγών βρίσκεται ήδη σε εξέλιξη"), 3000);
+        return;
+    }
+    QFuture<QStringList> entries = IoExecutor::instance().run<QStringList>("catalog lines", [](IoExecutor::Job &) {
+        return Catalog::entryLines();
+    });
+    IoExecutor::then<QStringList>(entries, this, [this](const QStringList &lines) { editCalories(lines); });
+}
+
+void MainWindow::editCalories(const QStringList &entries) {
+    QStringList names;
+    QHash<QString, int> calories;
+    Ingredient ingredient;
+    for (auto &&line : entries)
+        if (Catalog::parseLine(line, &ingredient)) {
+            if (!calories.contains(ingredient.name()))
+                names.append(ingredient.name());
+            calories.insert(ingredient.name(), ingredient.calories());  // the personal list comes last
+        }
+    bool ok;
+    QString name = QInputDialog::getItem(this, tr("Διόρθωση θερμίδων"), tr("Υλικό:"), names, 0, true, &ok).trimmed();
+    if (!ok || name.isEmpty())
+        return;
+    int old = calories.value(name);
+    int value = QInputDialog::getInt(this, tr("Διόρθωση θερμίδων"), tr("Θερμίδες ανά 100g για «%1»:").arg(name),
+                                     old, 0, 9000, 1, &ok);
+    if (!ok || (value == old && calories.contains(name)))
+        return;
+    QFuture<bool> stored = IoExecutor::instance().run<bool>("update catalog", [name, value](IoExecutor::Job &) {
+        return Catalog::setCalories(name, value);
+    });
+    IoExecutor::then<bool>(stored, this, [this, name, value](bool saved) {
+        if (saved)
+            recalculate(Ingredient(name, value));
+        else
+            QMessageBox::warning(this, QApplication::applicationName(), tr("Σφάλμα αποθήκευσης της λίστας υλικών"));
+    });
+}
+
+void MainWindow::recalculate(const Ingredient &changed) {
+    QString name = changed.name();
+    QStringList locations = searchIndex->recipesUsing(name);
+    if (locations.isEmpty()) {
+        statusBar()->showMessage(tr("Η λίστα υλικών ενημερώθηκε· καμία συνταγή της βιβλιοθήκης δεν χρησιμοποιεί το υλικό"), 4000);
+        return;
+    }
+    QMessageBox box(QMessageBox::Question, QApplication::applicationName(),
+                    tr("%n συνταγές της βιβλιοθήκης χρησιμοποιούν το υλικό «%1».", "", locations.count()).arg(name),
+                    QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel, this);
+    box.setInformativeText(tr("Να ενημερωθούν τώρα τα αρχεία τους ή να σημειωθούν ώστε να ενημερωθούν όταν ανοιχτούν;"));
+    box.setButtonText(QMessageBox::Yes, tr("Ενημέρωση"));
+    box.setButtonText(QMessageBox::No, tr("Σήμανση"));
+    box.setButtonText(QMessageBox::Cancel, tr("Καμία αλλαγή"));
+    int ret = box.exec();
+    if (ret == QMessageBox::Cancel)
+        return;
+
+    if (!recalculation) {
+        recalculation = new Recalculation(this);
+        connect(recalculation, &Recalculation::finished, this, &MainWindow::recalculationFinished);
+        connect(recalculation, &Recalculation::progressValueChanged, this, [this](int value) {
+            statusBar()->showMessage(tr("Επανυπολογισμός συνταγών... %1").arg(value));
+        });
+    }
+    statusBar()->showMessage(tr("Επανυπολογισμός συνταγών..."));
+    recalculation->start(QList<Ingredient>() << changed, locations,
+                         ret == QMessageBox::Yes ? Recalculation::Rewrite : Recalculation::MarkStale);
+}
+
+// An unmodified current recipe that was rewritten is reloaded; the
+// rewritten files are picked up by the search index on its own.
+void MainWindow::recalculationFinished() {
+    statusBar()->clearMessage();
+    QList<Recalculation::Change> changes = recalculation->changes();
+    int failed = 0;
+    bool current = false;
+    for (auto &&change : changes) {
+        if (!change.error.isEmpty())
+            failed++;
+        else if (change.location == currentFile)
+            current = true;
+    }
+    if (current && editor && !editor->isModified() && !calculator->isModified())
+        openRecipe(currentFile);
+    searchIndex->refresh();
+
+    QMessageBox box(failed ? QMessageBox::Warning : QMessageBox::Information, QApplication::applicationName(),
+                    tr("Επανυπολογίστηκαν %n συνταγές.", "", changes.count() - failed), QMessageBox::Ok, this);
+    if (failed)
+        box.setInformativeText(tr("%n συνταγές δεν ενημερώθηκαν.", "", failed));
+    box.setDetailedText(recalculation->report());
+    box.exec();
+}
+
+// Reading the recipes and writing the archive happen on the I/O thread;
+// the progress dialog follows the job and can cancel it between files.
+void MainWindow::on_actionPackLibrary_triggered() {
+    QString dirName = QFileDialog::getExistingDirectory(this, tr("Φάκελος συνταγών"), writeableDir());
+    if (dirName.isEmpty())
+        return;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Αποθήκευση συλλογής"), writeableDir(),
+                                                    QString("Recipe archives (*.rca)"));
+    if (fileName.isEmpty())
+        return;
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName += '.' + RecipeArchive::suffix;
+
+    auto pack = [dirName, fileName](IoExecutor::Job &job) -> QString {
+        QStringList files;
+        QDirIterator it(dirName, QStringList("*.rcp"), QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            files.append(it.next());
+
+        RecipeArchive archive(fileName);
+        if (QFileInfo::exists(fileName) && !archive.open())
+            return archive.errorString();
+        QDir dir(dirName);
+        job.setProgressRange(0, files.count());
+        QList<QPair<QString, Recipe>> batch;
+        int batches {0};
+        auto flush = [&]() {
+            if (batch.isEmpty() || !archive.append(batch))
+                return false;
+            batch.clear();
+            batches++;
+            return true;
+        };
+        for (int i = 0; i < files.count() && !job.isCanceled(); i++) {
+            job.setProgress(i);
+            Recipe recipe;
+            if (!recipe.read(files.at(i)))
+                continue;
+            QString name = dir.relativeFilePath(files.at(i));
+            name.chop(4);  // ".rcp"
+            batch.append(qMakePair(name, recipe));
+            if (batch.count() == 1000 && !flush())
+                break;
+        }
+        if (!batch.isEmpty() && !flush())
+            return archive.errorString();
+        job.setProgress(files.count());
+        if (batches > 1)
+            archive.compact();
+        return tr("Η συλλογή %1 περιέχει %2 συνταγές").arg(QFileInfo(fileName).fileName()).arg(archive.count());
+    };
+
+    QFuture<QString> packed = IoExecutor::instance().run<QString>("pack library", pack);
+    auto progress = new QProgressDialog(tr("Δημιουργία συλλογής..."), tr("Ακύρωση"), 0, 0, this);
+    progress->setWindowModality(Qt::WindowModal);
+    auto watcher = new QFutureWatcher<QString>(progress);
+    connect(watcher, &QFutureWatcher<QString>::progressRangeChanged, progress, &QProgressDialog::setRange);
+    connect(watcher, &QFutureWatcher<QString>::progressValueChanged, progress, &QProgressDialog::setValue);
+    connect(progress, &QProgressDialog::canceled, watcher, &QFutureWatcher<QString>::cancel);
+    connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, progress]() {
+        if (watcher->isCanceled())
+            statusBar()->showMessage(tr("Η δημιουργία της συλλογής διακόπηκε"), 5000);
+        else
+            statusBar()->showMessage(watcher->result(), 5000);
+        progress->deleteLater();
+    });
+    watcher->setFuture(packed);
+}
+
+void MainWindow::on_action_export_to_pdf_triggered() {
+    QString fileName = QFileDialog::getSaveFileName(nullptr, "Export PDF", writeableDir() + QString(currentFile).remove(".rcp"), "*.pdf");
     if (fileName.isEmpty())
         return;
     if (QFileInfo(fileName).suffix().isEmpty())
         fileName.append(".pdf");
+    exportPdf(fileName);
+}
+
+void MainWindow::exportPdf(const QString &fileName) {
     QPrinter printer(QPrinter::PrinterResolution);
     printer.setOutputFormat(QPrinter::PdfFormat);
     printer.setPageSize(QPageSize(QPageSize::A4));
     printer.setOutputFileName(fileName);
 
-    QStringList ingrList;
-    for (int i = 0; i < labelData.count(); i++) {
-        QString ingr = lineData[i] + " γρ. " + labelData[i];
-        ingrList.append("<span>&#8226; " + ingr + "</span>");
-    }
+    if (editor)
+        editor->commitEdits();
+    QTextDocument doc;
+    doc.setHtml(currentRecipe().toHtml(QFileInfo(fileName).baseName()));
+    doc.print(&printer);
+}
 
-    QStringList instrList;
-    for (auto &&line : calculator->instruct->toPlainText().replace("<", "&#60;").split("\n")) {
-        line.isEmpty() ? instrList.append(line) : instrList.append("<span>&#8226; " + line + "</span>");
-    }
+void MainWindow::on_actionExportCookbook_triggered() {
+    QStringList files = QFileDialog::getOpenFileNames(this, tr("Επιλογή συνταγών"), writeableDir(),
+                                                      QString("Recipies (*.rcp)"));
+    if (files.isEmpty())
+        return;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Εξαγωγή βιβλίου συνταγών"), writeableDir(), "*.pdf");
+    if (fileName.isEmpty())
+        return;
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName.append(".pdf");
 
-    QTextDocument doc;
-    QFileInfo fi(fileName);
+    Cookbook cookbook;
+    QProgressDialog progress(tr("Σελιδοποίηση συνταγών..."), tr("Ακύρωση"), 0, 0, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(0);
+    connect(&cookbook, &Cookbook::progressRangeChanged, &progress, &QProgressDialog::setRange);
+    connect(&cookbook, &Cookbook::progressValueChanged, &progress, &QProgressDialog::setValue);
+    connect(&progress, &QProgressDialog::canceled, &cookbook, &Cookbook::cancel);
+    bool ok = cookbook.write(files, fileName);
+    progress.reset();
+    statusBar()->showMessage(ok ? tr("Το βιβλίο συνταγών αποθηκεύτηκε στο %1").arg(fileName)
+                                : cookbook.errorString(), 5000);
+}
 
-    QString stdText = "<p style='text-align: right'>Σύνολο: " + labelsList[4]->text() + "<br/>" + labelsList[5]->text() + "</p>" \
-                + "<p style='text-align: center'><b><h2>" + fi.baseName() + "</b></h2></p>" \
-                + "<p style='line-height:120%'><br/><u>Υλικά:</u><br/>" + ingrList.join("<br/>") + "</p><br/>";
-    QString instrText = "<p style='line-height:120%'><u>Οδηγίες εκτέλεσης:</u><br/>" + instrList.join("<br/>") + "</p>";
-    QString fullText = stdText + instrText;
+void MainWindow::on_actionExportLibrary_triggered() {
+    QString filter;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Εξαγωγή βιβλιοθήκης"), writeableDir(),
+                                                    "JSON Lines (*.jsonl);;CSV (*.csv)", &filter);
+    if (fileName.isEmpty())
+        return;
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName.append(filter.startsWith("CSV") ? ".csv" : ".jsonl");
+
+    // the scan, the archives and the output file are all on the I/O
+    // thread, like packing
+    QString libraryPath = searchIndex->libraryPath();
+    auto exportLibrary = [libraryPath, fileName](IoExecutor::Job &job) -> QString {
+        LibraryExport exporter;
+        exporter.setCancelCheck([&job]() { return job.isCanceled(); });
+        QObject::connect(&exporter, &LibraryExport::progressRangeChanged, [&job](int minimum, int maximum) {
+            job.setProgressRange(minimum, maximum);
+        });
+        QObject::connect(&exporter, &LibraryExport::progressValueChanged, [&job](int value) {
+            job.setProgress(value);
+        });
+        if (!exporter.write(libraryPath, fileName, LibraryExport::formatFor(fileName)))
+            return exporter.errorString();
+        return tr("Η βιβλιοθήκη εξήχθη στο %1").arg(fileName);
+    };
+
+    QFuture<QString> exported = IoExecutor::instance().run<QString>("export library", exportLibrary);
+    auto progress = new QProgressDialog(tr("Εξαγωγή συνταγών..."), tr("Ακύρωση"), 0, 0, this);
+    progress->setWindowModality(Qt::WindowModal);
+    auto watcher = new QFutureWatcher<QString>(progress);
+    connect(watcher, &QFutureWatcher<QString>::progressRangeChanged, progress, &QProgressDialog::setRange);
+    connect(watcher, &QFutureWatcher<QString>::progressValueChanged, progress, &QProgressDialog::setValue);
+    connect(progress, &QProgressDialog::canceled, watcher, &QFutureWatcher<QString>::cancel);
+    connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, progress]() {
+        statusBar()->showMessage(watcher->isCanceled() ? tr("Η εξαγωγή ακυρώθηκε") : watcher->result(), 5000);
+        progress->deleteLater();
+    });
+    watcher->setFuture(exported);
+}
 
-    !calculator->instruct->toPlainText().isEmpty() ? doc.setHtml(fullText) : doc.setHtml(stdText);
-    doc.print(&printer);
-    ingrList.clear();
+// The pending entries are queued before the sync on the same serial
+// executor, so they travel with it.
+void MainWindow::on_actionSyncCatalog_triggered() {
+    QSettings settings;
+    QString folder = QFileDialog::getExistingDirectory(this, tr("Κοινόχρηστος φάκελος συγχρονισμού"),
+                                                       settings.value("syncFolder", writeableDir()).toString());
+    if (folder.isEmpty())
+        return;
+    settings.setValue("syncFolder", folder);
+
+    flushCatalog();
+    statusBar()->showMessage(tr("Συγχρονισμός λίστας υλικών..."));
+    QFuture<CatalogSync::Report> synced = IoExecutor::instance().run<CatalogSync::Report>(
+                "sync catalog", [folder](IoExecutor::Job &) { return CatalogSync::sync(folder); });
+    IoExecutor::then<CatalogSync::Report>(synced, this, [this](const CatalogSync::Report &report) {
+        if (!report.error.isEmpty()) {
+            statusBar()->clearMessage();
+            QMessageBox::warning(this, QApplication::applicationName(), report.error);
+            return;
+        }
+        // the list dialogs are built on first use and reset by every exec()
+        if (report.changed && drop)
+            drop->reset();
+        if (report.changed && combo)
+            combo->reset();
+        statusBar()->showMessage(tr("Στάλθηκαν %1 και παραλήφθηκαν %2 αλλαγές, ενημερώθηκαν %3 υλικά")
+                                 .arg(report.exported).arg(report.imported).arg(report.changed), 5000);
+    });
 }
 
 void MainWindow::helpPopup() {
@@ -811,11 +1361,12 @@ void MainWindow::readSettings() {
     const int s = settings.value("size", 11).toInt();
     const QFont font(f, s);
     QApplication::setFont(font);
+    ui->actionDiagnostics->setChecked(settings.value("diagnostics", false).toBool());
 }
 
 void MainWindow::closeEvent(QCloseEvent *event) {
     updateExtendedList();
-    if (editor->isModified() || calculator->isModified()) {
+    if (editor && (editor->isModified() || calculator->isModified())) {
         QMessageBox box(QMessageBox::Warning,QApplication::applicationName(),
                         tr("Υπάρχουν αλλαγές που δεν αποθηκεύτηκαν.\n"),
                         QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel,
@@ -838,6 +1389,7 @@ void MainWindow::closeEvent(QCloseEvent *event) {
             event->ignore();
             return;
         default:
+            saving = QFuture<QString>();  // a failed earlier save no longer matters
             break;
         }
     }
@@ -848,7 +1400,32 @@ void MainWindow::closeEvent(QCloseEvent *event) {
             settings.setValue("geometry", saveGeometry());
         settings.setValue("font", QApplication::font().toString());
         settings.setValue("size", QApplication::font().pointSize());
+        settings.setValue("diagnostics", ui->actionDiagnostics->isChecked());
     }
     updateExtendedList();
+    flushCatalog();
+    // the one place the GUI waits for the disk: queued saves must land
+    // before the autosave snapshot goes
+    IoExecutor::instance().waitForDone();
+    // a queued save that failed keeps the window and the recovery snapshot
+    if (saving.isFinished() && !saving.isCanceled() && !saving.result().isEmpty()) {
+        QMessageBox::warning(this, QApplication::applicationName(), saving.result());
+        if (editor) {
+            editor->setModified(true);
+            calculator->setModified(true);
+            autosave();
+        }
+        event->ignore();
+        return;
+    }
+    if (flushing.isFinished() && !flushing.isCanceled() && !flushing.result()) {
+        // the entries are queued again once the event loop runs
+        QMessageBox::warning(this, QApplication::applicationName(),
+                             tr("Τα νέα υλικά δεν γράφτηκαν στη λίστα υλικών, που είναι κλειδωμένη από άλλο "
+                                "παράθυρο. Δοκιμάστε ξανά σε λίγο."));
+        event->ignore();
+        return;
+    }
+    autosaver->discard();
     event->accept();
 }
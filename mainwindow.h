@@ -3,63 +3,125 @@
 
 #include "ingredient.h"
 #include "ingredientwidget.h"
+#include "recipe.h"
 #include <QCloseEvent>
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QMainWindow>
 #include <QSettings>
+#include <functional>
 
+class Autosaver;
+class Combo;
+class DiagnosticsDock;
+class DropList;
+class Recalculation;
+class SearchIndex;
 class StartPage;
 class CollectionEditorWidget;
 class MassCalculatorWidget;
 class QStackedWidget;
+class QTimer;
 
 namespace Ui { class MainWindow; }
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
+    friend class AllocReport;
 
 public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
-    void openRecipe(const QString &fileName);
+    void openRecipe(const QString &location, const std::function<void(bool)> &opened = nullptr);
+    void setStartupTimer(const QElapsedTimer &timer);
 
 public slots:
-    void addToCalc(QString name);
+    void addToCalc(const QString &name);
     void calcClimb(int i);
     void calcDescend(int i);
-    void calcRemove(QList<int> selections);
+    void calcRemove(const QList<int> &selections);
+    void openFiles(const QStringList &files);
     void refreshCalc();
-    void refreshCalcMasses(QStringList lastMasses);
+    void refreshCalcMasses(const QStringList &lastMasses);
     void stateUpdates(int boxNum);
 
 protected:
     void closeEvent(QCloseEvent *event) override;
+    bool event(QEvent *event) override;
 
 private:
-    bool saveRecipeFile(QStringList ingrs);
+    struct LoadedRecipe {
+        Recipe recipe;
+        QString title;
+        QString error;    // nothing to show
+        QString warning;  // shown, but references could not be resolved
+        int updated;      // items given calories from the stale list
+    };
+
+    void addRecipe(const QString &location);
+    Combo *comboDialog();
+    void createPages();
+    Recipe currentRecipe() const;  // committed names only; see commitEdits()
+    DropList *dropList();
+    void editCalories(const QStringList &entries);
+    void exportPdf(const QString &fileName);
+    bool maybeSave();
+    void chooseFromArchive(const QString &fileName, const std::function<void(const QString &)> &chosen);
+    void recalculate(const Ingredient &changed);
+    bool chooseSaveFile();
+    void saveRecipe(const QString &location, const Recipe &recipe);
+    void showRecipe(const Recipe &recipe);
     void readSettings();
     void selectFont();
     void setColumnNumber(int columns);
     void updateExtendedList();
+    void requeueEntries(const QList<Ingredient> &entries);
     Ui::MainWindow *ui;
     StartPage *start;
     CollectionEditorWidget *editor;
     MassCalculatorWidget *calculator;
     QStackedWidget *stackedWidget;
+    Autosaver *autosaver;
+    SearchIndex *searchIndex;
+    DropList *drop;
+    Combo *combo;
+    DiagnosticsDock *diagnostics;
+    Recalculation *recalculation;
+    QElapsedTimer startup;
+    bool firstFrame {false};
     bool selMany;
     QString currentFile;
-    QStringList ingrs;
-    QStringList instr;
-    QStringList recipeIngrs;
+    QFuture<LoadedRecipe> opening;
+    QFuture<QString> saving;  // the last queued save; error text or empty
+    QList<Ingredient> pendingEntries;  // not yet written to extended.cal
+    QFuture<bool> flushing;
+    QTimer *catalogFlush;
 
 private slots:
+    void autosave();
+    void flushCatalog();
+    void offerRecovery();
+    void prewarm();
+    void recalculationFinished();
     bool on_actionSaveRecipe_triggered();
     bool on_actionSaveRecipeAs_triggered();
     void helpPopup();
     void infoPopup();
     void on_actionAdaptor_triggered();
     void on_actionAddFromList_triggered();
+    void on_actionAddRecipe_triggered();
     void on_action_export_to_pdf_triggered();
+    void on_actionDedupe_triggered();
+    void on_actionDiagnostics_toggled(bool arg1);
+    void on_actionEditCalories_triggered();
+    void on_actionExportCookbook_triggered();
+    void on_actionExportLibrary_triggered();
+    void on_actionSyncCatalog_triggered();
+    void on_actionHistory_triggered();
     void on_actionOpenRecipe_triggered();
+    void on_actionOptimize_triggered();
+    void on_actionPackLibrary_triggered();
+    void on_actionSearch_triggered();
     void on_actionSelectMany_toggled(bool arg1);
     void on_actionToggleToolbar_toggled(bool arg1);
     void showCalculator();
@@ -18,16 +18,17 @@
 
 #include "masscalculatorwidget.h"
 #include "ui_masscalculatorwidget.h"
+#include "diagnostics.h"
 #include "global.h"
 #include "ingredients.h"
 #include "masslineedit.h"
 #include <QFile>
 #include <QGridLayout>
-#include <QIntValidator>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMainWindow>
 #include <QPushButton>
+#include <QRegularExpressionValidator>
 #include <QSizePolicy>
 #include <QStatusBar>
 #include <QTextCodec>
@@ -42,17 +43,23 @@ MassCalculatorWidget::MassCalculatorWidget(QWidget *parent) :
 {
     ui->setupUi(this);
     connect(ui->actionClear, &QAction::triggered, this, &MassCalculatorWidget::clear);
+    // a number, a fraction or both ("1 1/2"), optionally followed by a unit
+    validator = new QRegularExpressionValidator(
+                QRegularExpression("\\s*(\\d{1,6}([.,]\\d{1,3})?(\\s+\\d{1,2}/\\d{1,2})?|\\d{1,2}/\\d{1,2})?\\s*[\\w. ]{0,20}"), this);
     instruct = new QPlainTextEdit(this);
+    instruct->setPlaceholderText(plh);
     instruct->setVisible(false);
+    connect(instruct, &QPlainTextEdit::textChanged, this, [=]() { _modified = true; });
 }
 
 MassCalculatorWidget::~MassCalculatorWidget() { delete ui; }
 
 void MassCalculatorWidget::calculation() {
+    Diagnostics::ScopedTimer timer("calculator calculation");
     int masssum {0};
     float kcalsum {0};
     for (auto &&lineEdit : lineEdits) {
-        int mass = lineEdit->text().toInt();
+        int mass = lineEdit->grams();
         masssum += mass;
         kcalsum += lineEdit->calories() * mass / 100.0;
     }
@@ -70,71 +77,15 @@ void MassCalculatorWidget::clear() {
     ui->kcalcount->setText("0 kCal");
     ui->masscount->setText("0 g");
     ui->percentcount->setText("0 kCal/100g");
-    lineEdits.at(0)->setFocus();
+    if (!lineEdits.isEmpty())
+        lineEdits.at(0)->setFocus();
 }
 
 void MassCalculatorWidget::updateDisplay() {
+    Diagnostics::ScopedTimer timer("calculator updateDisplay");
     setUpdatesEnabled(false);  // to avoid screen flicker
-
-    auto lastLines = findChildren<QLineEdit *>();
-    QStringList lastMasses;
-    for (auto &&line : lastLines)
-        lastMasses.append(line->text());
-    QRegularExpression re("^ing.*$");
-    auto caloriesWidgets = findChildren<QWidget *>(re);
-    for (auto &&widget : caloriesWidgets)
-        widget->close();
-    ui->caloriesGridLayout->invalidate();
-    lineEdits.clear();
-
-    int rowsPerColumn = qCeil(static_cast<float>(Ingredients::ingredients.size()) / columns());
-    for (int i = 0; i < columns(); i++) {
-        int column = columns() * i + 1;
-        QLabel *label = new QLabel(this);
-        label->setObjectName(QString::fromUtf8("ingHeader") + QString::number(i));
-        label->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed, QSizePolicy::Label));
-        label->setText(tr("γραμμάρια"));
-        label->setAlignment(Qt::AlignCenter);
-        label->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(label, 0, column);
-        QFrame *vline = new QFrame(this);
-        vline->setObjectName(QString::fromUtf8("ingLine") + QString::number(i));
-        vline->setFrameShape(QFrame::VLine);
-        vline->setFrameShadow(QFrame::Sunken);
-        vline->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(vline, 0, column + 1, rowsPerColumn + 1, 1);
-    }
-
-    for (int i = 0; i < Ingredients::ingredients.size(); i++) {
-        int column = (i / rowsPerColumn);
-        int row = i % rowsPerColumn + 1;
-        QLabel *label = new QLabel(this);
-        label->setObjectName(QString::fromUtf8("ingLabel") + QString::number(i));
-        label->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed, QSizePolicy::Label));
-        label->setText(Ingredients::ingredients.at(i).name());
-        label->setToolTip(QString("%1 kCal/100g").arg(Ingredients::ingredients.at(i).calories()));
-        label->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(label, row, 0 + column * columns(), 1, 1);
-
-        MassLineEdit *line = new MassLineEdit(Ingredients::ingredients.at(i).calories(), this);
-        line->setObjectName(QString::fromUtf8("ingLine") +  QString::number(i));
-        line->setAlignment(Qt::AlignCenter);
-        line->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed, QSizePolicy::LineEdit));
-        line->setValidator(new QIntValidator(0, 100000, this));
-        line->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(line, row, 1 + column * columns(), 1, 1, Qt::AlignHCenter);
-        lineEdits.append(line);
-        connect(line, &MassLineEdit::textEdited, this, &MassCalculatorWidget::calculation);
-        connect(line, &MassLineEdit::textEdited, this, [=]() { _modified = true; });
-    }
-
-    ui->caloriesGridLayout->addWidget(instruct, 0, columns() * 2 + 3, rowsPerColumn + 1, 1);
-    instruct->setAttribute(Qt::WA_DeleteOnClose);
-    instruct->setPlaceholderText(plh);
-    if (columns())
-        instruct->setVisible(true);
-    connect(instruct, &QPlainTextEdit::textChanged, this, [=]() { _modified = true; });
-
+    QStringList lastMasses = masses();
+    rebuild();
     setUpdatesEnabled(true);
     clear();
     if (lineEdits.count() >= lastMasses.count())
@@ -142,139 +93,140 @@ void MassCalculatorWidget::updateDisplay() {
             lineEdits.at(i)->setText(lastMasses.at(i));
 }
 
-void MassCalculatorWidget::updateMasses(QStringList masses) {
+void MassCalculatorWidget::updateMasses(const QStringList &masses) {
+    Diagnostics::ScopedTimer timer("calculator updateMasses");
     setUpdatesEnabled(false);
+    rebuild();
+    setUpdatesEnabled(true);
+    clear();
+    if (lineEdits.count() >= masses.count())
+        for (int i=0; i<masses.count(); i++)
+            lineEdits.at(i)->setText(masses.at(i));
+}
 
-    QRegularExpression re("^ing.*$");
-    auto caloriesWidgets = findChildren<QWidget *>(re);
-    for (auto &&widget : caloriesWidgets)
-        widget->close();
-    ui->caloriesGridLayout->invalidate();
-    lineEdits.clear();
+void MassCalculatorWidget::addIngr(const QString &name) {
+    Diagnostics::ScopedTimer timer("calculator addIngr");
+    setUpdatesEnabled(false);
+    QStringList lastMasses = masses();
+    rebuild();
+    if (!labels.isEmpty())
+        labels.last()->setText(name);
+    setUpdatesEnabled(true);
+    clear();
+    emit refreshMasses(lastMasses);
+}
 
-    int rowsPerColumn = qCeil(static_cast<float>(Ingredients::ingredients.size()) / columns());
-    for (int i = 0; i < columns(); i++) {
-        int column = columns() * i + 1;
-        QLabel *label = new QLabel(this);
-        label->setObjectName(QString::fromUtf8("ingHeader") + QString::number(i));
-        label->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed, QSizePolicy::Label));
-        label->setText(tr("γραμμάρια"));
-        label->setAlignment(Qt::AlignCenter);
-        label->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(label, 0, column);
-        QFrame *vline = new QFrame(this);
-        vline->setObjectName(QString::fromUtf8("ingLine") + QString::number(i));
-        vline->setFrameShape(QFrame::VLine);
-        vline->setFrameShadow(QFrame::Sunken);
-        vline->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(vline, 0, column + 1, rowsPerColumn + 1, 1);
-    }
+void MassCalculatorWidget::relayout() {
+    setUpdatesEnabled(false);
+    placeWidgets();
+    setUpdatesEnabled(true);
+}
 
-    for (int i = 0; i < Ingredients::ingredients.size(); i++) {
-        int column = (i / rowsPerColumn);
-        int row = i % rowsPerColumn + 1;
+QString MassCalculatorWidget::kcalText() const { return ui->kcalcount->text(); }
+
+QString MassCalculatorWidget::percentText() const { return ui->percentcount->text(); }
+
+QStringList MassCalculatorWidget::masses() const {
+    QStringList masses;
+    for (auto &&line : lineEdits)
+        masses.append(line->text());
+    return masses;
+}
+
+// Brings the row pool in line with Ingredients::ingredients. Rows that are
+// no longer needed are hidden and kept for later, so rebuilding a recipe
+// only allocates widgets when it grows past its largest size so far.
+void MassCalculatorWidget::rebuild() {
+    int count = Ingredients::ingredients.size();
+    while (lineEdits.size() > count) {
+        QLabel *label = labels.takeLast();
+        MassLineEdit *line = lineEdits.takeLast();
+        ui->caloriesGridLayout->removeWidget(label);
+        ui->caloriesGridLayout->removeWidget(line);
+        label->hide();
+        line->hide();
+        spareLabels.append(label);
+        spareLines.append(line);
+    }
+    while (lineEdits.size() < count) {
+        if (!spareLines.isEmpty()) {
+            labels.append(spareLabels.takeLast());
+            lineEdits.append(spareLines.takeLast());
+            continue;
+        }
+        int i = lineEdits.size();
         QLabel *label = new QLabel(this);
         label->setObjectName(QString::fromUtf8("ingLabel") + QString::number(i));
         label->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed, QSizePolicy::Label));
-        label->setText(Ingredients::ingredients.at(i).name());
-        label->setToolTip(QString("%1 kCal/100g").arg(Ingredients::ingredients.at(i).calories()));
-        label->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(label, row, 0 + column * columns(), 1, 1);
+        labels.append(label);
 
-        MassLineEdit *line = new MassLineEdit(Ingredients::ingredients.at(i).calories(), this);
+        MassLineEdit *line = new MassLineEdit(this);
         line->setObjectName(QString::fromUtf8("ingLine") +  QString::number(i));
         line->setAlignment(Qt::AlignCenter);
         line->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed, QSizePolicy::LineEdit));
-        line->setValidator(new QIntValidator(0, 100000, this));
-        line->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(line, row, 1 + column * columns(), 1, 1, Qt::AlignHCenter);
+        line->setValidator(validator);
         lineEdits.append(line);
         connect(line, &MassLineEdit::textEdited, this, &MassCalculatorWidget::calculation);
         connect(line, &MassLineEdit::textEdited, this, [=]() { _modified = true; });
     }
 
-    ui->caloriesGridLayout->addWidget(instruct, 0, columns()*2+3, rowsPerColumn + 1, 1);
-    instruct->setAttribute(Qt::WA_DeleteOnClose);
-    instruct->setPlaceholderText(plh);
-    if (columns())
-        instruct->setVisible(true);
-    connect(instruct, &QPlainTextEdit::textChanged, this, [=]() { _modified = true; });
-
-    setUpdatesEnabled(true);
-    clear();
-    if (lineEdits.count() >= masses.count())
-        for (int i=0; i<masses.count(); i++)
-            lineEdits.at(i)->setText(masses.at(i));
+    for (int i = 0; i < count; i++) {
+        const Ingredient &ingr = Ingredients::ingredients.at(i);
+        labels.at(i)->setText(ingr.name());
+        labels.at(i)->setToolTip(QString("%1 kCal/100g").arg(ingr.calories()));
+        lineEdits.at(i)->setIngredient(ingr);
+        labels.at(i)->show();
+        lineEdits.at(i)->show();
+    }
+    placeWidgets();
 }
 
-void MassCalculatorWidget::addIngr(QString name) {
-    setUpdatesEnabled(false);
-
-    auto lastLines = findChildren<QLineEdit *>();
-    QStringList lastMasses;
-    for (auto &&line : lastLines)
-        lastMasses.append(line->text());
-    QRegularExpression re("^ing.*$");
-    auto caloriesWidgets = findChildren<QWidget *>(re);
-    for (auto &&widget : caloriesWidgets)
-        widget->close();
-    ui->caloriesGridLayout->invalidate();
-    lineEdits.clear();
+// Moves the existing rows into the grid shape given by columns(); only the
+// per-column headers and separators are created here, and only when missing.
+void MassCalculatorWidget::placeWidgets() {
+    auto grid = ui->caloriesGridLayout;
+    int rowsPerColumn = qMax(1, qCeil(static_cast<float>(lineEdits.size()) / columns()));
 
-    int rowsPerColumn = qCeil(static_cast<float>(Ingredients::ingredients.size()) / columns());
-    for (int i = 0; i < columns(); i++) {
-        int column = columns() * i + 1;
+    while (headers.size() < columns()) {
+        int i = headers.size();
         QLabel *label = new QLabel(this);
         label->setObjectName(QString::fromUtf8("ingHeader") + QString::number(i));
         label->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed, QSizePolicy::Label));
-        label->setText(tr("γραμμάρια"));
+        label->setText(tr("ποσότητα"));
         label->setAlignment(Qt::AlignCenter);
-        label->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(label, 0, column);
+        headers.append(label);
         QFrame *vline = new QFrame(this);
-        vline->setObjectName(QString::fromUtf8("ingLine") + QString::number(i));
+        vline->setObjectName(QString::fromUtf8("ingVLine") + QString::number(i));
         vline->setFrameShape(QFrame::VLine);
         vline->setFrameShadow(QFrame::Sunken);
-        vline->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(vline, 0, column + 1, rowsPerColumn + 1, 1);
+        vlines.append(vline);
     }
 
-    for (int i = 0; i < Ingredients::ingredients.size(); i++) {
+    // every column takes three grid columns: name, mass and separator
+    for (int i = 0; i < headers.size(); i++) {
+        grid->removeWidget(headers.at(i));
+        grid->removeWidget(vlines.at(i));
+        bool used = i < columns();
+        headers.at(i)->setVisible(used);
+        vlines.at(i)->setVisible(used);
+        if (used) {
+            grid->addWidget(headers.at(i), 0, i * 3 + 1);
+            grid->addWidget(vlines.at(i), 0, i * 3 + 2, rowsPerColumn + 1, 1);
+        }
+    }
+
+    for (int i = 0; i < lineEdits.size(); i++) {
         int column = (i / rowsPerColumn);
         int row = i % rowsPerColumn + 1;
-        QLabel *label = new QLabel(this);
-        label->setObjectName(QString::fromUtf8("ingLabel") + QString::number(i));
-        label->setSizePolicy(QSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed, QSizePolicy::Label));
-        label->setText(Ingredients::ingredients.at(i).name());
-        label->setToolTip(QString("%1 kCal/100g").arg(Ingredients::ingredients.at(i).calories()));
-        label->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(label, row, 0 + column * columns(), 1, 1);
-
-        MassLineEdit *line = new MassLineEdit(Ingredients::ingredients.at(i).calories(), this);
-        line->setObjectName(QString::fromUtf8("ingLine") +  QString::number(i));
-        line->setAlignment(Qt::AlignCenter);
-        line->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed, QSizePolicy::LineEdit));
-        line->setValidator(new QIntValidator(0, 100000, this));
-        line->setAttribute(Qt::WA_DeleteOnClose);
-        ui->caloriesGridLayout->addWidget(line, row, 1 + column * columns(), 1, 1, Qt::AlignHCenter);
-        lineEdits.append(line);
-        connect(line, &MassLineEdit::textEdited, this, &MassCalculatorWidget::calculation);
-        connect(line, &MassLineEdit::textEdited, this, [=]() { _modified = true; });
+        grid->removeWidget(labels.at(i));
+        grid->removeWidget(lineEdits.at(i));
+        grid->addWidget(labels.at(i), row, column * 3, 1, 1);
+        grid->addWidget(lineEdits.at(i), row, column * 3 + 1, 1, 1, Qt::AlignHCenter);
     }
 
-    QList<QLabel* > labelList = findChildren<QLabel *>();
-    labelList.at(labelList.count()-1)->setText(name);
-
-    ui->caloriesGridLayout->addWidget(instruct, 0, columns() * 2 + 3, rowsPerColumn + 1, 1);
-    instruct->setAttribute(Qt::WA_DeleteOnClose);
-    instruct->setPlaceholderText(plh);
-    if (columns())
-        instruct->setVisible(true);
-    connect(instruct, &QPlainTextEdit::textChanged, this, [=]() { _modified = true; });
-
-    setUpdatesEnabled(true);
-    clear();
-    emit refreshMasses(lastMasses);
+    grid->removeWidget(instruct);
+    grid->addWidget(instruct, 0, columns() * 3, rowsPerColumn + 1, 1);
+    instruct->setVisible(true);
 }
 
 void MassCalculatorWidget::on_refreshButton_clicked() {
@@ -282,24 +234,22 @@ void MassCalculatorWidget::on_refreshButton_clicked() {
     _modified = true;
 }
 
-void MassCalculatorWidget::doRefresh(float kcalsum, int masssum, float percentsum, QStringList names) {
+void MassCalculatorWidget::doRefresh(float kcalsum, int masssum, float percentsum, const QStringList &names) {
     ui->kcalcount->setText(QString::number(qRound(kcalsum)) + " kCal");
     ui->masscount->setText(QString::number(masssum) + "g");
     ui->percentcount->setText(QString::number(qRound(percentsum)) + " kCal/100g");
 
-    auto calcLabels = findChildren<QLabel *>();
-    for (int i = 0; i < names.count(); i++)
-        calcLabels.at(i + 6 + columns())->setText(names.at(i));
+    for (int i = 0; i < names.count() && i < labels.count(); i++)
+        labels.at(i)->setText(names.at(i));
 }
 
-void MassCalculatorWidget::doRefreshMasses(float kcalsum, int masssum, float percentsum, QStringList names, QStringList lastMasses) {
+void MassCalculatorWidget::doRefreshMasses(float kcalsum, int masssum, float percentsum, const QStringList &names, const QStringList &lastMasses) {
     ui->kcalcount->setText(QString::number(qRound(kcalsum)) + " kCal");
     ui->masscount->setText(QString::number(masssum) + "g");
     ui->percentcount->setText(QString::number(qRound(percentsum)) + " kCal/100g");
 
-    auto calcLabels = findChildren<QLabel *>();
-    for (int i = 0; i < names.count(); i++)
-        calcLabels.at(i + 6 + columns())->setText(names.at(i));
+    for (int i = 0; i < names.count() && i < labels.count(); i++)
+        labels.at(i)->setText(names.at(i));
 
     if (lineEdits.count() >= lastMasses.count())
         for (int i=0; i<lastMasses.count(); i++)
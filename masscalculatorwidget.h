@@ -6,6 +6,9 @@
 #include <QWidget>
 
 class MassLineEdit;
+class QFrame;
+class QLabel;
+class QRegularExpressionValidator;
 namespace Ui { class MassCalculatorWidget; }
 
 class MassCalculatorWidget : public CollectionPage {
@@ -14,29 +17,41 @@ class MassCalculatorWidget : public CollectionPage {
 public:
     explicit MassCalculatorWidget(QWidget *parent = nullptr);
     ~MassCalculatorWidget();
-    void addIngr(QString name);
+    void addIngr(const QString &name);
     void updateDisplay() override;
-    void updateMasses(QStringList masses);
+    void relayout() override;
+    void updateMasses(const QStringList &masses);
+    QStringList masses() const;
+    QString kcalText() const;
+    QString percentText() const;
     QPlainTextEdit *instruct;
     inline bool isModified() const { return _modified; }
     inline void setModified(bool modified) { _modified = modified; }
+    QList<QLabel *> labels {};
     QList<MassLineEdit *> lineEdits {};
 
 signals:
     void refresh();
-    void refreshMasses(QStringList lastMasses);
+    void refreshMasses(const QStringList &lastMasses);
 
 public slots:
     void calculation();
-    void doRefresh(float kcalsum, int masssum, float percentsum, QStringList names);
-    void doRefreshMasses(float kcalsum, int masssum, float percentsum, QStringList names, QStringList lastMasses);
+    void doRefresh(float kcalsum, int masssum, float percentsum, const QStringList &names);
+    void doRefreshMasses(float kcalsum, int masssum, float percentsum, const QStringList &names, const QStringList &lastMasses);
 
 private slots:
     void clear();
     void on_refreshButton_clicked();
 
 private:
+    void rebuild();
+    void placeWidgets();
     Ui::MassCalculatorWidget *ui;
+    QList<QLabel *> headers {};
+    QList<QFrame *> vlines {};
+    QList<QLabel *> spareLabels {};
+    QList<MassLineEdit *> spareLines {};
+    QRegularExpressionValidator *validator;
     bool _modified { false };
 };
 
@@ -0,0 +1,43 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "masslineedit.h"
+
+MassLineEdit::MassLineEdit(QWidget *parent) : QLineEdit(parent) {
+    connect(this, &QLineEdit::textChanged, this, &MassLineEdit::convert);
+}
+
+void MassLineEdit::setIngredient(const Ingredient &ingredient) {
+    if (ingredient.nameId() != _ingredient.nameId())
+        _measure = Units::measure(ingredient);
+    _ingredient = ingredient;
+    convert();
+}
+
+void MassLineEdit::convert() {
+    Units::Quantity quantity;
+    double grams {0};
+    bool ok = Units::parse(text(), &quantity) && Units::toGrams(quantity, _measure, &grams);
+    _grams = ok ? qRound(grams) : 0;
+    if (!ok)
+        setToolTip(tr("Άγνωστη μονάδα ή βάρος τεμαχίου"));
+    else if (quantity.unit == Units::Gram)
+        setToolTip(QString());
+    else
+        setToolTip(QString("≈ %1 g").arg(_grams));
+}
@@ -1,18 +1,26 @@
 #ifndef MASSLINEEDIT_H
 #define MASSLINEEDIT_H
 
+#include "ingredient.h"
+#include "units.h"
 #include <QLineEdit>
 
+// Keeps the typed quantity converted to grams, so totals never parse text.
 class MassLineEdit : public QLineEdit {
     Q_OBJECT
     Q_PROPERTY(int calories READ calories)
 
 public:
-    MassLineEdit(int calories, QWidget* parent = nullptr) : QLineEdit(parent), _calories(calories) {}
-    int calories() const { return _calories; }
+    explicit MassLineEdit(QWidget* parent = nullptr);
+    int calories() const { return _ingredient.calories(); }
+    int grams() const { return _grams; }
+    void setIngredient(const Ingredient &ingredient);
 
 private:
-    const int _calories;
+    void convert();
+    Ingredient _ingredient;
+    Units::Measure _measure {0, 0};
+    int _grams {0};
 };
 
 #endif // MASSLINEEDIT_H
@@ -1,4 +1,4 @@
-QT += core gui printsupport
+QT += core gui printsupport concurrent network
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = nefchef
 TEMPLATE = app
@@ -7,49 +7,109 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
     adaptor.cpp \
+    autosaver.cpp \
+    calcserver.cpp \
+    catalog.cpp \
+    catalogsync.cpp \
     collectioneditorwidget.cpp \
     combo.cpp \
+    cookbook.cpp \
+    dedupe.cpp \
+    dedupedialog.cpp \
+    diagnostics.cpp \
+    diagnosticsdock.cpp \
     droplist.cpp \
     helpdialog.cpp \
+    historydialog.cpp \
     ingredient.cpp \
     ingredients.cpp \
     ingredientwidget.cpp \
+    ioexecutor.cpp \
+    libraryexport.cpp \
     main.cpp \
     mainwindow.cpp \
     masscalculatorwidget.cpp \
-    startpage.cpp
+    masslineedit.cpp \
+    optimizer.cpp \
+    optimizerdialog.cpp \
+    recalculation.cpp \
+    recipe.cpp \
+    recipearchive.cpp \
+    recipegraph.cpp \
+    recipehistory.cpp \
+    recipequery.cpp \
+    searchdialog.cpp \
+    searchindex.cpp \
+    singleinstance.cpp \
+    startpage.cpp \
+    units.cpp
 
 HEADERS += \
     adaptor.h \
+    autosaver.h \
+    calcserver.h \
+    catalog.h \
+    catalogsync.h \
     collectioneditorwidget.h \
     collectionpage.h \
     combo.h \
+    cookbook.h \
+    dedupe.h \
+    dedupedialog.h \
+    diagnostics.h \
+    diagnosticsdock.h \
     droplist.h \
     global.h \
     helpdialog.h \
+    historydialog.h \
     ingredient.h \
     ingredients.h \
     ingredientwidget.h \
+    ioexecutor.h \
+    libraryexport.h \
     mainwindow.h \
     masscalculatorwidget.h \
     masslineedit.h \
-    startpage.h
+    optimizer.h \
+    optimizerdialog.h \
+    recalculation.h \
+    recipe.h \
+    recipearchive.h \
+    recipegraph.h \
+    recipehistory.h \
+    recipequery.h \
+    searchdialog.h \
+    searchindex.h \
+    singleinstance.h \
+    startpage.h \
+    units.h
 
 FORMS += \
     adaptor.ui \
     combo.ui \
+    dedupedialog.ui \
     droplist.ui \
     helpdialog.ui \
+    historydialog.ui \
     ingredientwidget.ui \
     mainwindow.ui \
     masscalculatorwidget.ui \
+    optimizerdialog.ui \
+    searchdialog.ui \
     startpage.ui
 
+# qmake CONFIG+=alloctrack builds the --alloc-report profiling mode
+alloctrack {
+    DEFINES += NEFCHEF_ALLOCTRACK
+    SOURCES += allocreport.cpp alloctrack.cpp
+    HEADERS += allocreport.h alloctrack.h
+}
+
 RESOURCES += \
     nefchef.qrc
 
 OTHER_FILES += \
-    combined.cal \
+    catalog/*.cal \
     instructions.txt
 
 isEmpty(PREFIX) {
@@ -58,7 +118,7 @@ isEmpty(PREFIX) {
 
 DISTFILES += \
     LICENSE \
-    combined.cal \
+    catalog/*.cal \
     nefchef.desktop
 
 unix:!android {
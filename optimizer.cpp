@@ -0,0 +1,103 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "optimizer.h"
+#include <QtGlobal>
+
+namespace Optimizer {
+    double evaluate(const QVector<Variable> &variables, const QVector<double> &masses, Target target) {
+        double kcal {0};
+        double mass {0};
+        for (int i = 0; i < variables.size(); i++) {
+            kcal += variables.at(i).calories * masses.at(i) / 100.0;
+            mass += masses.at(i);
+        }
+        switch (target) {
+        case CaloriesPer100g:
+            return mass > 0 ? kcal * 100 / mass : 0;
+        case TotalCalories:
+            return kcal;
+        case TotalMass:
+            return mass;
+        }
+        return 0;
+    }
+
+    // Every target is written as a.x = b. For kcal/100g = v this is
+    // sum((c_i - v) x_i) = 0, which is linear once v is fixed.
+    Result solve(const QVector<Variable> &variables, Target target, double value) {
+        int n = variables.size();
+        QVector<double> a(n), weight(n);
+        double b {0};
+        if (target == TotalCalories)
+            b = value;
+        for (int i = 0; i < n; i++) {
+            const Variable &v = variables.at(i);
+            switch (target) {
+            case CaloriesPer100g: a[i] = v.calories - value; break;
+            case TotalCalories:   a[i] = v.calories / 100.0; break;
+            case TotalMass:       a[i] = 1; break;
+            }
+            // relative changes: a 10g change weighs more on 20g than on 500g
+            weight[i] = 1.0 / qMax(v.mass, 1.0);
+        }
+        if (target == TotalMass)
+            b = value;
+        for (int i = 0; i < n; i++)
+            if (variables.at(i).pinned)
+                b -= a.at(i) * variables.at(i).mass;
+
+        auto massesFor = [&](double lambda) {
+            QVector<double> x(n);
+            for (int i = 0; i < n; i++) {
+                const Variable &v = variables.at(i);
+                x[i] = v.pinned ? v.mass : qBound(v.lower, v.mass + lambda * a.at(i) / weight.at(i), v.upper);
+            }
+            return x;
+        };
+        auto lhs = [&](const QVector<double> &x) {
+            double sum {0};
+            for (int i = 0; i < n; i++)
+                if (!variables.at(i).pinned)
+                    sum += a.at(i) * x.at(i);
+            return sum;
+        };
+
+        // lhs(massesFor(lambda)) never decreases with lambda; widen the
+        // bracket until it holds b or the bounds stop it from moving
+        double low = -1, high = 1;
+        for (int i = 0; i < 60 && lhs(massesFor(low)) > b; i++)
+            low *= 4;
+        for (int i = 0; i < 60 && lhs(massesFor(high)) < b; i++)
+            high *= 4;
+        for (int i = 0; i < 100; i++) {
+            double mid = (low + high) / 2;
+            if (lhs(massesFor(mid)) < b)
+                low = mid;
+            else
+                high = mid;
+        }
+
+        Result result;
+        result.masses = massesFor((low + high) / 2);
+        result.achieved = evaluate(variables, result.masses, target);
+        double tolerance = qMax(0.5, qAbs(value) * 0.005);
+        result.feasible = qAbs(result.achieved - value) <= tolerance;
+        return result;
+    }
+}
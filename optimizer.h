@@ -0,0 +1,32 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <QVector>
+
+// Finds the masses closest to the current ones (relative least squares)
+// that meet one nutritional target, keeping pinned masses and bounds.
+// With a single linear target the optimum is a clamped shift of every free
+// mass along the target's gradient, found by bisection on the multiplier;
+// a few thousand flops for a typical recipe.
+namespace Optimizer {
+    enum Target { CaloriesPer100g, TotalCalories, TotalMass };
+
+    struct Variable {
+        int calories;   // per 100g
+        double mass;    // current grams
+        double lower;
+        double upper;
+        bool pinned;
+    };
+
+    struct Result {
+        QVector<double> masses;
+        double achieved;
+        bool feasible;
+    };
+
+    Result solve(const QVector<Variable> &variables, Target target, double value);
+    double evaluate(const QVector<Variable> &variables, const QVector<double> &masses, Target target);
+}
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,177 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "optimizerdialog.h"
+#include "ui_optimizerdialog.h"
+#include <QCheckBox>
+#include <QFont>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QSignalBlocker>
+#include <QSpinBox>
+#include <QTableWidgetItem>
+
+enum Column { NameColumn, CaloriesColumn, CurrentColumn, PinnedColumn, LowerColumn, UpperColumn, ResultColumn };
+
+static const int SliderSteps {1000};
+
+OptimizerDialog::OptimizerDialog(const QList<Ingredient> &ingredients, const QList<int> &masses, QWidget *parent) :
+    QDialog(parent), ui(new Ui::OptimizerDialog)
+{
+    ui->setupUi(this);
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setText(tr("Εφαρμογή"));
+    ui->target->addItems(QStringList() << tr("kCal/100g") << tr("Συνολικές kCal") << tr("Συνολικό βάρος (g)"));
+    ui->slider->setRange(0, SliderSteps);
+
+    auto table = ui->table;
+    table->setRowCount(ingredients.size());
+    for (int row = 0; row < ingredients.size(); row++) {
+        Optimizer::Variable v;
+        v.calories = ingredients.at(row).calories();
+        v.mass = masses.value(row);
+        v.lower = 0;
+        v.upper = qMax(3 * v.mass, 100.0);
+        v.pinned = false;
+        initial.append(v);
+
+        auto readOnly = [](const QString &text) {
+            auto item = new QTableWidgetItem(text);
+            item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+            return item;
+        };
+        table->setItem(row, NameColumn, readOnly(ingredients.at(row).name()));
+        table->setItem(row, CaloriesColumn, readOnly(QString::number(v.calories)));
+        table->setItem(row, CurrentColumn, readOnly(QString::number(qRound(v.mass))));
+        table->setItem(row, ResultColumn, readOnly(QString()));
+
+        auto pin = new QCheckBox(table);
+        table->setCellWidget(row, PinnedColumn, pin);
+        connect(pin, &QCheckBox::toggled, this, &OptimizerDialog::targetChanged);
+        for (int column : {LowerColumn, UpperColumn}) {
+            auto spin = new QSpinBox(table);
+            spin->setRange(0, 100000);
+            spin->setSuffix(" g");
+            spin->setValue(qRound(column == LowerColumn ? v.lower : v.upper));
+            table->setCellWidget(row, column, spin);
+            connect(spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &OptimizerDialog::targetChanged);
+        }
+    }
+    table->horizontalHeader()->setSectionResizeMode(NameColumn, QHeaderView::Stretch);
+
+    connect(ui->target, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &OptimizerDialog::targetChanged);
+    connect(ui->slider, &QSlider::valueChanged, this, &OptimizerDialog::sliderMoved);
+    connect(ui->value, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), this, [this](double value) {
+        QSignalBlocker blocker(ui->slider);
+        if (rangeHigh > rangeLow)
+            ui->slider->setValue(qRound((value - rangeLow) / (rangeHigh - rangeLow) * SliderSteps));
+        solve();
+    });
+    targetChanged();
+}
+
+OptimizerDialog::~OptimizerDialog() { delete ui; }
+
+QList<int> OptimizerDialog::masses() const {
+    QList<int> list;
+    for (double mass : solution)
+        list.append(qRound(mass));
+    return list;
+}
+
+QVector<Optimizer::Variable> OptimizerDialog::variables() const {
+    QVector<Optimizer::Variable> vars = initial;
+    for (int row = 0; row < vars.size(); row++) {
+        auto &v = vars[row];
+        v.pinned = static_cast<QCheckBox *>(ui->table->cellWidget(row, PinnedColumn))->isChecked();
+        v.lower = static_cast<QSpinBox *>(ui->table->cellWidget(row, LowerColumn))->value();
+        v.upper = qMax(v.lower, double(static_cast<QSpinBox *>(ui->table->cellWidget(row, UpperColumn))->value()));
+    }
+    return vars;
+}
+
+// The slider spans what the bounds allow: the extreme ingredient densities
+// for kcal/100g, and the all-lower to all-upper totals otherwise.
+void OptimizerDialog::updateRange() {
+    auto vars = variables();
+    auto target = static_cast<Optimizer::Target>(ui->target->currentIndex());
+    rangeLow = rangeHigh = 0;
+    if (target == Optimizer::CaloriesPer100g) {
+        bool first = true;
+        for (auto &&v : vars) {
+            double c = v.calories;
+            rangeLow = first ? c : qMin(rangeLow, c);
+            rangeHigh = first ? c : qMax(rangeHigh, c);
+            first = false;
+        }
+    } else {
+        QVector<double> low, high;
+        for (auto &&v : vars) {
+            low.append(v.pinned ? v.mass : v.lower);
+            high.append(v.pinned ? v.mass : v.upper);
+        }
+        rangeLow = Optimizer::evaluate(vars, low, target);
+        rangeHigh = Optimizer::evaluate(vars, high, target);
+    }
+}
+
+void OptimizerDialog::targetChanged() {
+    updateRange();
+    auto target = static_cast<Optimizer::Target>(ui->target->currentIndex());
+    QVector<double> current;
+    for (auto &&v : initial)
+        current.append(v.mass);
+    double value = solution.isEmpty() || sender() == ui->target
+            ? Optimizer::evaluate(initial, current, target) : ui->value->value();
+    {
+        QSignalBlocker blockValue(ui->value);
+        QSignalBlocker blockSlider(ui->slider);
+        ui->value->setRange(0, qMax(rangeHigh, value) * 2 + 1);
+        ui->value->setValue(value);
+        if (rangeHigh > rangeLow)
+            ui->slider->setValue(qRound((value - rangeLow) / (rangeHigh - rangeLow) * SliderSteps));
+    }
+    solve();
+}
+
+void OptimizerDialog::sliderMoved(int position) {
+    QSignalBlocker blocker(ui->value);
+    ui->value->setValue(rangeLow + (rangeHigh - rangeLow) * position / SliderSteps);
+    solve();
+}
+
+void OptimizerDialog::solve() {
+    auto vars = variables();
+    auto target = static_cast<Optimizer::Target>(ui->target->currentIndex());
+    Optimizer::Result result = Optimizer::solve(vars, target, ui->value->value());
+    solution = result.masses;
+
+    for (int row = 0; row < solution.size(); row++) {
+        auto item = ui->table->item(row, ResultColumn);
+        item->setText(QString::number(qRound(solution.at(row))));
+        QFont font = item->font();
+        font.setBold(qRound(solution.at(row)) != qRound(vars.at(row).mass));
+        item->setFont(font);
+    }
+    double kcal = Optimizer::evaluate(vars, solution, Optimizer::TotalCalories);
+    double mass = Optimizer::evaluate(vars, solution, Optimizer::TotalMass);
+    QString totals = tr("%1 kCal, %2 g, %3 kCal/100g")
+            .arg(qRound(kcal)).arg(qRound(mass)).arg(mass > 0 ? qRound(kcal * 100 / mass) : 0);
+    ui->status->setText(result.feasible ? totals
+                                        : tr("Ο στόχος δεν επιτυγχάνεται με αυτά τα όρια. Πλησιέστερο: %1").arg(totals));
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!solution.isEmpty());
+}
@@ -0,0 +1,33 @@
+#ifndef OPTIMIZERDIALOG_H
+#define OPTIMIZERDIALOG_H
+
+#include "ingredient.h"
+#include "optimizer.h"
+#include <QDialog>
+
+namespace Ui { class OptimizerDialog; }
+
+class OptimizerDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    OptimizerDialog(const QList<Ingredient> &ingredients, const QList<int> &masses, QWidget *parent = nullptr);
+    ~OptimizerDialog();
+    QList<int> masses() const;
+
+private slots:
+    void targetChanged();
+    void sliderMoved(int position);
+    void solve();
+
+private:
+    QVector<Optimizer::Variable> variables() const;
+    void updateRange();
+    Ui::OptimizerDialog *ui;
+    QVector<Optimizer::Variable> initial;
+    QVector<double> solution;
+    double rangeLow { 0 };
+    double rangeHigh { 0 };
+};
+
+#endif // OPTIMIZERDIALOG_H
@@ -0,0 +1,266 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recalculation.h"
+#include "ioexecutor.h"
+#include "recipe.h"
+#include "recipearchive.h"
+#include "recipegraph.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTextCodec>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+    // location -> the whole file; archive entries are grouped by archive so
+    // that each archive is rewritten once, by a single task
+    typedef QMap<QString, QStringList> Files;
+
+    // the stale list is read and rewritten from the GUI and the I/O thread
+    QMutex staleMutex;
+
+    QString staleFileName() {
+        return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/stale.lst";
+    }
+
+    // "location<TAB>name = calories", one line per ingredient to update
+    QStringList readStale() {
+        QStringList lines;
+        QFile file(staleFileName());
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return lines;
+        QTextStream data(&file);
+        data.setCodec(QTextCodec::codecForName("UTF-8"));
+        while (!data.atEnd()) {
+            QString line = data.readLine();
+            if (line.contains('\t'))
+                lines.append(line);
+        }
+        return lines;
+    }
+
+    void writeStale(const QStringList &lines) {
+        QDir().mkpath(QFileInfo(staleFileName()).path());
+        QSaveFile file(staleFileName());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            return;
+        QTextStream data(&file);
+        data.setCodec(QTextCodec::codecForName("UTF-8"));
+        for (auto &&line : lines)
+            data << line << '\n';
+        data.flush();
+        file.commit();
+    }
+
+    struct Updater {
+        typedef QList<Recalculation::Change> result_type;
+        QHash<QString, int> calories;  // folded name -> new calories
+        Recalculation::Mode mode;
+
+        // Applies the new calories to recipe; false when nothing differs.
+        bool update(Recipe *recipe, Recalculation::Change *change) const {
+            change->oldCalories = recipe->totalCalories();
+            for (auto &&item : recipe->items) {
+                auto it = calories.constFind(Catalog::fold(item.ingredient.name()));
+                if (it == calories.constEnd() || it.value() == item.ingredient.calories())
+                    continue;
+                change->ingredients.append(QString("%1: %2 → %3").arg(item.ingredient.name())
+                                           .arg(item.ingredient.calories()).arg(it.value()));
+                item.ingredient.setCalories(it.value());
+            }
+            change->newCalories = recipe->totalCalories();
+            return !change->ingredients.isEmpty();
+        }
+
+        QList<Recalculation::Change> operator()(const QPair<QString, QStringList> &file) const {
+            QList<Recalculation::Change> changes;
+            if (file.second.isEmpty()) {
+                Recipe recipe;
+                Recalculation::Change change {file.first, QStringList(), 0, 0, QString()};
+                if (!recipe.read(file.first)) {
+                    change.error = QObject::tr("Σφάλμα ανάγνωσης");
+                    return changes << change;
+                }
+                if (!update(&recipe, &change))
+                    return changes;
+                if (mode == Recalculation::Rewrite && !recipe.write(file.first))
+                    change.error = QObject::tr("Σφάλμα αποθήκευσης");
+                return changes << change;
+            }
+
+            RecipeArchive archive(file.first);
+            if (!archive.open()) {
+                for (auto &&name : file.second)
+                    changes.append({RecipeArchive::location(file.first, name), QStringList(), 0, 0,
+                                    archive.errorString()});
+                return changes;
+            }
+            QList<QPair<QString, Recipe>> rewritten;
+            for (auto &&name : file.second) {
+                Recipe recipe;
+                Recalculation::Change change {RecipeArchive::location(file.first, name), QStringList(), 0, 0, QString()};
+                if (!archive.read(name, &recipe))
+                    change.error = archive.errorString();
+                else if (!update(&recipe, &change))
+                    continue;
+                else if (mode == Recalculation::Rewrite)
+                    rewritten.append(qMakePair(name, recipe));
+                changes.append(change);
+            }
+            if (!rewritten.isEmpty() && !archive.append(rewritten)) {
+                for (auto &&change : changes)
+                    if (change.error.isEmpty())
+                        change.error = archive.errorString();
+            }
+            return changes;
+        }
+    };
+
+    void reduce(QList<Recalculation::Change> &all, const QList<Recalculation::Change> &changes) {
+        all += changes;
+    }
+}
+
+Recalculation::Recalculation(QObject *parent) : QObject(parent) {
+    connect(&watcher, &QFutureWatcher<QList<Change>>::progressRangeChanged, this, &Recalculation::progressRangeChanged);
+    connect(&watcher, &QFutureWatcher<QList<Change>>::progressValueChanged, this, &Recalculation::progressValueChanged);
+    connect(&watcher, &QFutureWatcher<QList<Change>>::finished, this, &Recalculation::collect);
+}
+
+Recalculation::~Recalculation() {
+    watcher.cancel();
+    watcher.waitForFinished();
+}
+
+void Recalculation::start(const QList<Ingredient> &changed, const QStringList &locations, Mode mode) {
+    Updater updater;
+    updater.mode = mode;
+    for (auto &&ingredient : changed)
+        updater.calories.insert(Catalog::fold(ingredient.name()), ingredient.calories());
+
+    Files files;
+    for (auto &&location : locations) {
+        QString archiveName, name;
+        if (RecipeArchive::splitLocation(location, &archiveName, &name))
+            files[archiveName].append(name);
+        else
+            files.insert(location, QStringList());
+    }
+    QList<QPair<QString, QStringList>> tasks;
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it)
+        tasks.append(qMakePair(it.key(), it.value()));
+
+    _changes.clear();
+    _changed = changed;
+    _mode = mode;
+    watcher.setFuture(QtConcurrent::mappedReduced<QList<Change>>(tasks, updater, reduce));
+}
+
+void Recalculation::cancel() {
+    watcher.cancel();
+}
+
+// Runs on the GUI thread once every task is done; the stale list is
+// updated on the I/O thread and finished() follows that write.
+void Recalculation::collect() {
+    if (!watcher.isCanceled())
+        _changes = watcher.result();
+    std::sort(_changes.begin(), _changes.end(), [](const Change &a, const Change &b) {
+        return a.location < b.location;
+    });
+    QStringList marked;
+    for (auto &&change : _changes) {
+        if (!change.error.isEmpty())
+            continue;
+        RecipeGraph::instance().invalidate(change.location);
+        if (_mode == MarkStale)
+            for (auto &&ingredient : _changed)
+                marked.append(QString("%1\t%2 = %3").arg(change.location, ingredient.name())
+                              .arg(ingredient.calories()));
+    }
+    if (marked.isEmpty()) {
+        emit finished();
+        return;
+    }
+    QFuture<bool> written = IoExecutor::instance().run<bool>("mark stale", [marked](IoExecutor::Job &) {
+        QMutexLocker locker(&staleMutex);
+        QStringList stale = readStale() + marked;
+        stale.removeDuplicates();
+        writeStale(stale);
+        return true;
+    });
+    IoExecutor::then<bool>(written, this, [this](bool) { emit finished(); });
+}
+
+QString Recalculation::report() const {
+    QString text;
+    for (auto &&change : _changes) {
+        text += QDir::toNativeSeparators(change.location) + '\n';
+        if (!change.error.isEmpty()) {
+            text += "    " + change.error + '\n';
+            continue;
+        }
+        for (auto &&ingredient : change.ingredients)
+            text += "    " + ingredient + '\n';
+        text += QString("    %1 → %2 kcal\n").arg(qRound(change.oldCalories)).arg(qRound(change.newCalories));
+    }
+    return text;
+}
+
+// Later lines win, so the newest value of an ingredient edited twice is
+// the one applied.
+QList<Ingredient> Recalculation::staleIngredients(const QString &location) {
+    QList<Ingredient> ingredients;
+    QHash<QString, int> seen;
+    QMutexLocker locker(&staleMutex);
+    for (auto &&line : readStale()) {
+        int tab = line.indexOf('\t');
+        if (line.left(tab) != location)
+            continue;
+        Ingredient ingredient;
+        if (!Catalog::parseLine(line.mid(tab + 1), &ingredient))
+            continue;
+        QString key = Catalog::fold(ingredient.name());
+        if (seen.contains(key))
+            ingredients[seen.value(key)] = ingredient;
+        else {
+            seen.insert(key, ingredients.count());
+            ingredients.append(ingredient);
+        }
+    }
+    return ingredients;
+}
+
+void Recalculation::clearStale(const QString &location) {
+    QMutexLocker locker(&staleMutex);
+    QStringList lines = readStale();
+    QStringList kept;
+    for (auto &&line : lines)
+        if (line.left(line.indexOf('\t')) != location)
+            kept.append(line);
+    if (kept.count() != lines.count())
+        writeStale(kept);
+}
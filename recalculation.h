@@ -0,0 +1,55 @@
+#ifndef RECALCULATION_H
+#define RECALCULATION_H
+
+#include "ingredient.h"
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+
+// Brings the recipes of the library up to date after the calories of
+// catalog ingredients changed: either rewrites them in place or records
+// them as stale, so that the new values are applied when each is opened.
+// Runs on the thread pool, one task per .rcp file or .rca archive.
+class Recalculation : public QObject {
+    Q_OBJECT
+
+public:
+    enum Mode { Rewrite, MarkStale };
+
+    struct Change {
+        QString location;
+        QStringList ingredients;  // "name: old → new" per changed item
+        double oldCalories;
+        double newCalories;
+        QString error;
+    };
+
+    explicit Recalculation(QObject *parent = nullptr);
+    ~Recalculation();
+    void start(const QList<Ingredient> &changed, const QStringList &locations, Mode mode);
+    bool isRunning() const { return watcher.isRunning(); }
+    QList<Change> changes() const { return _changes; }
+    QString report() const;
+
+    static QList<Ingredient> staleIngredients(const QString &location);
+    static void clearStale(const QString &location);
+
+public slots:
+    void cancel();
+
+signals:
+    void progressRangeChanged(int minimum, int maximum);
+    void progressValueChanged(int value);
+    void finished();
+
+private slots:
+    void collect();
+
+private:
+    QFutureWatcher<QList<Change>> watcher;
+    QList<Change> _changes {};
+    QList<Ingredient> _changed {};
+    Mode _mode { Rewrite };
+};
+
+#endif // RECALCULATION_H
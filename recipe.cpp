@@ -0,0 +1,124 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recipe.h"
+#include "units.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextCodec>
+#include <QTextStream>
+
+double Recipe::totalCalories() const {
+    double kcalsum {0};
+    for (auto &&item : items)
+        kcalsum += item.ingredient.calories() * Units::grams(item.mass, item.ingredient) / 100.0;
+    return kcalsum;
+}
+
+int Recipe::totalMass() const {
+    int masssum {0};
+    for (auto &&item : items)
+        masssum += Units::grams(item.mass, item.ingredient);
+    return masssum;
+}
+
+// Printable form used by the PDF exports; ingredients without a mass are left out.
+QString Recipe::toHtml(const QString &title) const {
+    QStringList ingrList;
+    for (auto &&item : items)
+        if (!item.mass.isEmpty())
+            ingrList.append("<span>&#8226; " + Units::display(item.mass) + " " + item.ingredient.name() + "</span>");
+
+    QStringList instrList;
+    for (auto &&line : QString(instructions).replace("<", "&#60;").split("\n")) {
+        line.isEmpty() ? instrList.append(line) : instrList.append("<span>&#8226; " + line + "</span>");
+    }
+
+    double kcalsum = totalCalories();
+    int masssum = totalMass();
+    double percentsum = masssum ? kcalsum * 100 / masssum : 0;
+    QString stdText = "<p style='text-align: right'>Σύνολο: " + QString::number(qRound(kcalsum)) + " kCal<br/>" \
+                + QString::number(qRound(percentsum)) + " kCal/100g</p>" \
+                + "<p style='text-align: center'><b><h2>" + title + "</b></h2></p>" \
+                + "<p style='line-height:120%'><br/><u>Υλικά:</u><br/>" + ingrList.join("<br/>") + "</p><br/>";
+    QString instrText = "<p style='line-height:120%'><u>Οδηγίες εκτέλεσης:</u><br/>" + instrList.join("<br/>") + "</p>";
+    return instructions.isEmpty() ? stdText : stdText + instrText;
+}
+
+// Same layout as the one written by MainWindow: one "name > kcal > mass"
+// line per ingredient, then a '#' line followed by the instructions.
+QString Recipe::toText(const QHash<int, QString> &names) const {
+    QString text;
+    for (int i = 0; i < items.count(); i++) {
+        const Item &item = items.at(i);
+        text += names.value(i, item.ingredient.name()).replace('=', ':').replace('>', ':') + " > " +
+                QString::number(item.ingredient.calories()) + " > " + item.mass + '\n';
+    }
+    text += "#\n" + instructions + '\n';
+    return text;
+}
+
+Recipe Recipe::fromText(const QString &text) {
+    Recipe recipe;
+    QStringList lines = text.split('\n');
+    int i = 0;
+    for (; i < lines.count(); i++) {
+        const QString &line = lines.at(i);
+        if (line.startsWith('#')) {
+            i++;
+            break;
+        }
+        QStringList fields = line.split(" > ");
+        if (fields.count() < 3)
+            continue;
+        Item item;
+        item.ingredient = Ingredient(fields.at(0), fields.at(1).toInt());
+        item.mass = fields.at(2);
+        recipe.items.append(item);
+    }
+    QStringList instr = lines.mid(i);
+    if (!instr.isEmpty() && instr.last().isEmpty())
+        instr.removeLast();
+    recipe.instructions = instr.join('\n');
+    return recipe;
+}
+
+bool Recipe::read(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    QTextStream reader(&file);
+    reader.setCodec(QTextCodec::codecForName("UTF-8"));
+    *this = fromText(reader.readAll());
+    return true;
+}
+
+bool Recipe::write(const QString &fileName, const QHash<int, QString> &names) const {
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QFile::Text))
+        return false;
+    QTextStream data(&file);
+    data.setCodec(QTextCodec::codecForName("UTF-8"));
+    data.setGenerateByteOrderMark(true);
+    data << toText(names);
+    data.flush();
+    if (data.status() != QTextStream::Ok)
+        return false;
+    return file.commit();
+}
@@ -0,0 +1,45 @@
+#ifndef RECIPE_H
+#define RECIPE_H
+
+#include "ingredient.h"
+#include <QHash>
+#include <QList>
+#include <QString>
+
+class Recipe {
+public:
+    struct Item {
+        Ingredient ingredient;
+        QString mass;
+    };
+
+    QList<Item> items {};
+    QString instructions {};
+
+    bool isEmpty() const { return items.isEmpty(); }
+    double totalCalories() const;
+    int totalMass() const;
+    // names replaces the names of the items at its indexes, for names
+    // still being typed that are not interned yet
+    QString toText(const QHash<int, QString> &names = QHash<int, QString>()) const;
+    QString toHtml(const QString &title) const;
+    bool read(const QString &fileName);
+    bool write(const QString &fileName, const QHash<int, QString> &names = QHash<int, QString>()) const;
+
+    static Recipe fromText(const QString &text);
+};
+
+inline bool operator==(const Recipe::Item &lhs, const Recipe::Item &rhs) {
+    return lhs.ingredient.nameId() == rhs.ingredient.nameId() &&
+            lhs.ingredient.calories() == rhs.ingredient.calories() && lhs.mass == rhs.mass;
+}
+
+inline bool operator==(const Recipe &lhs, const Recipe &rhs) {
+    return lhs.items == rhs.items && lhs.instructions == rhs.instructions;
+}
+
+inline bool operator!=(const Recipe &lhs, const Recipe &rhs) { return !(lhs == rhs); }
+
+Q_DECLARE_TYPEINFO(Recipe::Item, Q_MOVABLE_TYPE);
+
+#endif // RECIPE_H
@@ -0,0 +1,366 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recipearchive.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QObject>
+#include <QSaveFile>
+
+static const quint32 Magic {0x4E435241};  // "NCRA"
+static const quint32 Version {1};
+static const qint64 HeaderSize {24};
+static const quint8 Deleted {0x01};
+static const int LockTimeout {5000};            // ms to wait for another writer
+static const int StaleLockTime {15000};         // ms
+static const qint64 MinDeadBytes {1024 * 1024};  // compacted past this much
+
+const QString RecipeArchive::suffix {"rca"};
+
+RecipeArchive::RecipeArchive(const QString &fileName) : _fileName(fileName) {}
+
+bool RecipeArchive::isArchive(const QString &fileName) {
+    return QFileInfo(fileName).suffix() == suffix;
+}
+
+// Recipes inside an archive are addressed as "<archive>.rca#<name>".
+QString RecipeArchive::location(const QString &fileName, const QString &name) {
+    return fileName + '#' + name;
+}
+
+bool RecipeArchive::isLocation(const QString &location) {
+    return location.contains('.' + suffix + '#');
+}
+
+bool RecipeArchive::splitLocation(const QString &location, QString *fileName, QString *name) {
+    int pos = location.indexOf('.' + suffix + '#');
+    if (pos < 0)
+        return false;
+    pos += suffix.size() + 1;
+    *fileName = location.left(pos);
+    *name = location.mid(pos + 1);
+    return true;
+}
+
+// Reads the header and the whole index in one sequential read; the recipe
+// blocks themselves are only touched by read().
+bool RecipeArchive::open() {
+    QMutexLocker locker(&mutex);
+    return load();
+}
+
+bool RecipeArchive::load() {
+    entries.clear();
+    byName.clear();
+    byId.clear();
+    file.close();
+    file.setFileName(_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        _errorString = file.errorString();
+        return false;
+    }
+    QDataStream header(&file);
+    header.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version, entryCount;
+    quint64 indexOffset;
+    header >> magic >> version >> indexOffset >> entryCount >> nextId;
+    if (header.status() != QDataStream::Ok || magic != Magic || version != Version) {
+        _errorString = QObject::tr("Μη έγκυρο αρχείο συλλογής: %1").arg(_fileName);
+        return false;
+    }
+    if (!file.seek(indexOffset)) {
+        _errorString = file.errorString();
+        return false;
+    }
+    QByteArray index = file.readAll();
+    QDataStream in(index);
+    in.setVersion(QDataStream::Qt_5_0);
+    entries.reserve(entryCount);
+    for (quint32 i = 0; i < entryCount; i++) {
+        Entry entry;
+        quint8 flags;
+        in >> entry.id;
+        entry.flagPos = indexOffset + in.device()->pos();
+        in >> flags >> entry.offset >> entry.size >> entry.name;
+        if (in.status() != QDataStream::Ok) {
+            _errorString = QObject::tr("Κατεστραμμένο ευρετήριο στο αρχείο %1").arg(_fileName);
+            return false;
+        }
+        entry.deleted = flags & Deleted;
+        byId.insert(entry.id, entries.count());
+        if (!entry.deleted)
+            byName.insert(entry.name, entries.count());
+        entries.append(entry);
+    }
+    return true;
+}
+
+// Writers of the same archive in other instances are kept out by a lock
+// file next to it. Once it is held the index is read again, so that the
+// change is made against what is on disk and not against an older open().
+bool RecipeArchive::lockForWrite(QLockFile *lock) {
+    lock->setStaleLockTime(StaleLockTime);
+    if (!lock->tryLock(LockTimeout)) {
+        _errorString = QObject::tr("Το αρχείο συλλογής %1 χρησιμοποιείται από άλλο παράθυρο").arg(_fileName);
+        return false;
+    }
+    QFileInfo info(_fileName);
+    if (!info.exists() || info.size() < HeaderSize) {
+        entries.clear();
+        byName.clear();
+        byId.clear();
+        return true;
+    }
+    return load();
+}
+
+// Makes live, which holds no deleted entries, the tables of the archive.
+void RecipeArchive::adopt(QList<Entry> *live) {
+    entries.swap(*live);
+    byName.clear();
+    byId.clear();
+    for (int i = 0; i < entries.count(); i++) {
+        byId.insert(entries.at(i).id, i);
+        byName.insert(entries.at(i).name, i);
+    }
+}
+
+QStringList RecipeArchive::names() const {
+    QStringList list;
+    list.reserve(byName.count());
+    for (auto &&entry : entries)
+        if (!entry.deleted)
+            list.append(entry.name);
+    return list;
+}
+
+bool RecipeArchive::read(const QString &name, Recipe *recipe) const {
+    int i = byName.value(name, -1);
+    if (i < 0) {
+        _errorString = QObject::tr("Η συνταγή %1 δεν υπάρχει στη συλλογή").arg(name);
+        return false;
+    }
+    return readBlock(entries.at(i), recipe);
+}
+
+bool RecipeArchive::read(quint32 id, Recipe *recipe) const {
+    int i = byId.value(id, -1);
+    if (i < 0 || entries.at(i).deleted) {
+        _errorString = QObject::tr("Η συνταγή %1 δεν υπάρχει στη συλλογή").arg(id);
+        return false;
+    }
+    return readBlock(entries.at(i), recipe);
+}
+
+bool RecipeArchive::readBlock(const Entry &entry, Recipe *recipe) const {
+    QByteArray data;
+    {
+        QMutexLocker locker(&mutex);
+        if (!file.isOpen() || !file.seek(entry.offset)) {
+            _errorString = file.errorString();
+            return false;
+        }
+        data = file.read(entry.size);
+    }
+    if (data.size() != static_cast<int>(entry.size)) {
+        _errorString = QObject::tr("Κατεστραμμένο αρχείο συλλογής: %1").arg(_fileName);
+        return false;
+    }
+    *recipe = Recipe::fromText(QString::fromUtf8(qUncompress(data)));
+    return true;
+}
+
+QByteArray RecipeArchive::buildIndex(QList<Entry> *indexed, qint64 indexOffset) const {
+    QByteArray index;
+    QDataStream out(&index, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    for (auto &entry : *indexed) {
+        out << entry.id;
+        entry.flagPos = indexOffset + out.device()->pos();
+        out << static_cast<quint8>(entry.deleted ? Deleted : 0) << entry.offset << entry.size << entry.name;
+    }
+    return index;
+}
+
+bool RecipeArchive::writeHeader(QFileDevice &out, quint64 indexOffset, int count) const {
+    if (!out.seek(0))
+        return false;
+    QDataStream header(&out);
+    header.setVersion(QDataStream::Qt_5_0);
+    header << Magic << Version << indexOffset << static_cast<quint32>(count) << nextId;
+    return header.status() == QDataStream::Ok;
+}
+
+// Adds the given recipes in one batch. A recipe whose name is already in
+// the archive replaces it. Replaced and removed entries are left out of
+// the new index; their blocks, and the indexes the new one supersedes,
+// are dead bytes until the archive is compacted, which happens here once
+// they outweigh the live blocks.
+bool RecipeArchive::append(const QList<QPair<QString, Recipe>> &recipes) {
+    QMutexLocker locker(&mutex);
+    QLockFile lock(_fileName + ".lock");
+    if (!lockForWrite(&lock))
+        return false;
+    QFile out(_fileName);
+    bool fresh = !out.exists() || out.size() < HeaderSize;
+    if (!out.open(QIODevice::ReadWrite)) {
+        _errorString = out.errorString();
+        return false;
+    }
+    if (fresh) {
+        out.resize(0);
+        if (!writeHeader(out, HeaderSize, 0)) {
+            _errorString = out.errorString();
+            return false;
+        }
+    }
+    qint64 pos = out.size();
+    if (!out.seek(pos)) {
+        _errorString = out.errorString();
+        return false;
+    }
+    QList<Entry> updated = entries;
+    QHash<QString, int> names = byName;
+    quint32 id = nextId;
+    for (auto &&pair : recipes) {
+        int old = names.value(pair.first, -1);
+        if (old >= 0)
+            updated[old].deleted = true;
+        QByteArray data = qCompress(pair.second.toText().toUtf8());
+        if (out.write(data) != data.size()) {
+            _errorString = out.errorString();
+            return false;
+        }
+        Entry entry;
+        entry.id = id++;
+        entry.name = pair.first;
+        entry.offset = pos;
+        entry.size = data.size();
+        entry.deleted = false;
+        entry.flagPos = 0;
+        names.insert(entry.name, updated.count());
+        updated.append(entry);
+        pos += data.size();
+    }
+    QList<Entry> live;
+    qint64 liveBytes {0};
+    for (auto &&entry : updated)
+        if (!entry.deleted) {
+            live.append(entry);
+            liveBytes += entry.size;
+        }
+    quint32 previousId = nextId;
+    nextId = id;
+    QByteArray index = buildIndex(&live, pos);
+    if (out.write(index) != index.size() || !out.flush() || !writeHeader(out, pos, live.count()) || !out.flush()) {
+        _errorString = out.errorString();
+        nextId = previousId;
+        return false;
+    }
+    out.close();
+    adopt(&live);
+    if (!file.isOpen()) {
+        file.setFileName(_fileName);
+        file.open(QIODevice::ReadOnly);
+    }
+    qint64 dead = pos - HeaderSize - liveBytes;
+    if (dead > qMax(MinDeadBytes, liveBytes) && !rewrite())
+        qWarning() << "RecipeArchive: cannot compact" << _fileName << _errorString;
+    return true;
+}
+
+bool RecipeArchive::remove(const QString &name) {
+    QMutexLocker locker(&mutex);
+    QLockFile lock(_fileName + ".lock");
+    if (!lockForWrite(&lock))
+        return false;
+    int i = byName.value(name, -1);
+    if (i < 0)
+        return false;
+    QFile out(_fileName);
+    if (!out.open(QIODevice::ReadWrite) || !out.seek(entries.at(i).flagPos)) {
+        _errorString = out.errorString();
+        return false;
+    }
+    char flag = Deleted;
+    if (out.write(&flag, 1) != 1) {
+        _errorString = out.errorString();
+        return false;
+    }
+    entries[i].deleted = true;
+    byName.remove(name);
+    return true;
+}
+
+// Rewrites the archive without tombstoned blocks and stale indexes. Blocks
+// are copied as they are, without being decompressed. The tables change
+// only once the new file is in place, so a failure leaves them describing
+// the old one.
+bool RecipeArchive::compact() {
+    QMutexLocker locker(&mutex);
+    QLockFile lock(_fileName + ".lock");
+    return lockForWrite(&lock) && rewrite();
+}
+
+bool RecipeArchive::rewrite() {
+    if (!file.isOpen()) {
+        _errorString = QObject::tr("Το αρχείο συλλογής δεν είναι ανοιχτό");
+        return false;
+    }
+    QSaveFile out(_fileName);
+    if (!out.open(QIODevice::WriteOnly) || !writeHeader(out, HeaderSize, 0)) {
+        _errorString = out.errorString();
+        return false;
+    }
+    QList<Entry> live;
+    qint64 pos = HeaderSize;
+    for (auto &&entry : entries) {
+        if (entry.deleted)
+            continue;
+        if (!file.seek(entry.offset)) {
+            _errorString = file.errorString();
+            return false;
+        }
+        QByteArray data = file.read(entry.size);
+        if (out.write(data) != data.size()) {
+            _errorString = out.errorString();
+            return false;
+        }
+        Entry moved = entry;
+        moved.offset = pos;
+        live.append(moved);
+        pos += data.size();
+    }
+    QByteArray index = buildIndex(&live, pos);
+    if (out.write(index) != index.size() || !writeHeader(out, pos, live.count())) {
+        _errorString = out.errorString();
+        return false;
+    }
+    file.close();
+    bool ok = out.commit();
+    if (!ok)
+        _errorString = out.errorString();
+    file.open(QIODevice::ReadOnly);
+    if (!ok)
+        return false;
+    adopt(&live);
+    return true;
+}
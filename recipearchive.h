@@ -0,0 +1,69 @@
+#ifndef RECIPEARCHIVE_H
+#define RECIPEARCHIVE_H
+
+#include "recipe.h"
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+
+class QLockFile;
+
+/* Many recipes packed in one file:
+ *   header  magic, version, index offset, entry count, next id
+ *   blocks  qCompress()ed .rcp text, one per recipe, appended over time
+ *   index   id, flags, block offset, block size and name of every entry
+ * The index is always written last, after the new blocks, and only then is
+ * the header pointed at it, so an interrupted append leaves the previous
+ * index valid. Removing a recipe flips its deleted flag inside the index;
+ * the next append leaves it out. Writers hold <archive>.lock. */
+class RecipeArchive {
+public:
+    struct Entry {
+        quint32 id;
+        QString name;
+        quint64 offset;
+        quint32 size;
+        bool deleted;
+        qint64 flagPos;
+    };
+
+    explicit RecipeArchive(const QString &fileName);
+    bool open();
+    QString fileName() const { return _fileName; }
+    QString errorString() const { return _errorString; }
+    QStringList names() const;
+    int count() const { return byName.count(); }
+    bool contains(const QString &name) const { return byName.contains(name); }
+    bool read(const QString &name, Recipe *recipe) const;
+    bool read(quint32 id, Recipe *recipe) const;
+    bool append(const QList<QPair<QString, Recipe>> &recipes);
+    bool remove(const QString &name);
+    bool compact();
+
+    static bool isArchive(const QString &fileName);
+    static bool isLocation(const QString &location);
+    static QString location(const QString &fileName, const QString &name);
+    static bool splitLocation(const QString &location, QString *fileName, QString *name);
+    static const QString suffix;
+
+private:
+    bool load();
+    bool lockForWrite(QLockFile *lock);
+    void adopt(QList<Entry> *live);
+    bool rewrite();
+    bool readBlock(const Entry &entry, Recipe *recipe) const;
+    QByteArray buildIndex(QList<Entry> *indexed, qint64 indexOffset) const;
+    bool writeHeader(QFileDevice &out, quint64 indexOffset, int count) const;
+    QString _fileName;
+    mutable QString _errorString;
+    mutable QFile file;
+    mutable QMutex mutex;
+    QList<Entry> entries {};
+    QHash<QString, int> byName {};
+    QHash<quint32, int> byId {};
+    quint32 nextId { 1 };
+};
+
+#endif // RECIPEARCHIVE_H
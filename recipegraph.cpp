@@ -0,0 +1,204 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recipegraph.h"
+#include "recipearchive.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QObject>
+
+namespace {
+    // the file whose modification time covers a location
+    QString fileOf(const QString &location) {
+        QString archiveName, name;
+        return RecipeArchive::splitLocation(location, &archiveName, &name) ? archiveName : location;
+    }
+
+    qint64 stampOf(const QString &location) {
+        QFileInfo info(fileOf(location));
+        return info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+    }
+
+    bool readRecipe(const QString &location, Recipe *recipe) {
+        QString archiveName, name;
+        if (RecipeArchive::splitLocation(location, &archiveName, &name)) {
+            RecipeArchive archive(archiveName);
+            return archive.open() && archive.read(name, recipe);
+        }
+        return recipe->read(location);
+    }
+}
+
+RecipeGraph &RecipeGraph::instance() {
+    static RecipeGraph graph;
+    return graph;
+}
+
+// The ingredient name under which from refers to location.
+QString RecipeGraph::reference(const QString &location, const QString &from) {
+    QDir dir = QFileInfo(fileOf(from)).absoluteDir();
+    QString archiveName, name;
+    if (RecipeArchive::splitLocation(location, &archiveName, &name))
+        return '@' + RecipeArchive::location(dir.relativeFilePath(archiveName), name);
+    return '@' + dir.relativeFilePath(location);
+}
+
+QString RecipeGraph::resolve(const QString &name, const QString &from) {
+    QString target = name.mid(1).trimmed();
+    QDir dir = QFileInfo(fileOf(from)).absoluteDir();
+    QString archiveName, entry;
+    if (RecipeArchive::splitLocation(target, &archiveName, &entry))
+        return RecipeArchive::location(QDir::cleanPath(dir.absoluteFilePath(archiveName)), entry);
+    return QDir::cleanPath(dir.absoluteFilePath(target));
+}
+
+QString RecipeGraph::errorString() const {
+    QMutexLocker locker(&mutex);
+    return _errorString;
+}
+
+bool RecipeGraph::evaluate(const QString &location, double *kcalPer100g) {
+    QMutexLocker locker(&mutex);
+    QStringList path;
+    return visit(location, &path, kcalPer100g);
+}
+
+// Replaces the calories of the sub-recipe ingredients of a recipe read
+// from location with their current values.
+bool RecipeGraph::update(Recipe *recipe, const QString &location) {
+    QMutexLocker locker(&mutex);
+    QStringList path(QDir::cleanPath(location));
+    return updateItems(recipe, location, &path);
+}
+
+// True when location depends on other, directly or through sub-recipes;
+// adding other to location would then close a cycle.
+bool RecipeGraph::uses(const QString &location, const QString &other) {
+    double value;
+    if (!evaluate(location, &value))
+        return false;
+    QMutexLocker locker(&mutex);
+    QStringList pending(location);
+    QSet<QString> seen;
+    while (!pending.isEmpty()) {
+        QString current = pending.takeLast();
+        if (current == other)
+            return true;
+        if (seen.contains(current))
+            continue;
+        seen.insert(current);
+        pending += nodes.value(current).uses;
+    }
+    return false;
+}
+
+void RecipeGraph::invalidate(const QString &location) {
+    QMutexLocker locker(&mutex);
+    drop(QDir::cleanPath(location));
+}
+
+// Forgets location and, transitively, every recipe that used it.
+void RecipeGraph::drop(const QString &location) {
+    QStringList pending(location);
+    while (!pending.isEmpty()) {
+        QString current = pending.takeLast();
+        auto it = nodes.find(current);
+        if (it != nodes.end()) {
+            for (auto &&used : it->uses)
+                usedBy[used].remove(current);
+            nodes.erase(it);
+        }
+        pending += usedBy.take(current).values();
+    }
+}
+
+bool RecipeGraph::updateItems(Recipe *recipe, const QString &location, QStringList *path) {
+    for (auto &&item : recipe->items) {
+        if (!isReference(item.ingredient.name()))
+            continue;
+        double value;
+        if (!visit(resolve(item.ingredient.name(), location), path, &value))
+            return false;
+        item.ingredient.setCalories(qRound(value));
+    }
+    return true;
+}
+
+// Depth-first over the sub-recipes; path holds the recipes being evaluated
+// further up, so meeting one of them again is a cycle.
+bool RecipeGraph::visit(const QString &location, QStringList *path, double *kcalPer100g) {
+    QString key = QDir::cleanPath(location);
+    int onPath = path->indexOf(key);
+    if (onPath >= 0) {
+        QStringList cycle = path->mid(onPath) << key;
+        for (auto &&step : cycle)
+            step = QFileInfo(fileOf(step)).fileName();
+        _errorString = QObject::tr("Κυκλική αναφορά συνταγών: %1").arg(cycle.join(" → "));
+        return false;
+    }
+
+    qint64 stamp = stampOf(key);
+    auto it = nodes.constFind(key);
+    if (it != nodes.constEnd()) {
+        if (it->stamp != stamp) {
+            drop(key);
+        } else {
+            // a used recipe that changed drops this node on the way
+            path->append(key);
+            QStringList used = it->uses;
+            bool ok = true;
+            double unused;
+            for (int i = 0; ok && i < used.count(); i++)
+                ok = visit(used.at(i), path, &unused);
+            path->removeLast();
+            if (!ok)
+                return false;
+            it = nodes.constFind(key);
+            if (it != nodes.constEnd()) {
+                *kcalPer100g = it->kcalPer100g;
+                return true;
+            }
+        }
+    }
+
+    Recipe recipe;
+    if (stamp < 0 || !readRecipe(key, &recipe)) {
+        _errorString = QObject::tr("Η συνταγή %1 δεν βρέθηκε").arg(key);
+        return false;
+    }
+    path->append(key);
+    bool ok = updateItems(&recipe, key, path);
+    path->removeLast();
+    if (!ok)
+        return false;
+
+    Node node;
+    for (auto &&item : recipe.items)
+        if (isReference(item.ingredient.name())) {
+            QString used = resolve(item.ingredient.name(), key);
+            node.uses.append(used);
+            usedBy[used].insert(key);
+        }
+    int mass = recipe.totalMass();
+    node.kcalPer100g = mass ? recipe.totalCalories() * 100 / mass : 0;
+    node.stamp = stamp;
+    nodes.insert(key, node);
+    *kcalPer100g = node.kcalPer100g;
+    return true;
+}
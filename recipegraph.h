@@ -0,0 +1,50 @@
+#ifndef RECIPEGRAPH_H
+#define RECIPEGRAPH_H
+
+#include "recipe.h"
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+
+/* Recipes used as ingredients of other recipes. Such an ingredient is
+ * named "@" followed by the path of the sub-recipe, relative to the recipe
+ * that uses it (an archive entry is "@file.rca#name"); its kcal/100g is
+ * derived from the sub-recipe instead of being typed in.
+ *
+ * Evaluated values are memoized per recipe along with the modification
+ * time they were computed from and the recipes they used. When a recipe
+ * changes, it and everything that uses it, directly or not, is dropped and
+ * recomputed on the next request; unrelated recipes keep their values. */
+class RecipeGraph {
+public:
+    static RecipeGraph &instance();
+
+    static bool isReference(const QString &name) { return name.startsWith('@'); }
+    static QString reference(const QString &location, const QString &from);
+    static QString resolve(const QString &name, const QString &from);
+
+    bool evaluate(const QString &location, double *kcalPer100g);
+    bool update(Recipe *recipe, const QString &location);
+    bool uses(const QString &location, const QString &other);
+    void invalidate(const QString &location);
+    QString errorString() const;
+
+private:
+    struct Node {
+        double kcalPer100g;
+        qint64 stamp;
+        QStringList uses;
+    };
+
+    RecipeGraph() {}
+    bool visit(const QString &location, QStringList *path, double *kcalPer100g);
+    bool updateItems(Recipe *recipe, const QString &location, QStringList *path);
+    void drop(const QString &location);
+    QHash<QString, Node> nodes {};
+    QHash<QString, QSet<QString>> usedBy {};
+    QString _errorString {};
+    mutable QMutex mutex;
+};
+
+#endif // RECIPEGRAPH_H
@@ -0,0 +1,376 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recipehistory.h"
+#include "recipearchive.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QStandardPaths>
+#include <QVector>
+
+static const quint32 Magic {0x4E435248};  // "NCRH"
+static const quint32 Version {1};
+static const quint8 Checkpoint {0};
+static const quint8 Delta {1};
+
+enum Op : quint8 { Keep, Mass, Skip, Insert };
+
+namespace {
+    struct Changes {
+        int added {0};
+        int removed {0};
+        int changed {0};
+        bool instructions {false};
+    };
+
+    bool sameIngredient(const Recipe::Item &a, const Recipe::Item &b) {
+        return a.ingredient.nameId() == b.ingredient.nameId() &&
+                a.ingredient.calories() == b.ingredient.calories();
+    }
+
+    // Edit script from one revision to the next. Unchanged items at both
+    // ends are only counted; the middle is aligned on ingredient identity
+    // (longest common subsequence), so a changed mass is a single op.
+    QByteArray diff(const Recipe &from, const Recipe &to, Changes *changes) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+
+        const auto &a = from.items;
+        const auto &b = to.items;
+        int prefix = 0;
+        while (prefix < a.size() && prefix < b.size() && a.at(prefix) == b.at(prefix))
+            prefix++;
+        int suffix = 0;
+        while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+               a.at(a.size() - 1 - suffix) == b.at(b.size() - 1 - suffix))
+            suffix++;
+        int n = a.size() - prefix - suffix;
+        int m = b.size() - prefix - suffix;
+
+        QVector<int> lcs((n + 1) * (m + 1), 0);
+        auto at = [&](int i, int j) -> int & { return lcs[i * (m + 1) + j]; };
+        for (int i = n - 1; i >= 0; i--)
+            for (int j = m - 1; j >= 0; j--)
+                at(i, j) = sameIngredient(a.at(prefix + i), b.at(prefix + j))
+                        ? at(i + 1, j + 1) + 1 : qMax(at(i + 1, j), at(i, j + 1));
+
+        QByteArray ops;
+        QDataStream opOut(&ops, QIODevice::WriteOnly);
+        opOut.setVersion(QDataStream::Qt_5_0);
+        quint32 opCount {0};
+        quint32 kept {0};
+        auto flushKept = [&]() {
+            if (kept) {
+                opOut << quint8(Keep) << kept;
+                opCount++;
+                kept = 0;
+            }
+        };
+        int i = 0, j = 0;
+        while (i < n || j < m) {
+            if (i < n && j < m && sameIngredient(a.at(prefix + i), b.at(prefix + j)) && at(i, j) == at(i + 1, j + 1) + 1) {
+                if (a.at(prefix + i).mass == b.at(prefix + j).mass) {
+                    kept++;
+                } else {
+                    flushKept();
+                    opOut << quint8(Mass) << b.at(prefix + j).mass;
+                    opCount++;
+                    changes->changed++;
+                }
+                i++;
+                j++;
+            } else if (i < n && (j == m || at(i + 1, j) >= at(i, j + 1))) {
+                flushKept();
+                opOut << quint8(Skip) << quint32(1);
+                opCount++;
+                changes->removed++;
+                i++;
+            } else {
+                flushKept();
+                const auto &item = b.at(prefix + j);
+                opOut << quint8(Insert) << item.ingredient.name() << qint32(item.ingredient.calories()) << item.mass;
+                opCount++;
+                changes->added++;
+                j++;
+            }
+        }
+        flushKept();
+        out << quint32(prefix) << quint32(suffix) << opCount;
+        out.writeRawData(ops.constData(), ops.size());
+
+        changes->instructions = from.instructions != to.instructions;
+        out << quint8(changes->instructions);
+        if (changes->instructions) {
+            QStringList oldLines = from.instructions.split('\n');
+            QStringList newLines = to.instructions.split('\n');
+            int first = 0;
+            while (first < oldLines.size() && first < newLines.size() && oldLines.at(first) == newLines.at(first))
+                first++;
+            int last = 0;
+            while (last < oldLines.size() - first && last < newLines.size() - first &&
+                   oldLines.at(oldLines.size() - 1 - last) == newLines.at(newLines.size() - 1 - last))
+                last++;
+            out << quint32(first) << quint32(last) << newLines.mid(first, newLines.size() - first - last);
+        }
+        return payload;
+    }
+
+    bool patch(const Recipe &from, const QByteArray &payload, Recipe *to) {
+        QDataStream in(payload);
+        in.setVersion(QDataStream::Qt_5_0);
+        quint32 prefix, suffix, opCount;
+        in >> prefix >> suffix >> opCount;
+        const auto &a = from.items;
+        if (in.status() != QDataStream::Ok || prefix + suffix > quint32(a.size()))
+            return false;
+
+        Recipe result;
+        result.items = a.mid(0, prefix);
+        int k = prefix;
+        int end = a.size() - suffix;
+        for (quint32 op = 0; op < opCount; op++) {
+            quint8 kind;
+            in >> kind;
+            if (kind == Keep || kind == Skip) {
+                quint32 count;
+                in >> count;
+                if (k + int(count) > end)
+                    return false;
+                if (kind == Keep)
+                    result.items.append(a.mid(k, count));
+                k += count;
+            } else if (kind == Mass) {
+                Recipe::Item item = k < end ? a.at(k++) : Recipe::Item();
+                in >> item.mass;
+                result.items.append(item);
+            } else if (kind == Insert) {
+                QString name, mass;
+                qint32 calories;
+                in >> name >> calories >> mass;
+                Recipe::Item item;
+                item.ingredient = Ingredient(name, calories);
+                item.mass = mass;
+                result.items.append(item);
+            } else {
+                return false;
+            }
+        }
+        result.items.append(a.mid(end));
+
+        quint8 instructionsChanged;
+        in >> instructionsChanged;
+        result.instructions = from.instructions;
+        if (instructionsChanged) {
+            quint32 first, last;
+            QStringList middle;
+            in >> first >> last >> middle;
+            QStringList lines = from.instructions.split('\n');
+            if (first + last > quint32(lines.size()))
+                return false;
+            result.instructions = (lines.mid(0, first) + middle + lines.mid(lines.size() - last)).join('\n');
+        }
+        if (in.status() != QDataStream::Ok)
+            return false;
+        *to = result;
+        return true;
+    }
+}
+
+RecipeHistory::RecipeHistory(const QString &location)
+    : _location(location), _fileName(fileNameFor(location)) {}
+
+// One file per recipe, named after a hash of its absolute location so that
+// archive entries ("<archive>.rca#<name>") get their own history too.
+QString RecipeHistory::fileNameFor(const QString &location) {
+    QString archiveName, name, key;
+    if (RecipeArchive::splitLocation(location, &archiveName, &name))
+        key = RecipeArchive::location(QFileInfo(archiveName).absoluteFilePath(), name);
+    else
+        key = QFileInfo(location).absoluteFilePath();
+    QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(20);
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/history/" + hash + ".rhs";
+}
+
+// Reads only the record headers; payloads are fetched when a revision is
+// rebuilt. A record cut short by a crash ends the list and is overwritten
+// by the next record().
+bool RecipeHistory::load() {
+    _revisions.clear();
+    validSize = 0;
+    cachedRevision = -1;
+    QFile file(_fileName);
+    if (!file.exists())
+        return true;
+    if (!file.open(QIODevice::ReadOnly)) {
+        _errorString = file.errorString();
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    QString location;
+    in >> magic >> version >> location;
+    if (in.status() != QDataStream::Ok || magic != Magic || version != Version) {
+        _errorString = QObject::tr("Μη έγκυρο αρχείο ιστορικού: %1").arg(_fileName);
+        return false;
+    }
+    validSize = file.pos();
+    while (!in.atEnd()) {
+        quint8 kind, instructions;
+        qint64 msecs;
+        quint16 added, removed, changed;
+        quint32 size;
+        in >> kind >> msecs >> added >> removed >> changed >> instructions >> size;
+        if (in.status() != QDataStream::Ok || file.pos() + size > file.size())
+            break;
+        Revision revision;
+        revision.offset = file.pos();
+        revision.time = QDateTime::fromMSecsSinceEpoch(msecs);
+        revision.checkpoint = kind == Checkpoint;
+        revision.added = added;
+        revision.removed = removed;
+        revision.changed = changed;
+        revision.instructions = instructions;
+        if (_revisions.isEmpty() && !revision.checkpoint)
+            break;
+        if (!file.seek(revision.offset + size))
+            break;
+        _revisions.append(revision);
+        validSize = file.pos();
+    }
+    return true;
+}
+
+bool RecipeHistory::readPayload(const Revision &revision, QByteArray *payload) const {
+    QFile file(_fileName);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(revision.offset - qint64(sizeof(quint32)))) {
+        _errorString = file.errorString();
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 size;
+    in >> size;
+    *payload = file.read(size);
+    return payload->size() == int(size);
+}
+
+bool RecipeHistory::recipeAt(int revision, Recipe *recipe) const {
+    if (revision < 0 || revision >= _revisions.size())
+        return false;
+    if (revision == cachedRevision) {
+        *recipe = cachedRecipe;
+        return true;
+    }
+    // replay from the cached revision when it is on the way, else from the
+    // nearest checkpoint
+    int start = revision;
+    while (!_revisions.at(start).checkpoint)
+        start--;
+    Recipe current;
+    if (cachedRevision >= start && cachedRevision < revision) {
+        current = cachedRecipe;
+        start = cachedRevision + 1;
+    } else {
+        QByteArray payload;
+        if (!readPayload(_revisions.at(start), &payload))
+            return false;
+        current = Recipe::fromText(QString::fromUtf8(qUncompress(payload)));
+        start++;
+    }
+    for (int i = start; i <= revision; i++) {
+        QByteArray payload;
+        if (!readPayload(_revisions.at(i), &payload) || !patch(current, payload, &current)) {
+            _errorString = QObject::tr("Κατεστραμμένο ιστορικό: %1").arg(_fileName);
+            return false;
+        }
+    }
+    cachedRevision = revision;
+    cachedRecipe = current;
+    *recipe = current;
+    return true;
+}
+
+// Appends the recipe as a new revision unless it equals the latest one.
+bool RecipeHistory::record(const Recipe &recipe) {
+    Recipe previous;
+    bool hasPrevious = !_revisions.isEmpty();
+    if (hasPrevious) {
+        if (!recipeAt(_revisions.size() - 1, &previous))
+            return false;
+        if (previous == recipe)
+            return true;
+    }
+
+    Changes changes;
+    QByteArray payload = diff(previous, recipe, &changes);
+    int sinceCheckpoint = 0;
+    for (int i = _revisions.size() - 1; i >= 0 && !_revisions.at(i).checkpoint; i--)
+        sinceCheckpoint++;
+    bool checkpoint = !hasPrevious || sinceCheckpoint + 1 >= checkpointInterval;
+    QByteArray full;
+    if (!checkpoint) {
+        full = qCompress(recipe.toText().toUtf8());
+        checkpoint = payload.size() >= full.size();
+    }
+    if (checkpoint)
+        payload = full.isEmpty() ? qCompress(recipe.toText().toUtf8()) : full;
+
+    QDir().mkpath(QFileInfo(_fileName).path());
+    QFile file(_fileName);
+    if (!file.open(QIODevice::ReadWrite)) {
+        _errorString = file.errorString();
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    if (!validSize) {
+        file.resize(0);
+        out << Magic << Version << _location;
+        validSize = file.pos();
+    }
+    file.resize(validSize);
+    file.seek(validSize);
+
+    Revision revision;
+    revision.time = QDateTime::currentDateTime();
+    revision.checkpoint = checkpoint;
+    revision.added = changes.added;
+    revision.removed = changes.removed;
+    revision.changed = changes.changed;
+    revision.instructions = changes.instructions;
+    out << (checkpoint ? Checkpoint : Delta) << revision.time.toMSecsSinceEpoch()
+        << quint16(qMin(changes.added, 0xFFFF)) << quint16(qMin(changes.removed, 0xFFFF))
+        << quint16(qMin(changes.changed, 0xFFFF)) << quint8(changes.instructions) << quint32(payload.size());
+    revision.offset = file.pos();
+    out.writeRawData(payload.constData(), payload.size());
+    if (out.status() != QDataStream::Ok || !file.flush()) {
+        _errorString = file.errorString();
+        return false;
+    }
+    validSize = file.pos();
+    _revisions.append(revision);
+    cachedRevision = _revisions.size() - 1;
+    cachedRecipe = recipe;
+    return true;
+}
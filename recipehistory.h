@@ -0,0 +1,50 @@
+#ifndef RECIPEHISTORY_H
+#define RECIPEHISTORY_H
+
+#include "recipe.h"
+#include <QDateTime>
+#include <QList>
+
+/* Saved revisions of one recipe, kept in <AppData>/history:
+ *   header   magic, version, recipe location
+ *   records  kind, time, change counts, payload size, payload
+ * A checkpoint record holds the whole recipe; a delta record holds only the
+ * edits against the revision before it (kept, re-massed, dropped and new
+ * ingredients, plus the changed run of instruction lines). A checkpoint is
+ * written every checkpointInterval revisions, so rebuilding any revision
+ * replays at most that many deltas. */
+class RecipeHistory {
+public:
+    struct Revision {
+        qint64 offset;
+        QDateTime time;
+        bool checkpoint;
+        int added;
+        int removed;
+        int changed;
+        bool instructions;
+    };
+
+    explicit RecipeHistory(const QString &location);
+    bool load();
+    QString location() const { return _location; }
+    QString errorString() const { return _errorString; }
+    const QList<Revision> &revisions() const { return _revisions; }
+    bool recipeAt(int revision, Recipe *recipe) const;
+    bool record(const Recipe &recipe);
+
+    static QString fileNameFor(const QString &location);
+    static const int checkpointInterval {16};
+
+private:
+    bool readPayload(const Revision &revision, QByteArray *payload) const;
+    QString _location;
+    QString _fileName;
+    mutable QString _errorString;
+    QList<Revision> _revisions {};
+    qint64 validSize { 0 };
+    mutable int cachedRevision { -1 };
+    mutable Recipe cachedRecipe;
+};
+
+#endif // RECIPEHISTORY_H
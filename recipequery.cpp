@@ -0,0 +1,357 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recipequery.h"
+#include "catalog.h"
+#include <QObject>
+
+namespace {
+    enum Op { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+
+    // Sets the bits of the rows in [begin, begin + bits->size()) whose value
+    // compares true; the operator is chosen once per column scan. Equality
+    // takes the nearest whole value, as the page shows them.
+    template <typename T>
+    void compare(const QVector<T> &column, Op op, double value, int begin, QBitArray *bits) {
+        const T *row = column.constData() + begin;
+        const int n = bits->size();
+        switch (op) {
+        case Less:
+            for (int i = 0; i < n; i++)
+                if (row[i] < value)
+                    bits->setBit(i);
+            break;
+        case LessEqual:
+            for (int i = 0; i < n; i++)
+                if (row[i] <= value)
+                    bits->setBit(i);
+            break;
+        case Greater:
+            for (int i = 0; i < n; i++)
+                if (row[i] > value)
+                    bits->setBit(i);
+            break;
+        case GreaterEqual:
+            for (int i = 0; i < n; i++)
+                if (row[i] >= value)
+                    bits->setBit(i);
+            break;
+        case Equal:
+            for (int i = 0; i < n; i++)
+                if (qAbs(row[i] - value) < 0.5)
+                    bits->setBit(i);
+            break;
+        case NotEqual:
+            for (int i = 0; i < n; i++)
+                if (qAbs(row[i] - value) >= 0.5)
+                    bits->setBit(i);
+            break;
+        }
+    }
+}
+
+struct RecipeQuery::Node {
+    enum Kind { And, Or, Not, Comparison, Match } kind;
+    QSharedPointer<Node> left {}, right {};  // Not has only left
+    Field field {Calories};
+    Op op {Less};
+    double value {0};
+    Term term {Word};
+    QString text {};
+    QBitArray recipes {};  // of a Match, filled by resolve()
+
+    explicit Node(Kind kind) : kind(kind) {}
+};
+
+class RecipeQuery::Parser {
+public:
+    explicit Parser(const QString &text) : text(text) { next(); }
+
+    QSharedPointer<Node> parse(QString *error) {
+        QSharedPointer<Node> root = disjunction();
+        if (root && token.kind != End)
+            fail(QObject::tr("Περιττό «%1»").arg(token.text));
+        if (!message.isEmpty()) {
+            if (error)
+                *error = QObject::tr("%1 (θέση %2)").arg(message).arg(token.position + 1);
+            return QSharedPointer<Node>();
+        }
+        return root;
+    }
+
+private:
+    enum Kind { End, Text, Quoted, Operator, Open, Close };
+    struct Token {
+        Kind kind;
+        QString text;
+        int position;
+    };
+
+    void next() {
+        while (pos < text.size() && text.at(pos).isSpace())
+            pos++;
+        token = Token {End, QString(), pos};
+        if (pos == text.size())
+            return;
+        QChar c = text.at(pos);
+        if (c == '(' || c == ')') {
+            token.kind = c == '(' ? Open : Close;
+            token.text = c;
+            pos++;
+        } else if (QString("<>=!").contains(c)) {
+            int length = pos + 1 < text.size() && text.at(pos + 1) == '=' && c != '=' ? 2 : 1;
+            token.kind = Operator;
+            token.text = text.mid(pos, length);
+            pos += length;
+        } else if (c == '"' || c == QChar(0x00AB)) {  // "..." or «...»
+            QChar close = c == '"' ? QChar('"') : QChar(0x00BB);
+            int end = text.indexOf(close, pos + 1);
+            if (end < 0)
+                end = text.size();
+            token.kind = Quoted;
+            token.text = text.mid(pos + 1, end - pos - 1);
+            pos = qMin(end + 1, text.size());
+        } else {
+            int end = pos;
+            while (end < text.size() && !text.at(end).isSpace() &&
+                   !QString("()<>=!\"").contains(text.at(end)) && text.at(end) != QChar(0x00AB))
+                end++;
+            token.kind = Text;
+            token.text = text.mid(pos, end - pos);
+            pos = end;
+        }
+    }
+
+    bool isKeyword(const char *english, const char *greek) const {
+        if (token.kind != Text)
+            return false;
+        QString word = Catalog::fold(token.text);
+        return word == QLatin1String(english) || word == QString::fromUtf8(greek);
+    }
+
+    bool fail(const QString &text) {
+        if (message.isEmpty())
+            message = text;
+        return false;
+    }
+
+    static bool fieldFor(const QString &word, Field *field) {
+        QString name = Catalog::fold(word);
+        if (name == "kcal" || name == QString::fromUtf8("θερμιδες"))
+            *field = Calories;
+        else if (name == "kcal/100g" || name == QString::fromUtf8("θερμιδες/100g"))
+            *field = Density;
+        else if (name == "mass" || name == QString::fromUtf8("μαζα") || name == QString::fromUtf8("βαρος"))
+            *field = Mass;
+        else if (name == "ingredients" || name == QString::fromUtf8("υλικα"))
+            *field = IngredientCount;
+        else
+            return false;
+        return true;
+    }
+
+    static QSharedPointer<Node> join(Node::Kind kind, QSharedPointer<Node> left, QSharedPointer<Node> right) {
+        QSharedPointer<Node> node(new Node(kind));
+        node->left = left;
+        node->right = right;
+        return node;
+    }
+
+    QSharedPointer<Node> disjunction() {
+        QSharedPointer<Node> node = conjunction();
+        while (node && isKeyword("or", "η")) {
+            next();
+            QSharedPointer<Node> right = conjunction();
+            node = right ? join(Node::Or, node, right) : right;
+        }
+        return node;
+    }
+
+    // AND may be left out between terms
+    QSharedPointer<Node> conjunction() {
+        QSharedPointer<Node> node = unary();
+        while (node && token.kind != End && token.kind != Close && !isKeyword("or", "η")) {
+            if (isKeyword("and", "και"))
+                next();
+            QSharedPointer<Node> right = unary();
+            node = right ? join(Node::And, node, right) : right;
+        }
+        return node;
+    }
+
+    QSharedPointer<Node> unary() {
+        if (isKeyword("not", "οχι")) {
+            next();
+            QSharedPointer<Node> operand = unary();
+            return operand ? join(Node::Not, operand, QSharedPointer<Node>()) : operand;
+        }
+        if (token.kind == Open) {
+            next();
+            QSharedPointer<Node> node = disjunction();
+            if (node && token.kind != Close) {
+                fail(QObject::tr("Λείπει η «)»"));
+                return QSharedPointer<Node>();
+            }
+            next();
+            return node;
+        }
+        if (isKeyword("contains", "περιεχει")) {
+            next();
+            if (token.kind != Text && token.kind != Quoted) {
+                fail(QObject::tr("Λείπει το υλικό μετά το «περιέχει»"));
+                return QSharedPointer<Node>();
+            }
+            return match(Ingredient);
+        }
+        Field field;
+        if (token.kind == Text && fieldFor(token.text, &field)) {
+            Token name = token;
+            next();
+            if (token.kind != Operator) {
+                // only a word of the text after all
+                QSharedPointer<Node> node(new Node(Node::Match));
+                node->text = name.text;
+                return node;
+            }
+            return comparison(field);
+        }
+        if (token.kind == Text || token.kind == Quoted)
+            return match(Word);
+        fail(token.kind == End ? QObject::tr("Ελλιπές ερώτημα") : QObject::tr("Απρόσμενο «%1»").arg(token.text));
+        return QSharedPointer<Node>();
+    }
+
+    QSharedPointer<Node> match(Term term) {
+        QSharedPointer<Node> node(new Node(Node::Match));
+        node->term = term;
+        node->text = token.text;
+        next();
+        return node;
+    }
+
+    QSharedPointer<Node> comparison(Field field) {
+        static const char *const operators[] = {"<", "<=", ">", ">=", "=", "!="};
+        QSharedPointer<Node> node(new Node(Node::Comparison));
+        node->field = field;
+        int op = 0;
+        while (op < 6 && token.text != QLatin1String(operators[op]))
+            op++;
+        if (op == 6) {
+            fail(QObject::tr("Άγνωστος τελεστής «%1»").arg(token.text));
+            return QSharedPointer<Node>();
+        }
+        node->op = Op(op);
+        next();
+        bool ok = false;
+        if (token.kind == Text)
+            node->value = QString(token.text).replace(',', '.').toDouble(&ok);
+        if (!ok) {
+            fail(QObject::tr("Αναμενόταν αριθμός"));
+            return QSharedPointer<Node>();
+        }
+        next();
+        return node;
+    }
+
+    const QString &text;
+    int pos {0};
+    Token token;
+    QString message {};
+};
+
+RecipeQuery RecipeQuery::parse(const QString &text, QString *error) {
+    RecipeQuery query;
+    if (error)
+        error->clear();
+    if (!text.trimmed().isEmpty())
+        query.root = Parser(text).parse(error);
+    return query;
+}
+
+void RecipeQuery::resolve(int count, const std::function<QVector<quint32>(Term, const QString &)> &lookup) {
+    QList<Node *> pending;
+    if (root)
+        pending.append(root.data());
+    while (!pending.isEmpty()) {
+        Node *node = pending.takeLast();
+        if (node->left)
+            pending.append(node->left.data());
+        if (node->right)
+            pending.append(node->right.data());
+        if (node->kind != Node::Match)
+            continue;
+        node->recipes = QBitArray(count);
+        for (quint32 id : lookup(node->term, node->text))
+            if (int(id) < count)
+                node->recipes.setBit(int(id));
+    }
+}
+
+namespace {
+    // The rows of one chunk for which node holds, bit i standing for begin + i.
+    template <typename Node, typename Columns>
+    QBitArray rows(const Node &node, const Columns &columns, int begin, int end) {
+        QBitArray bits(end - begin);
+        switch (node.kind) {
+        case Node::And:
+            bits = rows(*node.left, columns, begin, end);
+            if (bits.count(true))
+                bits &= rows(*node.right, columns, begin, end);
+            break;
+        case Node::Or:
+            bits = rows(*node.left, columns, begin, end) | rows(*node.right, columns, begin, end);
+            break;
+        case Node::Not:
+            bits = ~rows(*node.left, columns, begin, end);
+            break;
+        case Node::Comparison:
+            switch (node.field) {
+            case RecipeQuery::Calories:
+                compare(columns.calories, node.op, node.value, begin, &bits);
+                break;
+            case RecipeQuery::Density:
+                compare(columns.density, node.op, node.value, begin, &bits);
+                break;
+            case RecipeQuery::Mass:
+                compare(columns.mass, node.op, node.value, begin, &bits);
+                break;
+            case RecipeQuery::IngredientCount:
+                compare(columns.ingredients, node.op, node.value, begin, &bits);
+                break;
+            }
+            break;
+        case Node::Match:
+            for (int i = begin; i < end && i < node.recipes.size(); i++)
+                if (node.recipes.testBit(i))
+                    bits.setBit(i - begin);
+            break;
+        }
+        return bits;
+    }
+}
+
+QVector<quint32> RecipeQuery::evaluate(const Columns &columns, int begin, int end) const {
+    QVector<quint32> ids;
+    if (!root || begin >= end)
+        return ids;
+    QBitArray bits = rows(*root, columns, begin, end);
+    for (int i = 0; i < bits.size(); i++)
+        if (bits.testBit(i))
+            ids.append(quint32(begin + i));
+    return ids;
+}
@@ -0,0 +1,47 @@
+#ifndef RECIPEQUERY_H
+#define RECIPEQUERY_H
+
+#include <QBitArray>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/* Structured filter over the recipe library, e.g.
+ *     kcal/100g < 150 AND contains Αυγό AND mass > 1000
+ * Comparisons take kcal, kcal/100g, mass (g) or ingredients (their count);
+ * "contains" matches ingredient names, a bare word the recipe's text as in
+ * SearchIndex::search(). Terms next to each other must all hold; AND, OR,
+ * NOT (or ΚΑΙ, Ή, ΟΧΙ) and parentheses combine them. The text is parsed
+ * once into a predicate tree whose word and ingredient terms are resolved
+ * to bitsets of recipes; the tree is then evaluated over the per-recipe
+ * columns of SearchIndex one chunk of recipes at a time. */
+class RecipeQuery {
+public:
+    enum Field { Calories, Density, Mass, IngredientCount };
+    enum Term { Word, Ingredient };
+
+    // per-recipe summaries, indexed by document id
+    struct Columns {
+        QVector<float> calories;
+        QVector<float> density;        // kcal/100g
+        QVector<qint32> mass;          // g
+        QVector<quint16> ingredients;  // distinct ingredients
+    };
+
+    static RecipeQuery parse(const QString &text, QString *error);
+    bool isEmpty() const { return !root; }
+    // Gives every word and ingredient term the ids of the recipes it
+    // matches, out of count documents.
+    void resolve(int count, const std::function<QVector<quint32>(Term, const QString &)> &lookup);
+    // the ids in [begin, end) that match, ascending
+    QVector<quint32> evaluate(const Columns &columns, int begin, int end) const;
+
+private:
+    struct Node;
+    class Parser;
+
+    QSharedPointer<Node> root {};
+};
+
+#endif // RECIPEQUERY_H
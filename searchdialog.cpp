@@ -0,0 +1,81 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchdialog.h"
+#include "ui_searchdialog.h"
+#include "searchindex.h"
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QPushButton>
+
+SearchDialog::SearchDialog(SearchIndex *index, QWidget *parent) :
+    QDialog(parent), ui(new Ui::SearchDialog), index(index)
+{
+    ui->setupUi(this);
+    ui->buttonBox->button(QDialogButtonBox::Open)->setText(tr("Άνοιγμα"));
+    ui->buttonBox->button(QDialogButtonBox::Open)->setEnabled(false);
+    connect(ui->query, &QLineEdit::textChanged, this, &SearchDialog::runQuery);
+    connect(index, &SearchIndex::updated, this, &SearchDialog::runQuery);
+    connect(ui->results, &QListWidget::currentRowChanged, this, [this](int row) {
+        ui->buttonBox->button(QDialogButtonBox::Open)->setEnabled(row >= 0);
+    });
+    connect(ui->buttonBox, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(ui->buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    index->refresh();
+    runQuery();
+}
+
+SearchDialog::~SearchDialog() { delete ui; }
+
+QString SearchDialog::selectedLocation() const {
+    auto item = ui->results->currentItem();
+    return item ? item->data(Qt::UserRole).toString() : QString();
+}
+
+void SearchDialog::runQuery() {
+    QElapsedTimer timer;
+    timer.start();
+    const auto hits = index->search(ui->query->text());
+    qint64 elapsed = timer.elapsed();
+
+    ui->results->clear();
+    for (auto &&hit : hits) {
+        auto item = new QListWidgetItem(hit.title, ui->results);
+        item->setData(Qt::UserRole, hit.location);
+        item->setToolTip(hit.summary.isEmpty() ? hit.location : hit.summary);
+    }
+    QString status = tr("%1 συνταγές στο ευρετήριο").arg(index->documentCount());
+    if (!ui->query->text().trimmed().isEmpty())
+        status = tr("%1 αποτελέσματα σε %2 ms").arg(hits.size()).arg(elapsed) + " — " + status;
+    if (index->isUpdating())
+        status += tr(" (ενημέρωση...)");
+    ui->status->setText(status);
+    ui->folder->setText(index->libraryPath());
+}
+
+void SearchDialog::on_folderButton_clicked() {
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Φάκελος συνταγών"), index->libraryPath());
+    if (!dir.isEmpty())
+        index->setLibraryPath(dir);
+    runQuery();
+}
+
+void SearchDialog::on_results_itemDoubleClicked(QListWidgetItem *item) {
+    ui->results->setCurrentItem(item);
+    accept();
+}
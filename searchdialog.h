@@ -0,0 +1,28 @@
+#ifndef SEARCHDIALOG_H
+#define SEARCHDIALOG_H
+
+#include <QDialog>
+
+class QListWidgetItem;
+class SearchIndex;
+namespace Ui { class SearchDialog; }
+
+class SearchDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit SearchDialog(SearchIndex *index, QWidget *parent = nullptr);
+    ~SearchDialog();
+    QString selectedLocation() const;
+
+private slots:
+    void runQuery();
+    void on_folderButton_clicked();
+    void on_results_itemDoubleClicked(QListWidgetItem *item);
+
+private:
+    Ui::SearchDialog *ui;
+    SearchIndex *index;
+};
+
+#endif // SEARCHDIALOG_H
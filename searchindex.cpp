@@ -0,0 +1,564 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchindex.h"
+#include "catalog.h"
+#include "diagnostics.h"
+#include "recipe.h"
+#include "recipearchive.h"
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QtConcurrent>
+#include <algorithm>
+
+static const quint32 Magic {0x4E435349};  // "NCSI"
+static const quint32 Version {3};
+static const int QueryChunk {4096};  // recipes per filter task
+
+struct SearchIndex::Parsed {
+    QString location;
+    QString file;
+    QString title;
+    QString summary;
+    QStringList tokens;
+    QStringList ingredients;
+    double calories;
+    int mass;
+};
+
+// Common inflection endings, longest first. Query words lose one of them
+// so that "φούρνος" also finds "φούρνο" and "φούρνου".
+static const char *const endings[] = {
+    "ους", "ων", "ος", "ου", "ες", "ης", "ας", "ια", "α", "ε", "η", "ι", "ο", "υ"
+};
+
+static QString stem(const QString &token) {
+    if (token.size() < 5 || token.at(0).isDigit())
+        return token;
+    for (auto &&ending : endings) {
+        QString suffix = QString::fromUtf8(ending);
+        if (token.endsWith(suffix))
+            return token.left(token.size() - suffix.size());
+    }
+    return token;
+}
+
+SearchIndex::SearchIndex(QObject *parent) : QObject(parent) {
+    QSettings settings;
+    _libraryPath = settings.value("libraryPath",
+                                  QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)).toString();
+    debounce = new QTimer(this);
+    debounce->setSingleShot(true);
+    debounce->setInterval(1000);
+    connect(debounce, &QTimer::timeout, this, &SearchIndex::refresh);
+    connect(&fsWatcher, &QFileSystemWatcher::directoryChanged, debounce, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&watcher, &QFutureWatcher<void>::finished, this, &SearchIndex::scanFinished);
+    Diagnostics::ioStarted();
+    watcher.setFuture(QtConcurrent::run([this]() {
+        load();
+        scan(libraryPath());
+    }));
+}
+
+SearchIndex::~SearchIndex() {
+    watcher.waitForFinished();
+}
+
+QString SearchIndex::indexFileName() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/search.idx";
+}
+
+QString SearchIndex::libraryPath() const {
+    QReadLocker locker(&lock);
+    return _libraryPath;
+}
+
+void SearchIndex::setLibraryPath(const QString &path) {
+    {
+        QWriteLocker locker(&lock);
+        if (path == _libraryPath)
+            return;
+        _libraryPath = path;
+    }
+    QSettings settings;
+    settings.setValue("libraryPath", path);
+    refresh();
+}
+
+int SearchIndex::documentCount() const {
+    QReadLocker locker(&lock);
+    return docs.size() - deadCount;
+}
+
+void SearchIndex::refresh() {
+    if (watcher.isRunning()) {
+        pending = true;
+        return;
+    }
+    QString path = libraryPath();
+    Diagnostics::ioStarted();
+    watcher.setFuture(QtConcurrent::run([this, path]() { scan(path); }));
+}
+
+void SearchIndex::scanFinished() {
+    Diagnostics::ioFinished();
+    QStringList dirs;
+    {
+        QReadLocker locker(&lock);
+        dirs = directories;
+    }
+    if (!fsWatcher.directories().isEmpty())
+        fsWatcher.removePaths(fsWatcher.directories());
+    if (!dirs.isEmpty())
+        fsWatcher.addPaths(dirs);
+    emit updated();
+    if (pending) {
+        pending = false;
+        refresh();
+    }
+}
+
+// Lower-case, accent-free words; single letters are dropped, numbers kept.
+QStringList SearchIndex::tokenize(const QString &text) {
+    QStringList tokens;
+    QString folded = Catalog::fold(text);
+    int start = -1;
+    for (int i = 0; i <= folded.size(); i++) {
+        bool word = i < folded.size() && folded.at(i).isLetterOrNumber();
+        if (word && start < 0) {
+            start = i;
+        } else if (!word && start >= 0) {
+            if (i - start > 1 || folded.at(start).isDigit())
+                tokens.append(folded.mid(start, i - start));
+            start = -1;
+        }
+    }
+    return tokens;
+}
+
+void SearchIndex::addRecipe(QList<Parsed> *parsed, const QString &location, const QString &file,
+                            const QString &title, const Recipe &recipe) {
+    Parsed doc;
+    doc.location = location;
+    doc.file = file;
+    doc.title = title;
+    doc.summary = recipe.instructions.simplified().left(160);
+    QString text = title + '\n' + recipe.instructions;
+    for (auto &&item : recipe.items) {
+        text += '\n' + item.ingredient.name();
+        doc.ingredients.append(Catalog::fold(item.ingredient.name()));
+    }
+    doc.calories = recipe.totalCalories();
+    doc.mass = recipe.totalMass();
+    doc.tokens = tokenize(text);
+    doc.tokens.removeDuplicates();
+    doc.ingredients.removeDuplicates();
+    parsed->append(doc);
+}
+
+// Runs on a pool thread: compares modification times with the ones in the
+// index and re-reads only new or changed files.
+void SearchIndex::scan(const QString &path) {
+    Diagnostics::ScopedTimer timer("search index scan");
+    QHash<QString, qint64> known;
+    {
+        QReadLocker locker(&lock);
+        known = fileTimes;
+    }
+    QStringList dirs;
+    QList<Parsed> parsed;
+    QHash<QString, qint64> seen;
+    if (!path.isEmpty() && QDir(path).exists()) {
+        dirs.append(path);
+        QDirIterator dirIt(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (dirIt.hasNext())
+            dirs.append(dirIt.next());
+        QDirIterator it(path, QStringList() << "*.rcp" << "*." + RecipeArchive::suffix,
+                        QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QString file = it.next();
+            qint64 mtime = it.fileInfo().lastModified().toMSecsSinceEpoch();
+            seen.insert(file, mtime);
+            if (known.value(file, -1) == mtime)
+                continue;
+            if (RecipeArchive::isArchive(file)) {
+                RecipeArchive archive(file);
+                if (!archive.open())
+                    continue;
+                for (auto &&name : archive.names()) {
+                    Recipe recipe;
+                    if (archive.read(name, &recipe))
+                        addRecipe(&parsed, RecipeArchive::location(file, name), file, name, recipe);
+                }
+            } else {
+                Recipe recipe;
+                if (recipe.read(file))
+                    addRecipe(&parsed, file, file, it.fileInfo().completeBaseName(), recipe);
+            }
+        }
+    }
+    QStringList gone;
+    for (auto it = known.constBegin(); it != known.constEnd(); ++it)
+        if (seen.value(it.key(), -1) != it.value())
+            gone.append(it.key());
+
+    {
+        QWriteLocker locker(&lock);
+        directories = dirs;
+        // nothing new, or the folder changed meanwhile and the next scan covers it
+        if ((parsed.isEmpty() && gone.isEmpty()) || path != _libraryPath)
+            return;
+        apply(parsed, gone);
+        for (auto it = seen.constBegin(); it != seen.constEnd(); ++it)
+            fileTimes.insert(it.key(), it.value());
+        if (deadCount > docs.size() / 3)
+            compact();
+    }
+    save();
+}
+
+// Called with the write lock held. Old versions of changed files are only
+// marked dead; compact() drops them once they pile up.
+void SearchIndex::apply(const QList<Parsed> &parsed, const QStringList &gone) {
+    for (auto &&file : gone) {
+        for (quint32 id : docsByFile.take(file)) {
+            docs[id].alive = false;
+            deadCount++;
+        }
+        fileTimes.remove(file);
+    }
+    for (auto &&doc : parsed) {
+        quint32 id = quint32(docs.size());
+        docs.append(Document {doc.location, doc.file, doc.title, doc.summary, true});
+        docsByFile[doc.file].append(id);
+        for (auto &&token : doc.tokens) {
+            auto it = termIds.constFind(token);
+            int term;
+            if (it == termIds.constEnd()) {
+                term = terms.size();
+                termIds.insert(token, term);
+                terms.append(token);
+                postings.append(QVector<quint32>());
+                sortedDirty = true;
+            } else {
+                term = it.value();
+            }
+            postings[term].append(id);  // ids only grow, so lists stay sorted
+        }
+        for (auto &&ingredient : doc.ingredients)
+            byIngredient[ingredient].append(id);
+        columns.calories.append(float(doc.calories));
+        columns.density.append(doc.mass > 0 ? float(doc.calories * 100 / doc.mass) : 0);
+        columns.mass.append(doc.mass);
+        columns.ingredients.append(quint16(qMin(doc.ingredients.size(), 0xFFFF)));
+    }
+}
+
+void SearchIndex::compact() {
+    QVector<qint64> remap(docs.size(), -1);
+    QVector<Document> alive;
+    RecipeQuery::Columns kept;
+    alive.reserve(docs.size() - deadCount);
+    docsByFile.clear();
+    for (int i = 0; i < docs.size(); i++) {
+        if (!docs.at(i).alive)
+            continue;
+        remap[i] = alive.size();
+        docsByFile[docs.at(i).file].append(quint32(alive.size()));
+        alive.append(docs.at(i));
+        kept.calories.append(columns.calories.at(i));
+        kept.density.append(columns.density.at(i));
+        kept.mass.append(columns.mass.at(i));
+        kept.ingredients.append(columns.ingredients.at(i));
+    }
+    auto remapped = [&remap](const QVector<quint32> &list) {
+        QVector<quint32> kept;
+        kept.reserve(list.size());
+        for (quint32 id : list)
+            if (remap.at(id) >= 0)
+                kept.append(quint32(remap.at(id)));
+        return kept;
+    };
+    for (auto &&list : postings)
+        list = remapped(list);
+    for (auto it = byIngredient.begin(); it != byIngredient.end();) {
+        it.value() = remapped(it.value());
+        if (it.value().isEmpty())
+            it = byIngredient.erase(it);
+        else
+            ++it;
+    }
+    docs = alive;
+    columns = kept;
+    deadCount = 0;
+}
+
+void SearchIndex::load() {
+    QFile file(indexFileName());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    QString path;
+    in >> magic >> version >> path;
+    if (in.status() != QDataStream::Ok || magic != Magic || version != Version)
+        return;
+    QWriteLocker locker(&lock);
+    if (path != _libraryPath)
+        return;
+    quint32 docCount, termCount;
+    in >> fileTimes >> docCount;
+    docs.resize(docCount);
+    for (int i = 0; i < docs.size(); i++) {
+        Document &doc = docs[i];
+        in >> doc.location >> doc.file >> doc.title >> doc.summary >> doc.alive;
+        if (doc.alive)
+            docsByFile[doc.file].append(quint32(i));
+        else
+            deadCount++;
+    }
+    in >> termCount;
+    terms.resize(termCount);
+    postings.resize(termCount);
+    for (quint32 i = 0; i < termCount; i++) {
+        in >> terms[i] >> postings[i];
+        termIds.insert(terms.at(i), int(i));
+    }
+    in >> byIngredient >> columns.calories >> columns.density >> columns.mass >> columns.ingredients;
+    bool aligned = columns.calories.size() == docs.size() && columns.density.size() == docs.size() &&
+            columns.mass.size() == docs.size() && columns.ingredients.size() == docs.size();
+    if (in.status() != QDataStream::Ok || !aligned) {
+        docs.clear();
+        deadCount = 0;
+        fileTimes.clear();
+        docsByFile.clear();
+        terms.clear();
+        postings.clear();
+        termIds.clear();
+        byIngredient.clear();
+        columns = RecipeQuery::Columns();
+    }
+    sortedDirty = true;
+}
+
+void SearchIndex::save() const {
+    QDir().mkpath(QFileInfo(indexFileName()).path());
+    QSaveFile file(indexFileName());
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    QReadLocker locker(&lock);
+    out << Magic << Version << _libraryPath << fileTimes;
+    // dead documents are written too so that posting ids stay valid; they
+    // are dropped by the next compact()
+    out << quint32(docs.size());
+    for (auto &&doc : docs)
+        out << doc.location << doc.file << doc.title << doc.summary << doc.alive;
+    out << quint32(terms.size());
+    for (int i = 0; i < terms.size(); i++)
+        out << terms.at(i) << postings.at(i);
+    out << byIngredient << columns.calories << columns.density << columns.mass << columns.ingredients;
+    locker.unlock();
+    file.commit();
+}
+
+// Ids of the documents containing a word starting with token (numbers must
+// match whole), ascending.
+QVector<quint32> SearchIndex::matching(const QString &token) const {
+    if (token.at(0).isDigit()) {
+        int term = termIds.value(token, -1);
+        return term < 0 ? QVector<quint32>() : postings.at(term);
+    }
+    if (sortedDirty) {
+        sortedTerms.resize(terms.size());
+        for (int i = 0; i < terms.size(); i++)
+            sortedTerms[i] = i;
+        std::sort(sortedTerms.begin(), sortedTerms.end(), [this](int a, int b) { return terms.at(a) < terms.at(b); });
+        sortedDirty = false;
+    }
+    auto first = std::lower_bound(sortedTerms.constBegin(), sortedTerms.constEnd(), token,
+                                  [this](int term, const QString &value) { return terms.at(term) < value; });
+    QVector<quint32> ids;
+    int runs = 0;
+    for (auto it = first; it != sortedTerms.constEnd() && terms.at(*it).startsWith(token); ++it) {
+        ids += postings.at(*it);
+        runs++;
+    }
+    if (runs > 1) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+    return ids;
+}
+
+// Ids of the documents containing every one of tokens, ascending.
+QVector<quint32> SearchIndex::matchingAll(const QStringList &tokens) const {
+    QList<QVector<quint32>> lists;
+    for (auto &&token : tokens)
+        lists.append(matching(stem(token)));
+    if (lists.isEmpty())
+        return QVector<quint32>();
+    std::sort(lists.begin(), lists.end(), [](const QVector<quint32> &a, const QVector<quint32> &b) {
+        return a.size() < b.size();
+    });
+    QVector<quint32> result = lists.first();
+    for (int i = 1; i < lists.size() && !result.isEmpty(); i++) {
+        QVector<quint32> both;
+        std::set_intersection(result.constBegin(), result.constEnd(),
+                              lists.at(i).constBegin(), lists.at(i).constEnd(), std::back_inserter(both));
+        result = both;
+    }
+    return result;
+}
+
+// Ids of the documents with an ingredient having, for every word of text,
+// a word that starts with it, ascending.
+QVector<quint32> SearchIndex::usingIngredient(const QString &text) const {
+    QStringList wanted = tokenize(text);
+    for (auto &&token : wanted)
+        token = stem(token);
+    QVector<quint32> ids;
+    if (wanted.isEmpty())
+        return ids;
+    int runs = 0;
+    for (auto it = byIngredient.constBegin(); it != byIngredient.constEnd(); ++it) {
+        QStringList words = tokenize(it.key());
+        bool all = std::all_of(wanted.constBegin(), wanted.constEnd(), [&words](const QString &token) {
+            return std::any_of(words.constBegin(), words.constEnd(), [&token](const QString &word) {
+                return word.startsWith(token);
+            });
+        });
+        if (all) {
+            ids += it.value();
+            runs++;
+        }
+    }
+    if (runs > 1) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+    return ids;
+}
+
+namespace {
+    // Keeps the limit ids whose titles sort first, in title order; every
+    // match takes part, so none of the first titles can be missing.
+    template <typename Docs>
+    void keepFirstByTitle(QVector<quint32> *ids, const Docs &docs, int limit) {
+        auto byTitle = [&docs](quint32 a, quint32 b) {
+            return QString::localeAwareCompare(docs.at(a).title, docs.at(b).title) < 0;
+        };
+        if (limit < 0 || limit >= ids->size()) {
+            std::sort(ids->begin(), ids->end(), byTitle);
+            return;
+        }
+        std::partial_sort(ids->begin(), ids->begin() + limit, ids->end(), byTitle);
+        ids->resize(limit);
+    }
+}
+
+// Every word of the query must appear. Of all the matches, the first limit
+// in title order are returned.
+QList<SearchIndex::Hit> SearchIndex::search(const QString &query, int limit) const {
+    QList<Hit> hits;
+    QStringList tokens = tokenize(query);
+    if (tokens.isEmpty())
+        return hits;
+    QWriteLocker locker(&lock);  // matching() may rebuild the sorted term list
+    QVector<quint32> alive;
+    for (quint32 id : matchingAll(tokens))
+        if (docs.at(id).alive)
+            alive.append(id);
+    keepFirstByTitle(&alive, docs, limit);
+    for (quint32 id : alive) {
+        const Document &doc = docs.at(id);
+        hits.append(Hit {doc.location, doc.title, doc.summary});
+    }
+    return hits;
+}
+
+// Locations of the recipes with an ingredient whose name folds to the same
+// text as the given one, e.g. those to recalculate after a catalog change.
+QStringList SearchIndex::recipesUsing(const QString &ingredient) const {
+    QStringList locations;
+    QReadLocker locker(&lock);
+    for (quint32 id : byIngredient.value(Catalog::fold(ingredient))) {
+        const Document &doc = docs.at(id);
+        if (doc.alive)
+            locations.append(doc.location);
+    }
+    return locations;
+}
+
+namespace {
+    // Runs on pool threads, which only read the index: filter() holds the
+    // write lock until all chunks are done.
+    struct ChunkFilter {
+        typedef QVector<quint32> result_type;
+        const RecipeQuery *query;
+        const RecipeQuery::Columns *columns;
+        int size;
+        QVector<quint32> operator()(int begin) const {
+            return query->evaluate(*columns, begin, qMin(begin + QueryChunk, size));
+        }
+    };
+}
+
+// The recipes for which query holds, evaluated in chunks on the global
+// pool; *matched gets their number, and of all of them the first limit in
+// title order are returned with the recipe's totals as summary.
+QList<SearchIndex::Hit> SearchIndex::filter(RecipeQuery query, int limit, int *matched) const {
+    Diagnostics::ScopedTimer timer("recipe query");
+    QList<Hit> hits;
+    if (matched)
+        *matched = 0;
+    if (query.isEmpty())
+        return hits;
+    QWriteLocker locker(&lock);  // as in search()
+    query.resolve(docs.size(), [this](RecipeQuery::Term term, const QString &text) {
+        return term == RecipeQuery::Ingredient ? usingIngredient(text) : matchingAll(tokenize(text));
+    });
+    QList<int> chunks;
+    for (int begin = 0; begin < docs.size(); begin += QueryChunk)
+        chunks.append(begin);
+    const QList<QVector<quint32>> parts =
+            QtConcurrent::blockingMapped<QList<QVector<quint32>>>(chunks, ChunkFilter {&query, &columns, docs.size()});
+    QVector<quint32> alive;
+    for (auto &&part : parts)
+        for (quint32 id : part)
+            if (docs.at(id).alive)
+                alive.append(id);
+    if (matched)
+        *matched = alive.size();
+    keepFirstByTitle(&alive, docs, limit);
+    for (quint32 id : alive) {
+        const Document &doc = docs.at(id);
+        hits.append(Hit {doc.location, doc.title,
+                         QString("%1 kcal, %2 g, %3 kcal/100g").arg(qRound(columns.calories.at(id)))
+                                 .arg(columns.mass.at(id)).arg(qRound(columns.density.at(id)))});
+    }
+    return hits;
+}
@@ -0,0 +1,96 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QFileSystemWatcher>
+#include "recipequery.h"
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QVector>
+
+class QTimer;
+class Recipe;
+
+/* Inverted index over the recipes of the library folder: every folded word
+ * of a recipe's title, ingredient names and instructions points at the
+ * recipes containing it, and every folded ingredient name points at the
+ * recipes using that ingredient. The totals of each recipe are kept in
+ * columns for RecipeQuery filters. Files are re-read only when their modification
+ * time changes; scanning and indexing run on a pool thread and the index is
+ * kept in <AppData>/search.idx between sessions. */
+class SearchIndex : public QObject {
+    Q_OBJECT
+
+public:
+    struct Hit {
+        QString location;
+        QString title;
+        QString summary;
+    };
+
+    explicit SearchIndex(QObject *parent = nullptr);
+    ~SearchIndex();
+    QString libraryPath() const;
+    void setLibraryPath(const QString &path);
+    QList<Hit> search(const QString &query, int limit = 200) const;
+    QList<Hit> filter(RecipeQuery query, int limit = 200, int *matched = nullptr) const;
+    QStringList recipesUsing(const QString &ingredient) const;
+    int documentCount() const;
+    bool isUpdating() const { return watcher.isRunning(); }
+
+    static QStringList tokenize(const QString &text);
+
+signals:
+    void updated();
+
+public slots:
+    void refresh();
+
+private slots:
+    void scanFinished();
+
+private:
+    struct Document {
+        QString location;
+        QString file;
+        QString title;
+        QString summary;
+        bool alive;
+    };
+    struct Parsed;
+
+    void scan(const QString &path);
+    void apply(const QList<Parsed> &parsed, const QStringList &gone);
+    static void addRecipe(QList<Parsed> *parsed, const QString &location, const QString &file,
+                          const QString &title, const Recipe &recipe);
+    void compact();
+    void load();
+    void save() const;
+    QVector<quint32> matching(const QString &token) const;
+    QVector<quint32> matchingAll(const QStringList &tokens) const;
+    QVector<quint32> usingIngredient(const QString &text) const;
+    static QString indexFileName();
+
+    mutable QReadWriteLock lock;
+    QString _libraryPath;
+    QVector<Document> docs {};
+    QHash<QString, qint64> fileTimes {};
+    QHash<QString, QVector<quint32>> docsByFile {};
+    QHash<QString, int> termIds {};
+    QVector<QString> terms {};
+    QVector<QVector<quint32>> postings {};
+    QHash<QString, QVector<quint32>> byIngredient {};
+    RecipeQuery::Columns columns {};
+    mutable QVector<int> sortedTerms {};
+    mutable bool sortedDirty { true };
+    int deadCount { 0 };
+    QStringList directories {};
+
+    QFutureWatcher<void> watcher;
+    QFileSystemWatcher fsWatcher;
+    QTimer *debounce;
+    bool pending { false };
+};
+
+#endif // SEARCHINDEX_H
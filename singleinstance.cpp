@@ -0,0 +1,92 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "singleinstance.h"
+#include "global.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QLocalSocket>
+
+static const quint32 Magic {0x4E434F50};  // "NCOP"
+static const int Timeout {1000};         // ms
+
+SingleInstance::SingleInstance(QObject *parent) : QObject(parent) {
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+    connect(&server, &QLocalServer::newConnection, this, &SingleInstance::newConnection);
+}
+
+// Per user, so that users sharing a machine each get their own instance.
+QString SingleInstance::serverName() {
+    QByteArray user = qgetenv("USER");
+    if (user.isEmpty())
+        user = qgetenv("USERNAME");
+    return APPNAME + '-' + QCryptographicHash::hash(user, QCryptographicHash::Sha1).toHex().left(12);
+}
+
+// True when a running instance accepted the files; the caller can quit.
+bool SingleInstance::forward(const QStringList &files) {
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(Timeout))
+        return false;
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << Magic << files;
+    socket.write(request);
+    if (!socket.waitForBytesWritten(Timeout) || !socket.waitForReadyRead(Timeout))
+        return false;
+    return socket.read(1) == "1";
+}
+
+bool SingleInstance::listen() {
+    if (server.listen(serverName()))
+        return true;
+    // A live instance that was only slow to answer forward() still accepts
+    // connections; only a name nobody answers on is left over from a crash.
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (socket.waitForConnected(Timeout))
+        return false;
+    QLocalServer::removeServer(serverName());
+    return server.listen(serverName());
+}
+
+void SingleInstance::newConnection() {
+    while (QLocalSocket *socket = server.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            QDataStream in(socket);
+            in.setVersion(QDataStream::Qt_5_0);
+            in.startTransaction();
+            quint32 magic;
+            QStringList files;
+            in >> magic >> files;
+            if (!in.commitTransaction())
+                return;  // wait for the rest of the request
+            if (magic != Magic) {
+                socket->abort();
+                return;
+            }
+            socket->write("1");
+            socket->flush();
+            socket->disconnectFromServer();
+            emit openRequested(files);
+        });
+    }
+}
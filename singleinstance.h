@@ -0,0 +1,29 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QLocalServer>
+#include <QObject>
+
+// One running NefChef per user session. A later launch hands its files to
+// the running instance through a local socket and exits before creating
+// any window.
+class SingleInstance : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SingleInstance(QObject *parent = nullptr);
+    bool forward(const QStringList &files);
+    bool listen();
+
+signals:
+    void openRequested(const QStringList &files);
+
+private slots:
+    void newConnection();
+
+private:
+    static QString serverName();
+    QLocalServer server;
+};
+
+#endif // SINGLEINSTANCE_H
@@ -18,9 +18,15 @@
 
 #include "startpage.h"
 #include "ui_startpage.h"
+#include "recipequery.h"
+#include "searchindex.h"
+#include <QElapsedTimer>
 
-StartPage::StartPage(QWidget *parent) : QWidget(parent), ui(new Ui::StartPage) {
+StartPage::StartPage(QWidget *parent) : QWidget(parent), ui(new Ui::StartPage), index(nullptr) {
     ui->setupUi(this);
+    ui->queryStatus->hide();
+    ui->queryResults->hide();
+    connect(ui->query, &QLineEdit::textChanged, this, &StartPage::runQuery);
 }
 
 StartPage::~StartPage() { delete ui; }
@@ -32,3 +38,47 @@ void StartPage::on_startCreate_clicked() { emit create(); }
 void StartPage::on_startHelp_clicked() { emit help(); }
 
 void StartPage::on_startInfo_clicked() { emit info(); }
+
+void StartPage::setIndex(SearchIndex *index) {
+    this->index = index;
+    connect(index, &SearchIndex::updated, this, &StartPage::runQuery);
+}
+
+// The query is parsed on every keystroke; the results stay hidden while
+// the box is empty so the page looks as before.
+void StartPage::runQuery() {
+    bool empty = ui->query->text().trimmed().isEmpty();
+    ui->queryStatus->setVisible(!empty);
+    ui->queryResults->setVisible(!empty);
+    ui->queryResults->clear();
+    if (empty || !index)
+        return;
+
+    QString error;
+    RecipeQuery query = RecipeQuery::parse(ui->query->text(), &error);
+    if (!error.isEmpty()) {
+        ui->queryStatus->setText(error);
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    int matched;
+    const auto hits = index->filter(query, 200, &matched);
+    qint64 elapsed = timer.elapsed();
+
+    for (auto &&hit : hits) {
+        auto item = new QListWidgetItem(hit.title + " — " + hit.summary, ui->queryResults);
+        item->setData(Qt::UserRole, hit.location);
+        item->setToolTip(hit.location);
+    }
+    QString status = tr("%1 από %2 συνταγές σε %3 ms").arg(matched).arg(index->documentCount()).arg(elapsed);
+    if (matched > hits.size())
+        status += tr(", εμφανίζονται οι πρώτες %1").arg(hits.size());
+    if (index->isUpdating())
+        status += tr(" (ενημέρωση...)");
+    ui->queryStatus->setText(status);
+}
+
+void StartPage::on_queryResults_itemActivated(QListWidgetItem *item) {
+    emit openLocation(item->data(Qt::UserRole).toString());
+}
@@ -3,6 +3,8 @@
 
 #include <QWidget>
 
+class QListWidgetItem;
+class SearchIndex;
 namespace Ui { class StartPage; }
 
 class StartPage : public QWidget {
@@ -11,14 +13,18 @@ class StartPage : public QWidget {
 public:
     explicit StartPage(QWidget *parent = nullptr);
     ~StartPage();
+    void setIndex(SearchIndex *index);
 
 signals:
     void create();
     void help();
     void info();
     void open();
+    void openLocation(const QString &location);
 
 private slots:
+    void runQuery();
+    void on_queryResults_itemActivated(QListWidgetItem *item);
     void on_startCreate_clicked();
     void on_startHelp_clicked();
     void on_startInfo_clicked();
@@ -26,6 +32,7 @@ private slots:
 
 private:
     Ui::StartPage *ui;
+    SearchIndex *index;
 };
 
 #endif // STARTPAGE_H
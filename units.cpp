@@ -0,0 +1,298 @@
+/**
+ * Copyright 2020 Dimitris Psathas <dimitrisinbox@gmail.com>
+ *
+ * This file is part of NefChef.
+ *
+ * NefChef is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License  as  published by  the  Free Software
+ * Foundation,  either version 3 of the License,  or (at your option)  any later
+ * version.
+ *
+ * NefChef is distributed in the hope that it will be useful,  but  WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the  GNU General Public License  for more details.
+ *
+ * You should have received a copy of the  GNU General Public License along with
+ * NefChef. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "units.h"
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QStandardPaths>
+#include <QTextCodec>
+#include <QTextStream>
+
+namespace {
+    using Units::Unit;
+
+    struct UnitAlias {
+        const char *text;
+        Unit unit;
+    };
+
+    // folded spellings, without dots
+    constexpr UnitAlias unitAliases[] = {
+        {"g", Units::Gram}, {"gr", Units::Gram}, {"γ", Units::Gram}, {"γρ", Units::Gram},
+        {"γραμμαριο", Units::Gram}, {"γραμμαρια", Units::Gram},
+        {"kg", Units::Kilogram}, {"κιλο", Units::Kilogram}, {"κιλα", Units::Kilogram},
+        {"ml", Units::Millilitre}, {"μλ", Units::Millilitre},
+        {"l", Units::Litre}, {"lt", Units::Litre}, {"λ", Units::Litre}, {"λιτρο", Units::Litre}, {"λιτρα", Units::Litre},
+        {"cup", Units::Cup}, {"cups", Units::Cup}, {"φλ", Units::Cup}, {"φλιτζανι", Units::Cup}, {"φλιτζανια", Units::Cup},
+        {"tbsp", Units::Tablespoon}, {"κσ", Units::Tablespoon}, {"κουταλια", Units::Tablespoon}, {"κουταλιες", Units::Tablespoon},
+        {"tsp", Units::Teaspoon}, {"κγ", Units::Teaspoon}, {"κουταλακι", Units::Teaspoon}, {"κουταλακια", Units::Teaspoon},
+        {"pc", Units::Piece}, {"pcs", Units::Piece}, {"τεμ", Units::Piece}, {"τεμαχιο", Units::Piece}, {"τεμαχια", Units::Piece},
+    };
+
+    // grams for mass units, millilitres for volume units; pieces are per ingredient
+    constexpr double unitFactors[] = {1, 1000, 1, 1000, 240, 15, 5, 0};
+    static_assert(sizeof(unitFactors) / sizeof(unitFactors[0]) == Units::Piece + 1, "one factor per unit");
+
+    constexpr bool isVolume(Unit unit) {
+        return unit == Units::Millilitre || unit == Units::Litre || unit == Units::Cup ||
+                unit == Units::Tablespoon || unit == Units::Teaspoon;
+    }
+
+    struct BuiltinMeasure {
+        const char *name;
+        double density;
+        double piece;
+    };
+
+    // Densities and typical piece weights for the entries of the built-in catalog.
+    // Users can add or override entries in units.cal next to extended.cal.
+    constexpr BuiltinMeasure builtinMeasures[] = {
+        {"Αλεύρι λευκό", 0.53, 0},
+        {"Ασπράδι Αυγού", 1.03, 33},
+        {"Αυγό", 1.03, 55},
+        {"Βούτυρο", 0.91, 0},
+        {"Βούτυρο καρπών", 1.05, 0},
+        {"Βρώμη", 0.36, 0},
+        {"Γάλα 1,5%", 1.03, 0},
+        {"Γάλα Καρύδας", 1.0, 0},
+        {"Γιαούρτι στραγγιστό 2%", 1.05, 0},
+        {"Γιαούρτι στραγγιστό 10%", 1.05, 0},
+        {"Γλυκοπατάτα", 0, 130},
+        {"Ζάχαρη", 0.85, 0},
+        {"Κακάο χωρίς ζάχαρη", 0.42, 0},
+        {"Καρότο", 0, 60},
+        {"Κολοκυθάκι", 0, 200},
+        {"Κρασί ξηρό", 0.99, 0},
+        {"Κρέμα γάλακτος 15%", 1.01, 0},
+        {"Κρέμα γάλακτος 35%", 0.99, 0},
+        {"Κρέμα καρύδας", 1.0, 0},
+        {"Κρεμμύδι ξερό", 0, 110},
+        {"Κρόκος Αυγού", 1.03, 17},
+        {"Λάδι", 0.92, 0},
+        {"Λικέρ", 1.05, 0},
+        {"Μαγιονέζα light", 0.95, 0},
+        {"Μαργαρίνη", 0.91, 0},
+        {"Μαρμελάδα", 1.33, 0},
+        {"Μέλι ή Γλυκόζη", 1.42, 0},
+        {"Μελιτζάνα", 0, 300},
+        {"Μπισκότο", 0, 8},
+        {"Νερό", 1.0, 0},
+        {"Νισεστέ", 0.54, 0},
+        {"Ντομάτα", 0, 120},
+        {"Ξύδι μπαλσάμικο", 1.06, 0},
+        {"Ουίσκι", 0.94, 0},
+        {"Πατάτα", 0, 170},
+        {"Πιπεριά", 0, 150},
+        {"Ρύζι", 0.85, 0},
+        {"Σάλτσα ντομάτας", 1.03, 0},
+        {"Σιμιγδάλι", 0.7, 0},
+        {"Σως Μήλου χωρίς ζάχαρη", 1.05, 0},
+        {"Φρυγανιά τριμμένη", 0.45, 0},
+        {"Χυμός Πορτοκάλι", 1.04, 0},
+    };
+
+    QHash<QString, Unit> buildAliases() {
+        QHash<QString, Unit> aliases;
+        for (auto &&alias : unitAliases)
+            aliases.insert(QString::fromUtf8(alias.text), alias.unit);
+        return aliases;
+    }
+
+    // user lines look like "Αυγό = 1.03, 60": density, then piece weight;
+    // either value may be left empty
+    void readUserMeasures(QHash<quint32, Units::Measure> &measures) {
+        QDir dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QFile file(dataDir.path() + "/units.cal");
+        if (!file.open(QIODevice::ReadOnly | QFile::Text))
+            return;
+        QTextStream in(&file);
+        in.setCodec(QTextCodec::codecForName("UTF-8"));
+        while (!in.atEnd()) {
+            QString line = in.readLine();
+            if (line.startsWith('#') || line.isEmpty())
+                continue;
+            QStringList pair = line.split('=');
+            if (pair.size() != 2)
+                continue;
+            quint32 key = Catalog::key(Catalog::intern(pair.first().trimmed()));
+            Units::Measure measure = measures.value(key, Units::Measure {0, 0});
+            QStringList values = pair.last().split(',');
+            bool ok;
+            double density = values.value(0).trimmed().toDouble(&ok);
+            if (ok)
+                measure.density = density;
+            double piece = values.value(1).trimmed().toDouble(&ok);
+            if (ok)
+                measure.piece = piece;
+            measures.insert(key, measure);
+        }
+    }
+
+    QHash<quint32, Units::Measure> buildMeasures() {
+        QHash<quint32, Units::Measure> measures;
+        for (auto &&builtin : builtinMeasures) {
+            quint32 key = Catalog::key(Catalog::intern(QString::fromUtf8(builtin.name)));
+            measures.insert(key, Units::Measure {builtin.density, builtin.piece});
+        }
+        readUserMeasures(measures);
+        return measures;
+    }
+
+    bool readNumber(const QString &text, int &pos, double *value, bool *integral) {
+        int start = pos;
+        while (pos < text.size() && text.at(pos).isDigit())
+            pos++;
+        if (pos == start)
+            return false;
+        *integral = true;
+        if (pos + 1 < text.size() && (text.at(pos) == '.' || text.at(pos) == ',') && text.at(pos + 1).isDigit()) {
+            *integral = false;
+            pos++;
+            while (pos < text.size() && text.at(pos).isDigit())
+                pos++;
+        }
+        *value = text.mid(start, pos - start).replace(',', '.').toDouble();
+        return true;
+    }
+
+    void skipSpaces(const QString &text, int &pos) {
+        while (pos < text.size() && text.at(pos).isSpace())
+            pos++;
+    }
+
+    // reads "n/d" at pos; leaves pos alone when there is no fraction
+    bool readFraction(const QString &text, int &pos, double *value) {
+        int p = pos;
+        double num, den;
+        bool integral;
+        if (!readNumber(text, p, &num, &integral) || !integral || p >= text.size() || text.at(p) != '/')
+            return false;
+        p++;
+        if (!readNumber(text, p, &den, &integral) || !integral || den == 0)
+            return false;
+        *value = num / den;
+        pos = p;
+        return true;
+    }
+
+    QString formatAmount(double amount, Unit unit) {
+        if (unit == Units::Gram || unit == Units::Millilitre)
+            return QString::number(qRound(amount));
+        QString number = QString::number(amount, 'f', 2);
+        while (number.endsWith('0'))
+            number.chop(1);
+        if (number.endsWith('.'))
+            number.chop(1);
+        return number;
+    }
+}
+
+namespace Units {
+    bool parse(const QString &text, Quantity *quantity, QString *unitText) {
+        int pos = 0;
+        skipSpaces(text, pos);
+        double amount {0};
+        bool integral;
+        if (!readFraction(text, pos, &amount) && readNumber(text, pos, &amount, &integral)) {
+            int whole = pos;
+            skipSpaces(text, whole);
+            double fraction;
+            if (integral && whole > pos && readFraction(text, whole, &fraction)) {
+                amount += fraction;
+                pos = whole;
+            }
+        }
+
+        QString unit = text.mid(pos).trimmed();
+        if (unitText)
+            *unitText = unit;
+        quantity->amount = amount;
+        quantity->unit = Gram;
+        if (unit.isEmpty())
+            return true;
+
+        static const QHash<QString, Unit> aliases = buildAliases();
+        auto it = aliases.constFind(Catalog::fold(unit).remove('.').remove(' '));
+        if (it == aliases.constEnd())
+            return false;
+        quantity->unit = it.value();
+        return true;
+    }
+
+    const QHash<quint32, Measure> &measures() {
+        static const QHash<quint32, Measure> table = buildMeasures();
+        return table;
+    }
+
+    Measure measure(const Ingredient &ingredient) {
+        return measures().value(Catalog::key(ingredient.nameId()), Measure {0, 0});
+    }
+
+    // For names from outside the program: looked up without adding them to
+    // the name pool. The table is built first, so its names are in the pool.
+    Measure measure(const QString &name) {
+        const QHash<quint32, Measure> &table = measures();
+        return table.value(Catalog::lookup(name), Measure {0, 0});
+    }
+
+    // Volumes of ingredients without a known density are taken as water.
+    bool toGrams(const Quantity &quantity, const Measure &measure, double *grams) {
+        if (quantity.unit == Piece) {
+            *grams = quantity.amount * measure.piece;
+            return measure.piece > 0;
+        }
+        double factor = unitFactors[quantity.unit];
+        if (isVolume(quantity.unit))
+            factor *= measure.density > 0 ? measure.density : 1.0;
+        *grams = quantity.amount * factor;
+        return true;
+    }
+
+    int grams(const QString &text, const Ingredient &ingredient) {
+        return grams(text, measure(ingredient));
+    }
+
+    int grams(const QString &text, const Measure &measure) {
+        Quantity quantity;
+        if (!parse(text, &quantity))
+            return 0;
+        if (quantity.unit == Gram)
+            return qRound(quantity.amount);
+        double result;
+        return toGrams(quantity, measure, &result) ? qRound(result) : 0;
+    }
+
+    QString scaled(const QString &text, double factor) {
+        Quantity quantity;
+        QString unit;
+        if (!parse(text, &quantity, &unit))
+            return text;
+        QString number = formatAmount(quantity.amount * factor, quantity.unit);
+        return unit.isEmpty() ? number : number + ' ' + unit;
+    }
+
+    // how a mass field reads in printed recipes
+    QString display(const QString &text) {
+        Quantity quantity;
+        QString unit;
+        if (parse(text, &quantity, &unit) && unit.isEmpty())
+            return formatAmount(quantity.amount, Gram) + " γρ.";
+        return text.trimmed();
+    }
+}
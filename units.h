@@ -0,0 +1,33 @@
+#ifndef UNITS_H
+#define UNITS_H
+
+#include "ingredient.h"
+#include <QString>
+
+// Quantities typed in the mass fields, e.g. "250", "1,5 kg", "2 φλιτζάνια",
+// "1 1/2 κ.σ." or "3 τεμ.". A bare number is grams.
+namespace Units {
+    enum Unit { Gram, Kilogram, Millilitre, Litre, Cup, Tablespoon, Teaspoon, Piece };
+
+    struct Quantity {
+        double amount;
+        Unit unit;
+    };
+
+    // grams per millilitre and grams per piece; 0 when not known
+    struct Measure {
+        double density;
+        double piece;
+    };
+
+    bool parse(const QString &text, Quantity *quantity, QString *unitText = nullptr);
+    Measure measure(const Ingredient &ingredient);
+    Measure measure(const QString &name);
+    bool toGrams(const Quantity &quantity, const Measure &measure, double *grams);
+    int grams(const QString &text, const Ingredient &ingredient);
+    int grams(const QString &text, const Measure &measure);
+    QString scaled(const QString &text, double factor);
+    QString display(const QString &text);
+}
+
+#endif // UNITS_H